@@ -4,6 +4,8 @@
 #include <QtDebug>
 
 #include <algorithm>
+#include <thread>
+#include <vector>
 
 
 #define TU AudioStreamTU
@@ -11,29 +13,89 @@ namespace TU {
 
 static const char* LOG_PREFIX = "[AudioStream]";
 
+// minimum size of the buffer, in device periods
+constexpr size_t MIN_BUFFER_PERIODS = 2;
+
+//
+// Resizes the buffer while keeping what has not been played yet. The newest
+// frames are dropped if they do not fit, the number of frames dropped is
+// returned. Neither side may access the buffer during this call.
+//
+template <typename T>
+size_t resizeKeeping(Ringbuffer<T, 2> &rb, size_t frames) {
+    if (rb.size() == frames) {
+        return 0;
+    }
+
+    auto reader = rb.reader();
+    std::vector<T> pending(reader.availableRead() * 2);
+    auto const count = reader.read(pending.data(), pending.size() / 2);
+    rb.init(frames);
+    return count - rb.writer().write(pending.data(), count);
+}
+
+//
+// Picks the device's native format and samplerate if it supports f32 or s16
+// natively. Otherwise the format is left unchanged and only the samplerate
+// is changed to the native one.
+//
+void negotiateFormat(AudioEnumerator::Device const& device, ma_format &format, ma_uint32 &samplerate) {
+    ma_device_info info;
+    if (device.context == nullptr || ma_context_get_device_info(device.context.get(), ma_device_type_playback, device.id, &info) != MA_SUCCESS) {
+        return;
+    }
+
+    // prefer f32, the format we synthesize in
+    for (auto preferred : { ma_format_f32, ma_format_s16 }) {
+        for (ma_uint32 i = 0; i < info.nativeDataFormatCount; ++i) {
+            auto const& native = info.nativeDataFormats[i];
+            if (native.format == preferred) {
+                format = native.format;
+                // 0 means any samplerate is supported
+                if (native.sampleRate != 0) {
+                    samplerate = native.sampleRate;
+                }
+                return;
+            }
+        }
+    }
+
+    // still avoid resampling if possible
+    if (info.nativeDataFormatCount != 0 && info.nativeDataFormats[0].sampleRate != 0) {
+        samplerate = info.nativeDataFormats[0].sampleRate;
+    }
+}
+
 }
 
 
 AudioStream::MaDeviceWrapper::MaDeviceWrapper() :
     mInitialized(false),
+    mContext(),
     mDevice()
 {
 }
 
 AudioStream::MaDeviceWrapper::~MaDeviceWrapper() {
-    if (mInitialized) {
-        uninit();
-    }
+    uninit();
 }
 
-ma_result AudioStream::MaDeviceWrapper::init(ma_context *ctx, ma_device_config const* config) {
-    auto result = ma_device_init(ctx, config, &mDevice);
+ma_result AudioStream::MaDeviceWrapper::init(std::shared_ptr<ma_context> const& ctx, ma_device_config const* config) {
+    auto result = ma_device_init(ctx.get(), config, &mDevice);
     mInitialized = result == MA_SUCCESS;
+    if (mInitialized) {
+        // keep the context alive for as long as the device is
+        mContext = ctx;
+    }
     return result;
 }
 
 void AudioStream::MaDeviceWrapper::uninit() {
-    ma_device_uninit(&mDevice);
+    if (mInitialized) {
+        ma_device_uninit(&mDevice);
+        mInitialized = false;
+        mContext.reset();
+    }
 }
 
 ma_device* AudioStream::MaDeviceWrapper::get() {
@@ -46,11 +108,28 @@ AudioStream::AudioStream(QObject *parent) :
     mEnabled(false),
     mRunning(false),
     mBuffer(),
-    mContext(),
-    mDevice(),
+    mBufferS16(),
+    mFormat(SampleFormat::f32),
+    mSamplerate(0),
+    mDevices(),
+    mCurrent(0),
+    mActive(nullptr),
+    mReading(false),
+    mKeptBuffer(false),
     mPlaybackDelay(0),
     mUnderruns(0),
-    mDraining(false)
+    mFramesPlayed(0),
+    mDraining(false),
+    mNextRenderFn(nullptr),
+    mNextRenderData(nullptr),
+    mRenderFn(nullptr),
+    mRenderData(nullptr),
+    mLowLatency(true),
+    mPeriodMs(0),
+    mPeriods(0),
+    mDevicePeriod(0),
+    mDevicePeriods(0),
+    mDeviceLatency(0.0)
 {
 
 }
@@ -67,63 +146,211 @@ unsigned AudioStream::underruns() const {
     return mUnderruns.load();
 }
 
+uint64_t AudioStream::framesPlayed() const {
+    return mFramesPlayed.load(std::memory_order_acquire);
+}
+
 void AudioStream::resetUnderruns() {
     mUnderruns = 0;
 }
 
 size_t AudioStream::bufferSize() const {
-    return mBuffer.size();
+    return mFormat == SampleFormat::s16 ? mBufferS16.size() : mBuffer.size();
+}
+
+SampleFormat AudioStream::format() const {
+    return mFormat;
+}
+
+int AudioStream::samplerate() const {
+    return mSamplerate;
+}
+
+size_t AudioStream::availableWrite() {
+    return mFormat == SampleFormat::s16 ? mBufferS16.writer().availableWrite() : mBuffer.writer().availableWrite();
+}
+
+void AudioStream::setBufferSize(size_t frames) {
+    if (mFormat == SampleFormat::s16) {
+        mBufferS16.writer().setSize(frames);
+    } else {
+        mBuffer.writer().setSize(frames);
+    }
 }
 
 void AudioStream::setDraining(bool draining) {
     mDraining = draining;
 }
 
+void AudioStream::setRenderCallback(RenderFn fn, void *userData) {
+    mNextRenderFn = fn;
+    mNextRenderData = userData;
+}
+
+void AudioStream::setDeviceTiming(bool lowLatency, int periodMs, int periods) {
+    mLowLatency = lowLatency;
+    mPeriodMs = std::max(0, periodMs);
+    mPeriods = std::max(0, periods);
+}
+
+size_t AudioStream::devicePeriod() const {
+    return mDevicePeriod;
+}
+
+unsigned AudioStream::devicePeriods() const {
+    return mDevicePeriods;
+}
+
+double AudioStream::deviceLatency() const {
+    return mDeviceLatency;
+}
+
+bool AudioStream::hasRenderCallback() const {
+    return mRenderFn != nullptr;
+}
+
 AudioRingbuffer::Writer AudioStream::writer() {
     return mBuffer.writer();
 }
 
-void AudioStream::open(AudioEnumerator::Device const& device, int samplerate, int latency) {
+S16Ringbuffer::Writer AudioStream::writerS16() {
+    return mBufferS16.writer();
+}
+
+bool AudioStream::open(AudioEnumerator::Device const& device, int samplerate, int latency, bool nativeFormat) {
 
     // get the current running state
-    // if we are running then we will have to start the newly opened stream
+    // if we are running then the new device is started while the current one
+    // keeps playing, and playback is then handed over to the new one
     bool running = isRunning();
 
-    // must be disabled when changing settings
-    disable();
+    if (!running) {
+        // nothing to hand over
+        disable();
+    }
 
-    // update buffer size
-    mBuffer.init((size_t)(latency * samplerate / 1000));
+    // 32-bit float stereo, unless the device has a native format we can use
+    auto format = ma_format_f32;
+    auto rate = (ma_uint32)samplerate;
+    if (nativeFormat) {
+        TU::negotiateFormat(device, format, rate);
+    }
 
     auto deviceConfig = ma_device_config_init(ma_device_type_playback);
-    // always 32-bit float stereo format
-    deviceConfig.playback.format = ma_format_f32;
+    deviceConfig.playback.format = format;
     deviceConfig.playback.channels = 2;
     deviceConfig.dataCallback = deviceDataCallback;
     deviceConfig.stopCallback = deviceStopCallback;
     deviceConfig.pUserData = this;
-    deviceConfig.sampleRate = samplerate;
+    deviceConfig.sampleRate = rate;
     deviceConfig.playback.pDeviceID = device.id;
+    deviceConfig.performanceProfile = mLowLatency ? ma_performance_profile_low_latency : ma_performance_profile_conservative;
+    deviceConfig.periodSizeInMilliseconds = (ma_uint32)mPeriodMs;
+    deviceConfig.periods = (ma_uint32)mPeriods;
 
-    mContext = device.context;
-    auto result = mDevice.init(mContext.get(), &deviceConfig);
+    auto &next = mDevices[mCurrent ^ 1];
+    auto result = next.init(device.context, &deviceConfig);
     if (result != MA_SUCCESS) {
-        handleError("could not initialize device:", result);
-        return;
+        if (running) {
+            // the current device keeps playing
+            logError("could not initialize device:", result);
+        } else {
+            handleError("could not initialize device:", result);
+        }
+        return false;
+    }
+
+    auto maDevice = next.get();
+    auto const nextFormat = maDevice->playback.format == ma_format_s16 ? SampleFormat::s16 : SampleFormat::f32;
+    auto const nextSamplerate = (int)maDevice->sampleRate;
+
+    // what the backend actually picked, which may differ from what was
+    // requested. The period is in the device's internal samplerate, convert
+    // it to ours
+    auto const internalRate = std::max((ma_uint32)1, maDevice->playback.internalSampleRate);
+    auto const internalPeriod = maDevice->playback.internalPeriodSizeInFrames;
+    auto const devicePeriod = std::max((size_t)1, (size_t)((uint64_t)internalPeriod * nextSamplerate / internalRate));
+
+    // update buffer size, no buffer is needed when rendering in the callback
+    size_t bufferFrames = 0;
+    if (!mNextRenderFn) {
+        // the device takes whole periods from the buffer, so the buffer
+        // must hold at least two of them: one being read by the device
+        // and one being written to by us. Round up to whole periods, any
+        // remainder would never be used
+        bufferFrames = std::max((size_t)(latency * nextSamplerate / 1000), devicePeriod * TU::MIN_BUFFER_PERIODS);
+        bufferFrames = (bufferFrames + devicePeriod - 1) / devicePeriod * devicePeriod;
     }
 
-    mEnabled = true;
     if (running) {
-        start();
+        // start now so that the new device's startup overlaps with the
+        // current device's playback, it plays silence until handed over
+        result = ma_device_start(maDevice);
+        if (result != MA_SUCCESS) {
+            // the current device keeps playing, only the new one is let go
+            logError("failed to start device:", result);
+            next.uninit();
+            return false;
+        }
+        acquireReader();
     }
+
+    // neither device is reading from here on. The buffered audio is kept
+    // when it is still playable, so the new device picks up where the
+    // current one left off
+    mKeptBuffer = running && !mRenderFn && !mNextRenderFn && nextFormat == mFormat && nextSamplerate == mSamplerate;
+    if (mKeptBuffer) {
+        size_t dropped;
+        if (mFormat == SampleFormat::s16) {
+            dropped = TU::resizeKeeping(mBufferS16, bufferFrames);
+        } else {
+            dropped = TU::resizeKeeping(mBuffer, bufferFrames);
+        }
+        // dropped frames are never heard, count them as played so the
+        // position stays in sync with what was written
+        mFramesPlayed.fetch_add(dropped, std::memory_order_relaxed);
+    } else {
+        mBuffer.init(nextFormat == SampleFormat::f32 ? bufferFrames : 0);
+        mBufferS16.init(nextFormat == SampleFormat::s16 ? bufferFrames : 0);
+        mPlaybackDelay = bufferFrames;
+        mFramesPlayed = 0;
+        mDraining = false;
+    }
+
+    mRenderFn = mNextRenderFn;
+    mRenderData = mNextRenderData;
+    mFormat = nextFormat;
+    mSamplerate = nextSamplerate;
+    mDevicePeriod = devicePeriod;
+    mDevicePeriods = maDevice->playback.internalPeriods;
+    mDeviceLatency = internalPeriod * mDevicePeriods * 1000.0 / internalRate;
+
+    auto &previous = mDevices[mCurrent];
+    mCurrent ^= 1;
+    mActive.store(maDevice, std::memory_order_release);
+
+    if (running) {
+        releaseReader();
+        // the previous device only plays silence now, uninit also stops it
+        previous.uninit();
+    }
+
+    mEnabled = true;
+    return true;
+}
+
+bool AudioStream::keptBuffer() const {
+    return mKeptBuffer;
 }
 
 bool AudioStream::start() {
     if (isEnabled() && !isRunning()) {
         mBuffer.reset();
-        mPlaybackDelay = mBuffer.size();
+        mBufferS16.reset();
+        mPlaybackDelay = bufferSize();
+        mFramesPlayed = 0;
         mDraining = false;
-        auto result = ma_device_start(mDevice.get());
+        auto result = ma_device_start(mDevices[mCurrent].get());
         if (result != MA_SUCCESS) {
             handleError("failed to start device:", result);
             return false;
@@ -138,7 +365,7 @@ bool AudioStream::stop() {
     if (isRunning()) {
         mRunning = false;
 
-        auto result = ma_device_stop(mDevice.get());
+        auto result = ma_device_stop(mDevices[mCurrent].get());
         if (result != MA_SUCCESS) {
             handleError("failed to stop device:", result);
             return false;
@@ -150,24 +377,60 @@ bool AudioStream::stop() {
 
 void AudioStream::disable() {
     mRunning = false;
-    if (mEnabled) {
-        mEnabled = false;
-        mDevice.uninit();
+    mKeptBuffer = false;
+    mEnabled = false;
+    // let go of both devices, uninit also stops them
+    mDevices[0].uninit();
+    mDevices[1].uninit();
+    mActive.store(nullptr, std::memory_order_release);
+}
+
+void AudioStream::acquireReader() {
+    // the data callback only holds it for the duration of a callback
+    while (mReading.exchange(true, std::memory_order_acquire)) {
+        std::this_thread::yield();
     }
 }
 
+bool AudioStream::tryAcquireReader(ma_device *device) {
+    if (mReading.exchange(true, std::memory_order_acquire)) {
+        return false;
+    }
+    // while a device is playing, the active device is only changed with the
+    // reader taken, so it is checked after taking it
+    if (device != mActive.load(std::memory_order_acquire)) {
+        releaseReader();
+        return false;
+    }
+    return true;
+}
+
+void AudioStream::releaseReader() {
+    mReading.store(false, std::memory_order_release);
+}
+
 
 
 void AudioStream::deviceDataCallback(ma_device *device, void *out, const void *in, ma_uint32 frames) {
     Q_UNUSED(in)
 
-    static_cast<AudioStream*>(device->pUserData)->handleData(
-        static_cast<float*>(out),
-        (size_t)frames
-    );
+    // only the active device plays from the buffer, a device being switched
+    // to or from plays silence
+    auto stream = static_cast<AudioStream*>(device->pUserData);
+    if (stream->tryAcquireReader(device)) {
+        stream->handleData(out, (size_t)frames);
+        stream->releaseReader();
+    }
 }
 
-void AudioStream::handleData(float *out, size_t frames) {
+void AudioStream::handleData(void *out, size_t frames) {
+
+    if (mRenderFn) {
+        // pull mode, render exactly what the device wants
+        mRenderFn(mRenderData, out, frames);
+        mFramesPlayed.fetch_add(frames, std::memory_order_release);
+        return;
+    }
 
     // an entire buffer's worth of silence is played when the stream is started
     // this gives the us ample time to fill the buffer before playing from it.
@@ -178,11 +441,18 @@ void AudioStream::handleData(float *out, size_t frames) {
         frames -= samples;
         // miniaudio clears the output buffer before calling the callback
         // so just seek the output pointer
-        out += samples * 2;
+        out = static_cast<char*>(out) + (samples * 2 * sampleSize(mFormat));
         mPlaybackDelay -= samples;
     }
 
-    auto nread = mBuffer.reader().fullRead(out, frames);
+    // the buffer is already in the device's format, this is just a copy
+    size_t nread;
+    if (mFormat == SampleFormat::s16) {
+        nread = mBufferS16.reader().read(static_cast<int16_t*>(out), frames);
+    } else {
+        nread = mBuffer.reader().read(static_cast<float*>(out), frames);
+    }
+    mFramesPlayed.fetch_add(nread, std::memory_order_release);
     if (nread < frames && !mDraining) {
         ++mUnderruns;
     }
@@ -190,7 +460,12 @@ void AudioStream::handleData(float *out, size_t frames) {
 
 void AudioStream::deviceStopCallback(ma_device *device) {
     // on explicit stops, abort does nothing, since isRunning() = false
-    static_cast<AudioStream*>(device->pUserData)->handleStop();
+    // the device being switched from is stopped while the stream is running,
+    // that is not an abort either
+    auto stream = static_cast<AudioStream*>(device->pUserData);
+    if (device == stream->mActive.load(std::memory_order_acquire)) {
+        stream->handleStop();
+    }
 }
 
 void AudioStream::handleStop() {
@@ -205,11 +480,15 @@ void AudioStream::handleStop() {
     }
 }
 
-void AudioStream::handleError(const char *msg, ma_result err) {
+void AudioStream::logError(const char *msg, ma_result err) {
     qCritical().noquote()
         << TU::LOG_PREFIX
         << msg
         << ma_result_description(err);
+}
+
+void AudioStream::handleError(const char *msg, ma_result err) {
+    logError(msg, err);
     disable();
 }
 
@@ -2,6 +2,7 @@
 
 #include "audio/AudioEnumerator.hpp"
 #include "audio/Ringbuffer.hpp"
+#include "audio/SampleFormat.hpp"
 
 #include "miniaudio.h"
 
@@ -9,6 +10,8 @@
 
 #include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <memory>
 
 //
 // AudioStream class. Manages a miniaudio device and a playback buffer for
@@ -19,14 +22,23 @@ class AudioStream : public QObject {
     Q_OBJECT
 
 public:
+
+    //
+    // Callback function for rendering audio directly into the device's
+    // output buffer. The callback must write the given number of frames to
+    // out (interleaved stereo, in the stream's format()), the buffer is silent
+    // before it is called. Called from the device's thread.
+    //
+    using RenderFn = void(*)(void *userData, void *out, size_t frames);
+
     explicit AudioStream(QObject *parent = nullptr);
 
     //
     // Determines if the stream is enabled. If enabled, audio can be played
     // out by starting the stream and then writing to its buffer. The stream
-    // is disabled if open() fails or if a device error occurs when starting
-    // or stopping the stream. The only way to enable the stream is by calling
-    // open().
+    // is disabled if open() fails while not running or if a device error
+    // occurs when starting or stopping the stream. The only way to enable the
+    // stream is by calling open().
     //
     bool isEnabled() const;
 
@@ -43,31 +55,133 @@ public:
     //
     unsigned underruns() const;
 
+    //
+    // Gets the number of frames played out since the stream was last
+    // started. Only frames taken from the buffer (or rendered by the render
+    // callback) are counted, the silence played at startup or during an
+    // underrun is not. Can be called from any thread.
+    //
+    uint64_t framesPlayed() const;
+
     //
     // Gets the size of the buffer, in samples. The size of the buffer is determined
-    // by the latency parameter in open().
+    // by the latency parameter in open(), rounded up to whole device periods.
     //
     size_t bufferSize() const;
 
+    //
+    // Gets the sample format of the stream, as negotiated by the last call
+    // to open(). Only the buffer for this format is used, see writer() and
+    // writerS16().
+    //
+    SampleFormat format() const;
+
+    //
+    // Gets the samplerate of the stream, as negotiated by the last call to
+    // open().
+    //
+    int samplerate() const;
+
+    //
+    // Number of frames that can be written to the buffer. Must only be
+    // called by the buffer's writer.
+    //
+    size_t availableWrite();
+
+    //
+    // Changes the usable size of the buffer, up to the size set by open().
+    // Must only be called by the buffer's writer.
+    //
+    void setBufferSize(size_t frames);
+
     void setDraining(bool draining);
 
+    //
+    // Sets the render callback. When set, the stream no longer plays from its
+    // buffer and instead calls this function from the device's data callback
+    // for exactly the frames the device needs ("pull mode"). Pass nullptr to
+    // use the buffer again. Takes effect on the next call to open().
+    //
+    void setRenderCallback(RenderFn fn, void *userData = nullptr);
+
+    //
+    // Determines if the stream renders via a render callback, as set by the
+    // last call to open().
+    //
+    bool hasRenderCallback() const;
+
+    //
+    // Sets the timing to request from the device on the next open(). The low
+    // latency profile lets the backend pick smaller periods than the
+    // conservative one. periodMs is the size of a device period, in
+    // milliseconds, and periods is the number of periods in the device's
+    // buffer, 0 for either lets the backend decide.
+    //
+    void setDeviceTiming(bool lowLatency, int periodMs, int periods);
+
+    //
+    // Size, in frames, of a period of the opened device, as picked by the
+    // backend. In timer mode, the buffer size is a multiple of it.
+    //
+    size_t devicePeriod() const;
+
+    //
+    // Number of periods in the opened device's buffer, as picked by the
+    // backend.
+    //
+    unsigned devicePeriods() const;
+
+    //
+    // Latency, in milliseconds, of the opened device's buffer. This is the
+    // latency added by the backend on top of our own buffer.
+    //
+    double deviceLatency() const;
+
     //
     // Resets the underrun counter to 0.
     //
     void resetUnderruns();
 
     //
-    // Opens an output stream for the configured device.
-    // On success the stream is enabled, and audio can now be played out. On
-    // failure the stream is disabled. If the stream was running when this
-    // function is called, it is stopped and then restarted.
+    // Opens an output stream for the configured device, returns true on
+    // success. On success the stream is enabled, and audio can now be played
+    // out. On failure the stream is disabled, unless it was running.
+    //
+    // If the stream was running when this function is called, the new device
+    // is started while the current one keeps playing and then playback is
+    // switched over to it. If the new device could not be initialized or
+    // started, the current one is kept and keeps playing. When the format
+    // and samplerate stay the same and
+    // the buffer is used before and after, the buffer's contents are kept
+    // (see keptBuffer()) and the switch is seamless. The buffer's writer must
+    // not be writing during this call.
+    //
+    // When nativeFormat is true, the device's native samplerate and format
+    // are used instead of the given samplerate and f32, if the device
+    // supports s16 or f32. This way no conversion or resampling is done by
+    // miniaudio. Use format() and samplerate() to get the result.
     //
     // NOTE: this function should only be called from the GUI thread
     //
-    void open(AudioEnumerator::Device const& device, int samplerate, int latency);
+    bool open(AudioEnumerator::Device const& device, int samplerate, int latency, bool nativeFormat = false);
 
+    //
+    // Determines if the last call to open() switched devices while running
+    // and kept the audio in the buffer. If so, framesPlayed() continues from
+    // where it was, otherwise the stream starts over as with start().
+    //
+    bool keptBuffer() const;
+
+    //
+    // Writer for the buffer when format() is f32
+    //
     AudioRingbuffer::Writer writer();
 
+    //
+    // Writer for the buffer when format() is s16
+    //
+    S16Ringbuffer::Writer writerS16();
+
     bool start();
 
     bool stop();
@@ -81,13 +195,30 @@ signals:
 private:
 
     static void deviceDataCallback(ma_device *device, void *out, const void *in, ma_uint32 frames);
-    void handleData(float *out, size_t frames);
+    void handleData(void *out, size_t frames);
 
     static void deviceStopCallback(ma_device *device);
     void handleStop();
 
+    static void logError(const char *msg, ma_result err);
+
     void handleError(const char *msg, ma_result err);
 
+    //
+    // Takes exclusive access to the buffer's reader (and the render
+    // callback) away from the data callback, waiting for it to finish if it
+    // is in progress. The data callback plays silence until released.
+    //
+    void acquireReader();
+
+    //
+    // Called by the data callback for the given device, false is returned if
+    // the device is not the active one or if the reader is taken.
+    //
+    bool tryAcquireReader(ma_device *device);
+
+    void releaseReader();
+
     //
     // Wrapper for a ma_device, ensures that the wrapped device is uninit'd on
     // destruction.
@@ -98,27 +229,58 @@ private:
         MaDeviceWrapper();
         ~MaDeviceWrapper();
 
-        ma_result init(ma_context *ctx, ma_device_config const* config);
+        ma_result init(std::shared_ptr<ma_context> const& ctx, ma_device_config const* config);
 
+        //
+        // Uninitializes the device if initialized, stopping it.
+        //
         void uninit();
 
         ma_device* get();
 
     private:
         bool mInitialized;
+        std::shared_ptr<ma_context> mContext;
         ma_device mDevice;
     };
 
     bool mEnabled;
     std::atomic_bool mRunning;
+    // only one of these is used, depending on the format
     AudioRingbuffer mBuffer;
-
-    std::shared_ptr<ma_context> mContext;
-    MaDeviceWrapper mDevice;
+    S16Ringbuffer mBufferS16;
+    SampleFormat mFormat;
+    int mSamplerate;
+
+    // the current device and the one being switched to, only the active
+    // device plays audio. A ma_device cannot be moved, hence the index
+    MaDeviceWrapper mDevices[2];
+    int mCurrent;
+    std::atomic<ma_device*> mActive;
+    // set while the buffer's reader is in use, see acquireReader()
+    std::atomic_bool mReading;
+    bool mKeptBuffer;
     size_t mPlaybackDelay;
 
     std::atomic_uint mUnderruns;
+    std::atomic_uint64_t mFramesPlayed;
     std::atomic_bool mDraining;
 
+    // render callback to use for the next open()
+    RenderFn mNextRenderFn;
+    void *mNextRenderData;
+    // render callback for the opened device, only modified when disabled
+    RenderFn mRenderFn;
+    void *mRenderData;
+
+    // device timing to request for the next open()
+    bool mLowLatency;
+    int mPeriodMs;
+    int mPeriods;
+    // device timing picked by the backend, set by open()
+    size_t mDevicePeriod;
+    unsigned mDevicePeriods;
+    double mDeviceLatency;
+
 };
 
@@ -0,0 +1,41 @@
+
+#include "audio/FanoutApu.hpp"
+
+FanoutApu::FanoutApu(ChannelOutput::Flags channels) :
+    DefaultApu(),
+    mPanMask(panMask(channels)),
+    mOutputs(),
+    mPanning(0)
+{
+}
+
+void FanoutApu::addOutput(trackerboy::IApuIo &apu, ChannelOutput::Flags channels) {
+    mOutputs.push_back({ &apu, panMask(channels) });
+}
+
+uint8_t FanoutApu::readRegister(uint8_t reg) {
+    if (reg == REG_NR51) {
+        return mPanning;
+    }
+    return DefaultApu::readRegister(reg);
+}
+
+void FanoutApu::writeRegister(uint8_t reg, uint8_t value) {
+    if (reg == REG_NR51) {
+        mPanning = value;
+        DefaultApu::writeRegister(reg, value & mPanMask);
+        for (auto &output : mOutputs) {
+            output.apu->writeRegister(reg, value & output.panMask);
+        }
+    } else {
+        DefaultApu::writeRegister(reg, value);
+        for (auto &output : mOutputs) {
+            output.apu->writeRegister(reg, value);
+        }
+    }
+}
+
+uint8_t FanoutApu::panMask(ChannelOutput::Flags channels) {
+    auto const bits = (uint8_t)channels;
+    return (uint8_t)(bits | (bits << 4));
+}
@@ -0,0 +1,56 @@
+
+#pragma once
+
+#include "core/ChannelOutput.hpp"
+
+#include "trackerboy/apu/DefaultApu.hpp"
+
+#include <cstdint>
+#include <vector>
+
+//
+// APU that forwards every register write to other APUs, so that a single
+// engine can drive several of them. Used for rendering channels to separate
+// outputs in a single pass: the engine steps once per frame and each APU only
+// outputs its own channels.
+//
+// Channels are isolated by masking NR51 writes. All channels are still
+// emulated in every APU, but only the given channels are sent to the
+// terminals, keeping each channel's panning. Reads are handled by this APU,
+// with NR51 reading back what the engine last wrote.
+//
+class FanoutApu : public trackerboy::DefaultApu {
+
+public:
+
+    explicit FanoutApu(ChannelOutput::Flags channels = ChannelOutput::AllOn);
+
+    //
+    // Adds an APU that receives every register write, outputting only the
+    // given channels. The APU must outlive this one.
+    //
+    void addOutput(trackerboy::IApuIo &apu, ChannelOutput::Flags channels);
+
+    virtual uint8_t readRegister(uint8_t reg) override;
+
+    virtual void writeRegister(uint8_t reg, uint8_t value) override;
+
+private:
+
+    struct Output {
+        trackerboy::IApuIo *apu;
+        uint8_t panMask;
+    };
+
+    //
+    // NR51 mask for the given channels, each channel has a bit for the left
+    // and right terminal.
+    //
+    static uint8_t panMask(ChannelOutput::Flags channels);
+
+    uint8_t mPanMask;
+    std::vector<Output> mOutputs;
+    // unmasked NR51, as written by the engine
+    uint8_t mPanning;
+
+};
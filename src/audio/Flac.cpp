@@ -0,0 +1,750 @@
+
+#include "audio/Flac.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <climits>
+#include <cmath>
+
+#define TU FlacTU
+namespace TU {
+
+constexpr int MAX_FIXED_ORDER = 4;
+constexpr int MAX_LPC_ORDER = 8;
+constexpr int MAX_PARTITION_ORDER = 8;
+constexpr int MAX_RICE_PARAM = 14;
+
+// blocks smaller than this are not worth an LPC analysis
+constexpr int MIN_LPC_BLOCK = 64;
+
+constexpr double PI = 3.14159265358979323846;
+constexpr double LN2 = 0.69314718055994530942;
+
+// size of a subframe header, in bits
+constexpr std::size_t SUBFRAME_HEADER_BITS = 8;
+
+//
+// Writes big endian bit fields to a byte buffer
+//
+class BitWriter {
+
+public:
+    BitWriter() :
+        mBytes(),
+        mAccum(0),
+        mBits(0)
+    {
+    }
+
+    void clear() {
+        mBytes.clear();
+        mAccum = 0;
+        mBits = 0;
+    }
+
+    //
+    // Writes the low n bits of value, n is at most 32.
+    //
+    void write(uint32_t value, int n) {
+        if (n == 0) {
+            return;
+        }
+        mAccum = (mAccum << n) | (value & (uint32_t)((UINT64_C(1) << n) - 1));
+        mBits += n;
+        while (mBits >= 8) {
+            mBits -= 8;
+            mBytes.push_back((uint8_t)(mAccum >> mBits));
+        }
+    }
+
+    void writeSigned(int32_t value, int n) {
+        write((uint32_t)value, n);
+    }
+
+    //
+    // Writes value as n zeros followed by a one
+    //
+    void writeUnary(uint32_t value) {
+        while (value >= 32) {
+            write(0, 32);
+            value -= 32;
+        }
+        write(1, value + 1);
+    }
+
+    void writeRice(uint32_t value, int param) {
+        writeUnary(value >> param);
+        write(value, param);
+    }
+
+    //
+    // Pads with zeros to the next byte
+    //
+    void align() {
+        if (mBits) {
+            write(0, 8 - mBits);
+        }
+    }
+
+    std::vector<uint8_t> const& bytes() const {
+        return mBytes;
+    }
+
+private:
+    std::vector<uint8_t> mBytes;
+    uint64_t mAccum;
+    int mBits;
+};
+
+uint8_t crc8(uint8_t const *data, std::size_t size) {
+    // polynomial x^8 + x^2 + x + 1, only used for the small frame header
+    uint8_t crc = 0;
+    while (size--) {
+        crc ^= *data++;
+        for (int i = 0; i < 8; ++i) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+uint16_t crc16(uint8_t const *data, std::size_t size) {
+    // polynomial x^16 + x^15 + x^2 + 1
+    static auto const table = []() {
+        std::array<uint16_t, 256> result{};
+        for (unsigned i = 0; i < 256; ++i) {
+            unsigned crc = i << 8;
+            for (int j = 0; j < 8; ++j) {
+                crc = (crc & 0x8000) ? (crc << 1) ^ 0x8005 : crc << 1;
+            }
+            result[i] = (uint16_t)crc;
+        }
+        return result;
+    }();
+
+    uint16_t crc = 0;
+    while (size--) {
+        crc = (uint16_t)((crc << 8) ^ table[(crc >> 8) ^ *data++]);
+    }
+    return crc;
+}
+
+//
+// Maps a signed residual to unsigned for Rice coding: 0, -1, 1, -2, 2, ...
+//
+uint32_t fold(int32_t residual) {
+    return ((uint32_t)residual << 1) ^ (uint32_t)(residual >> 31);
+}
+
+//
+// Picks the Rice parameter for a partition from the sum of its folded
+// residuals, returning the estimated size of its samples in bits.
+//
+std::size_t riceBits(uint64_t sum, int count, int &param) {
+    param = 0;
+    if (count == 0) {
+        return 0;
+    }
+    while (param < MAX_RICE_PARAM && ((uint64_t)count << (param + 1)) <= sum) {
+        ++param;
+    }
+    return (std::size_t)count * (param + 1) + (std::size_t)(sum >> param);
+}
+
+enum class SubframeType {
+    constant,
+    verbatim,
+    fixed,
+    lpc
+};
+
+//
+// The encoding picked for a channel in a frame
+//
+struct Subframe {
+    SubframeType type;
+    int bps;
+    int order;
+    int precision;
+    int shift;
+    std::array<int32_t, MAX_LPC_ORDER> coefs;
+    int partitionOrder;
+    std::array<int, 1 << MAX_PARTITION_ORDER> params;
+    std::size_t bits;
+    // folded residual of the predictor
+    std::vector<uint32_t> residual;
+};
+
+//
+// Encodes blocks of samples to frames. Keeps its buffers between frames so
+// that encoding does not allocate.
+//
+class Encoder {
+
+public:
+    Encoder(int channels, int bits) :
+        mChannels(channels),
+        mBits(bits),
+        mSignals(channels == 2 ? 4 : channels),
+        mSubframes(mSignals.size()),
+        mScratch(),
+        mWindow(),
+        mWindowed(),
+        mWriter()
+    {
+        for (auto &signal : mSignals) {
+            signal.resize(Flac::BLOCK_SIZE);
+        }
+        for (auto &subframe : mSubframes) {
+            subframe.residual.resize(Flac::BLOCK_SIZE);
+        }
+        mScratch.resize(Flac::BLOCK_SIZE);
+        mWindowed.resize(Flac::BLOCK_SIZE);
+    }
+
+    //
+    // Encodes a block of interleaved samples as a frame.
+    //
+    std::vector<uint8_t> const& encode(int32_t const *samples, int frames, uint32_t frameNumber) {
+        // deinterleave
+        for (int ch = 0; ch < mChannels; ++ch) {
+            auto &signal = mSignals[ch];
+            for (int i = 0; i < frames; ++i) {
+                signal[i] = samples[i * mChannels + ch];
+            }
+        }
+
+        int assignment = mChannels - 1;
+        std::array<int, 2> picked = { 0, 1 };
+        if (mChannels == 2) {
+            // side is one bit wider than the input
+            auto &mid = mSignals[2];
+            auto &side = mSignals[3];
+            for (int i = 0; i < frames; ++i) {
+                auto const left = mSignals[0][i];
+                auto const right = mSignals[1][i];
+                mid[i] = (left + right) >> 1;
+                side[i] = left - right;
+            }
+            plan(mSignals[0].data(), frames, mBits, mSubframes[0]);
+            plan(mSignals[1].data(), frames, mBits, mSubframes[1]);
+            plan(mid.data(), frames, mBits, mSubframes[2]);
+            plan(side.data(), frames, mBits + 1, mSubframes[3]);
+
+            auto const leftBits = mSubframes[0].bits;
+            auto const rightBits = mSubframes[1].bits;
+            auto const midBits = mSubframes[2].bits;
+            auto const sideBits = mSubframes[3].bits;
+            // independent, left/side, right/side, mid/side
+            std::array<std::size_t, 4> const totals = {
+                leftBits + rightBits,
+                leftBits + sideBits,
+                sideBits + rightBits,
+                midBits + sideBits
+            };
+            auto const best = std::min_element(totals.begin(), totals.end()) - totals.begin();
+            static constexpr std::array<std::array<int, 2>, 4> PAIRS = {{
+                { 0, 1 }, { 0, 3 }, { 3, 1 }, { 2, 3 }
+            }};
+            picked = PAIRS[best];
+            assignment = best == 0 ? 1 : 7 + (int)best;
+        } else {
+            for (int ch = 0; ch < mChannels; ++ch) {
+                plan(mSignals[ch].data(), frames, mBits, mSubframes[ch]);
+            }
+        }
+
+        mWriter.clear();
+        // frame header
+        mWriter.write(0x3FFE, 14);      // sync code
+        mWriter.write(0, 1);            // reserved
+        mWriter.write(0, 1);            // fixed blocksize
+        mWriter.write(7, 4);            // blocksize - 1 at the end of the header
+        mWriter.write(0, 4);            // samplerate from STREAMINFO
+        mWriter.write(assignment, 4);
+        mWriter.write(mBits == 24 ? 6 : 4, 3);
+        mWriter.write(0, 1);            // reserved
+        writeFrameNumber(frameNumber);
+        mWriter.write(frames - 1, 16);
+        mWriter.write(crc8(mWriter.bytes().data(), mWriter.bytes().size()), 8);
+
+        if (mChannels == 2) {
+            for (auto index : picked) {
+                writeSubframe(mSubframes[index], mSignals[index].data(), frames);
+            }
+        } else {
+            for (int ch = 0; ch < mChannels; ++ch) {
+                writeSubframe(mSubframes[ch], mSignals[ch].data(), frames);
+            }
+        }
+
+        mWriter.align();
+        mWriter.write(crc16(mWriter.bytes().data(), mWriter.bytes().size()), 16);
+        return mWriter.bytes();
+    }
+
+private:
+
+    //
+    // Frame numbers are coded like UTF-8
+    //
+    void writeFrameNumber(uint32_t number) {
+        if (number < 0x80) {
+            mWriter.write(number, 8);
+            return;
+        }
+        int bytes = 2;
+        while (bytes < 6 && number >= (1u << (5 * bytes + 1))) {
+            ++bytes;
+        }
+        auto shift = 6 * (bytes - 1);
+        mWriter.write((0xFF00u >> bytes) | (number >> shift), 8);
+        while (shift) {
+            shift -= 6;
+            mWriter.write(0x80 | ((number >> shift) & 0x3F), 8);
+        }
+    }
+
+    //
+    // Finds the partition order and Rice parameters with the smallest size
+    // for a residual, returning the size of the residual in bits.
+    //
+    static std::size_t planResidual(uint32_t const *residual, int blocksize, int order, Subframe &out) {
+        int maxOrder = MAX_PARTITION_ORDER;
+        while (maxOrder > 0 && ((blocksize & ((1 << maxOrder) - 1)) || (blocksize >> maxOrder) <= order)) {
+            --maxOrder;
+        }
+
+        // sums of the finest partitions, merged for the coarser ones
+        std::array<uint64_t, 1 << MAX_PARTITION_ORDER> sums;
+        {
+            auto const size = blocksize >> maxOrder;
+            for (int p = 0; p < (1 << maxOrder); ++p) {
+                auto const begin = std::max(p * size, order) - order;
+                auto const end = (p + 1) * size - order;
+                uint64_t sum = 0;
+                for (int i = begin; i < end; ++i) {
+                    sum += residual[i];
+                }
+                sums[p] = sum;
+            }
+        }
+
+        std::size_t best = SIZE_MAX;
+        std::array<int, 1 << MAX_PARTITION_ORDER> params;
+        for (int porder = maxOrder; porder >= 0; --porder) {
+            auto const partitions = 1 << porder;
+            auto const size = blocksize >> porder;
+            // coding method and partition order
+            std::size_t bits = 2 + 4;
+            for (int p = 0; p < partitions; ++p) {
+                bits += 4 + riceBits(sums[p], p == 0 ? size - order : size, params[p]);
+            }
+            if (bits < best) {
+                best = bits;
+                out.partitionOrder = porder;
+                std::copy_n(params.begin(), partitions, out.params.begin());
+            }
+            for (int p = 0; p < partitions / 2; ++p) {
+                sums[p] = sums[p * 2] + sums[p * 2 + 1];
+            }
+        }
+        return best;
+    }
+
+    //
+    // Picks the smallest encoding for a channel
+    //
+    void plan(int32_t const *x, int n, int bps, Subframe &out) {
+        out.bps = bps;
+
+        if (std::all_of(x + 1, x + n, [x](int32_t sample) { return sample == x[0]; })) {
+            out.type = SubframeType::constant;
+            out.bits = SUBFRAME_HEADER_BITS + bps;
+            return;
+        }
+
+        out.type = SubframeType::verbatim;
+        out.bits = SUBFRAME_HEADER_BITS + (std::size_t)n * bps;
+
+        planFixed(x, n, bps, out);
+        if (n >= MIN_LPC_BLOCK) {
+            planLpc(x, n, bps, out);
+        }
+    }
+
+    void planFixed(int32_t const *x, int n, int bps, Subframe &out) {
+        auto const maxOrder = std::min(MAX_FIXED_ORDER, n - 1);
+
+        // pick the order with the smallest residual, then size it
+        std::array<uint64_t, MAX_FIXED_ORDER + 1> errors{};
+        for (int i = MAX_FIXED_ORDER; i < n; ++i) {
+            int64_t const e0 = x[i];
+            int64_t const e1 = e0 - x[i - 1];
+            int64_t const e2 = e1 - (x[i - 1] - (int64_t)x[i - 2]);
+            int64_t const e3 = e2 - (x[i - 1] - 2 * (int64_t)x[i - 2] + x[i - 3]);
+            int64_t const e4 = e3 - (x[i - 1] - 3 * (int64_t)x[i - 2] + 3 * (int64_t)x[i - 3] - x[i - 4]);
+            errors[0] += (uint64_t)std::abs(e0);
+            errors[1] += (uint64_t)std::abs(e1);
+            errors[2] += (uint64_t)std::abs(e2);
+            errors[3] += (uint64_t)std::abs(e3);
+            errors[4] += (uint64_t)std::abs(e4);
+        }
+        auto const order = (int)(std::min_element(errors.begin(), errors.begin() + maxOrder + 1) - errors.begin());
+
+        auto residual = mScratch.data();
+        for (int i = order; i < n; ++i) {
+            int64_t prediction;
+            switch (order) {
+                case 0:
+                    prediction = 0;
+                    break;
+                case 1:
+                    prediction = x[i - 1];
+                    break;
+                case 2:
+                    prediction = 2 * (int64_t)x[i - 1] - x[i - 2];
+                    break;
+                case 3:
+                    prediction = 3 * (int64_t)x[i - 1] - 3 * (int64_t)x[i - 2] + x[i - 3];
+                    break;
+                default:
+                    prediction = 4 * (int64_t)x[i - 1] - 6 * (int64_t)x[i - 2] + 4 * (int64_t)x[i - 3] - x[i - 4];
+                    break;
+            }
+            residual[i - order] = fold((int32_t)(x[i] - prediction));
+        }
+
+        Subframe candidate;
+        auto const bits = SUBFRAME_HEADER_BITS + (std::size_t)order * bps + planResidual(residual, n, order, candidate);
+        if (bits < out.bits) {
+            out.type = SubframeType::fixed;
+            out.order = order;
+            out.partitionOrder = candidate.partitionOrder;
+            out.params = candidate.params;
+            out.bits = bits;
+            std::copy_n(residual, n - order, out.residual.begin());
+        }
+    }
+
+    void planLpc(int32_t const *x, int n, int bps, Subframe &out) {
+        // Hann windowed autocorrelation
+        if ((int)mWindow.size() != n) {
+            mWindow.resize(n);
+            for (int i = 0; i < n; ++i) {
+                mWindow[i] = 0.5 - 0.5 * std::cos(2.0 * PI * i / (n - 1));
+            }
+        }
+        for (int i = 0; i < n; ++i) {
+            mWindowed[i] = x[i] * mWindow[i];
+        }
+        std::array<double, MAX_LPC_ORDER + 1> autoc{};
+        for (int lag = 0; lag <= MAX_LPC_ORDER; ++lag) {
+            double sum = 0.0;
+            for (int i = lag; i < n; ++i) {
+                sum += mWindowed[i] * mWindowed[i - lag];
+            }
+            autoc[lag] = sum;
+        }
+        if (autoc[0] <= 0.0) {
+            return;
+        }
+
+        // Levinson-Durbin recursion, coefficients for every order up to the
+        // maximum along with their prediction error
+        std::array<std::array<double, MAX_LPC_ORDER>, MAX_LPC_ORDER> coefs{};
+        std::array<double, MAX_LPC_ORDER> errors{};
+        std::array<double, MAX_LPC_ORDER> lpc{};
+        double err = autoc[0];
+        int orders = 0;
+        for (int i = 0; i < MAX_LPC_ORDER; ++i) {
+            double r = -autoc[i + 1];
+            for (int j = 0; j < i; ++j) {
+                r -= lpc[j] * autoc[i - j];
+            }
+            r /= err;
+            lpc[i] = r;
+            int j = 0;
+            for (; j < (i >> 1); ++j) {
+                auto const tmp = lpc[j];
+                lpc[j] += r * lpc[i - 1 - j];
+                lpc[i - 1 - j] += r * tmp;
+            }
+            if (i & 1) {
+                lpc[j] += lpc[j] * r;
+            }
+            err *= 1.0 - r * r;
+            for (j = 0; j <= i; ++j) {
+                coefs[i][j] = -lpc[j];
+            }
+            errors[i] = err;
+            ++orders;
+            if (err <= 0.0) {
+                break;
+            }
+        }
+
+        auto const precision = bps <= 16 ? 13 : 15;
+
+        // estimate the size of each order from its error, encode the best
+        int order = 0;
+        double bestEstimate = HUGE_VAL;
+        for (int i = 0; i < orders; ++i) {
+            auto const residualBits = errors[i] > 0.0
+                ? std::max(0.0, 0.5 * std::log2(errors[i] * LN2 * LN2 / n))
+                : 0.0;
+            auto const estimate = residualBits * (n - i - 1) + (i + 1) * (bps + precision);
+            if (estimate < bestEstimate) {
+                bestEstimate = estimate;
+                order = i + 1;
+            }
+        }
+
+        // quantize the coefficients, carrying the rounding error forward
+        auto const& lp = coefs[order - 1];
+        double cmax = 0.0;
+        for (int i = 0; i < order; ++i) {
+            cmax = std::max(cmax, std::abs(lp[i]));
+        }
+        if (cmax <= 0.0) {
+            return;
+        }
+        int log2cmax;
+        std::frexp(cmax, &log2cmax);
+        // one bit of the precision is the sign
+        auto const shift = std::min(precision - log2cmax - 1, 15);
+        if (shift < 0) {
+            return;
+        }
+        int32_t const qmax = (1 << (precision - 1)) - 1;
+        int32_t const qmin = -qmax - 1;
+        std::array<int32_t, MAX_LPC_ORDER> qlp{};
+        double error = 0.0;
+        for (int i = 0; i < order; ++i) {
+            error += lp[i] * (1 << shift);
+            auto const q = std::clamp((int32_t)std::lround(error), qmin, qmax);
+            error -= q;
+            qlp[i] = q;
+        }
+
+        auto residual = mScratch.data();
+        for (int i = order; i < n; ++i) {
+            int64_t sum = 0;
+            for (int j = 0; j < order; ++j) {
+                sum += (int64_t)qlp[j] * x[i - 1 - j];
+            }
+            auto const r = x[i] - (sum >> shift);
+            if (r < INT32_MIN || r > INT32_MAX) {
+                return;
+            }
+            residual[i - order] = fold((int32_t)r);
+        }
+
+        Subframe candidate;
+        auto const bits = SUBFRAME_HEADER_BITS + (std::size_t)order * bps + 4 + 5 + (std::size_t)order * precision
+            + planResidual(residual, n, order, candidate);
+        if (bits < out.bits) {
+            out.type = SubframeType::lpc;
+            out.order = order;
+            out.precision = precision;
+            out.shift = shift;
+            out.coefs = qlp;
+            out.partitionOrder = candidate.partitionOrder;
+            out.params = candidate.params;
+            out.bits = bits;
+            std::copy_n(residual, n - order, out.residual.begin());
+        }
+    }
+
+    void writeSubframe(Subframe const& sub, int32_t const *x, int n) {
+        mWriter.write(0, 1);
+        switch (sub.type) {
+            case SubframeType::constant:
+                mWriter.write(0, 6);
+                mWriter.write(0, 1);
+                mWriter.writeSigned(x[0], sub.bps);
+                return;
+            case SubframeType::verbatim:
+                mWriter.write(1, 6);
+                mWriter.write(0, 1);
+                for (int i = 0; i < n; ++i) {
+                    mWriter.writeSigned(x[i], sub.bps);
+                }
+                return;
+            case SubframeType::fixed:
+                mWriter.write(8 | sub.order, 6);
+                mWriter.write(0, 1);
+                for (int i = 0; i < sub.order; ++i) {
+                    mWriter.writeSigned(x[i], sub.bps);
+                }
+                break;
+            case SubframeType::lpc:
+                mWriter.write(32 | (sub.order - 1), 6);
+                mWriter.write(0, 1);
+                for (int i = 0; i < sub.order; ++i) {
+                    mWriter.writeSigned(x[i], sub.bps);
+                }
+                mWriter.write(sub.precision - 1, 4);
+                mWriter.writeSigned(sub.shift, 5);
+                for (int i = 0; i < sub.order; ++i) {
+                    mWriter.writeSigned(sub.coefs[i], sub.precision);
+                }
+                break;
+        }
+
+        // Rice coded residual, 4-bit parameters
+        mWriter.write(0, 2);
+        mWriter.write(sub.partitionOrder, 4);
+        auto const partitions = 1 << sub.partitionOrder;
+        auto const size = n >> sub.partitionOrder;
+        auto residual = sub.residual.data();
+        for (int p = 0; p < partitions; ++p) {
+            auto const param = sub.params[p];
+            mWriter.write(param, 4);
+            auto const count = p == 0 ? size - sub.order : size;
+            for (int i = 0; i < count; ++i) {
+                mWriter.writeRice(*residual++, param);
+            }
+        }
+    }
+
+    int mChannels;
+    int mBits;
+    // input channels, followed by mid and side for stereo
+    std::vector<std::vector<int32_t>> mSignals;
+    std::vector<Subframe> mSubframes;
+    std::vector<uint32_t> mScratch;
+    std::vector<double> mWindow;
+    std::vector<double> mWindowed;
+    BitWriter mWriter;
+};
+
+}
+
+class Flac::Encoder : public TU::Encoder {
+public:
+    using TU::Encoder::Encoder;
+};
+
+
+Flac::Flac(std::string const& filename, int channels, int samplerate, int bits) :
+    mStream(filename, std::ios::out | std::ios::binary),
+    mGood(false),
+    mFinished(false),
+    mChannels(channels),
+    mSamplerate(samplerate),
+    mBits(bits),
+    mDithering(false),
+    mDither(),
+    mClipped(0),
+    mBlock(BLOCK_SIZE * channels),
+    mBlockFrames(0),
+    mEncoder(std::make_unique<Encoder>(channels, bits)),
+    mTotalFrames(0),
+    mFrameNumber(0),
+    mMinFrameSize(0),
+    mMaxFrameSize(0)
+{
+    assert(channels > 0 && channels <= 8);
+    assert(bits == 16 || bits == 24);
+
+    // the header is rewritten when finished, this just reserves its space
+    writeHeader();
+    mGood = mStream.good();
+}
+
+Flac::~Flac() {
+    if (!mFinished) {
+        finish();
+    }
+}
+
+bool Flac::finish() {
+    if (mFinished) {
+        return mGood;
+    }
+    mFinished = true;
+
+    if (mGood) {
+        if (mBlockFrames) {
+            encodeBlock();
+        }
+        mStream.seekp(0);
+        writeHeader();
+    }
+    mStream.close();
+    // close() sets failbit if the file could not be closed
+    mGood = mGood && !mStream.fail();
+    return mGood;
+}
+
+bool Flac::good() const {
+    return mGood;
+}
+
+std::size_t Flac::clipCount() const {
+    return mClipped;
+}
+
+void Flac::setDither(bool dither) {
+    mDithering = dither;
+}
+
+void Flac::write(float const buf[], std::size_t nsamples) {
+    if (!mGood || mFinished) {
+        return;
+    }
+
+    auto const dither = mDithering ? &mDither : nullptr;
+    while (nsamples) {
+        auto const frames = std::min(nsamples, BLOCK_SIZE - mBlockFrames);
+        auto const count = frames * mChannels;
+        mClipped += convertToInt(buf, mBlock.data() + mBlockFrames * mChannels, count, mBits, dither);
+        mBlockFrames += frames;
+        buf += count;
+        nsamples -= frames;
+        if (mBlockFrames == BLOCK_SIZE) {
+            encodeBlock();
+        }
+    }
+}
+
+void Flac::encodeBlock() {
+    auto const& frame = mEncoder->encode(mBlock.data(), (int)mBlockFrames, mFrameNumber++);
+    mStream.write(reinterpret_cast<char const*>(frame.data()), frame.size());
+    if (!mStream.good()) {
+        mGood = false;
+    }
+    auto const size = (uint32_t)frame.size();
+    mMinFrameSize = mMinFrameSize ? std::min(mMinFrameSize, size) : size;
+    mMaxFrameSize = std::max(mMaxFrameSize, size);
+    mTotalFrames += mBlockFrames;
+    mBlockFrames = 0;
+}
+
+void Flac::writeHeader() {
+    TU::BitWriter writer;
+    writer.write(0x664C6143, 32);   // "fLaC"
+    // STREAMINFO, the only metadata block
+    writer.write(1, 1);
+    writer.write(0, 7);
+    writer.write(34, 24);
+    writer.write(BLOCK_SIZE, 16);
+    writer.write(BLOCK_SIZE, 16);
+    writer.write(mMinFrameSize, 24);
+    writer.write(mMaxFrameSize, 24);
+    writer.write(mSamplerate, 20);
+    writer.write(mChannels - 1, 3);
+    writer.write(mBits - 1, 5);
+    writer.write((uint32_t)(mTotalFrames >> 32), 4);
+    writer.write((uint32_t)mTotalFrames, 32);
+    // MD5 signature, unknown
+    for (int i = 0; i < 4; ++i) {
+        writer.write(0, 32);
+    }
+    auto const& bytes = writer.bytes();
+    mStream.write(reinterpret_cast<char const*>(bytes.data()), bytes.size());
+}
+
+#undef TU
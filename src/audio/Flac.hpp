@@ -0,0 +1,104 @@
+
+#pragma once
+
+#include "audio/SampleFormat.hpp"
+#include "audio/SampleWriter.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+//
+// Writes FLAC files, a self-contained encoder that needs no external library.
+// Samples are given as float like Wav, and are quantized to 16 or 24-bit.
+//
+// Each block of samples is encoded as a frame using the best of a constant,
+// fixed or LPC predictor per channel, with partitioned Rice coding for the
+// residual. Stereo is decorrelated by picking the smallest of left/right,
+// left/side, right/side or mid/side.
+//
+// Each block is encoded and written by write() once it is full, on the
+// calling thread. To overlap rendering and encoding, write from another
+// thread (see PipelineSink). The MD5 signature in STREAMINFO is left unset
+// (all zeros).
+//
+class Flac : public SampleWriter {
+
+public:
+
+    // samples per channel in a frame, all frames but the last have this size
+    static constexpr std::size_t BLOCK_SIZE = 4096;
+
+    //
+    // Opens a FLAC file for writing with the given channel count, samplerate
+    // and bit depth (16 or 24). Existing files will be overwritten.
+    //
+    explicit Flac(std::string const& filename, int channels, int samplerate, int bits);
+
+    //
+    // Calls finish() if it wasn't called already.
+    //
+    virtual ~Flac();
+
+    virtual bool good() const override;
+
+    virtual void write(float const buf[], std::size_t nsamples) override;
+
+    virtual std::size_t clipCount() const override;
+
+    //
+    // Encodes the remaining samples and writes the final STREAMINFO.
+    // Returns false if anything could not be written.
+    //
+    virtual bool finish() override;
+
+    //
+    // Enables TPDF dither when quantizing. Off by default.
+    //
+    void setDither(bool dither);
+
+private:
+
+    class Encoder;
+
+    Flac(Flac const& flac) = delete;
+    Flac& operator=(Flac const& flac) = delete;
+
+    //
+    // Encodes and writes the current block, which may be partial.
+    //
+    void encodeBlock();
+
+    //
+    // Writes the stream marker and STREAMINFO, with the totals so far.
+    //
+    void writeHeader();
+
+    std::ofstream mStream;
+    bool mGood;
+    bool mFinished;
+
+    int mChannels;
+    int mSamplerate;
+    int mBits;
+
+    bool mDithering;
+    Dither mDither;
+    std::size_t mClipped;
+
+    // block being filled by write(), interleaved
+    std::vector<int32_t> mBlock;
+    std::size_t mBlockFrames;
+
+    std::unique_ptr<Encoder> mEncoder;
+
+    // totals for STREAMINFO
+    uint64_t mTotalFrames;
+    uint32_t mFrameNumber;
+    uint32_t mMinFrameSize;
+    uint32_t mMaxFrameSize;
+
+};
@@ -0,0 +1,73 @@
+
+#include "audio/LatencyController.hpp"
+
+#include <algorithm>
+#include <limits>
+
+LatencyController::LatencyController() :
+    mMinSize(0),
+    mMaxSize(0),
+    mSize(0),
+    mStableWindow(0),
+    mStableFrames(0),
+    mLowestFill(0),
+    mLongestPeriod(0),
+    mLastUnderruns(0)
+{
+    resetWindow();
+}
+
+void LatencyController::setup(size_t minSize, size_t maxSize, unsigned samplerate) {
+    mMaxSize = maxSize;
+    mMinSize = std::min(minSize, maxSize);
+    mSize = mMaxSize;
+    // one second of playback without underruns
+    mStableWindow = samplerate;
+    resetWindow();
+}
+
+size_t LatencyController::size() const {
+    return mSize;
+}
+
+size_t LatencyController::minSize() const {
+    return mMinSize;
+}
+
+size_t LatencyController::maxSize() const {
+    return mMaxSize;
+}
+
+size_t LatencyController::update(unsigned underruns, size_t fill, size_t periodFrames) {
+
+    if (underruns != mLastUnderruns) {
+        // the counter is lower if it was cleared
+        auto const underran = underruns > mLastUnderruns;
+        mLastUnderruns = underruns;
+        if (underran) {
+            // grow fast, underruns are far worse than extra latency
+            mSize = std::clamp(mSize * 2, mMinSize, mMaxSize);
+            resetWindow();
+            return mSize;
+        }
+    }
+
+    mStableFrames += periodFrames;
+    mLowestFill = std::min(mLowestFill, fill);
+    mLongestPeriod = std::max(mLongestPeriod, periodFrames);
+
+    if (mStableFrames >= mStableWindow) {
+        auto const floor = mLongestPeriod * 2;
+        auto const shrink = std::min(mLowestFill / 2, mSize);
+        mSize = std::clamp(std::max(floor, mSize - shrink), mMinSize, mMaxSize);
+        resetWindow();
+    }
+
+    return mSize;
+}
+
+void LatencyController::resetWindow() {
+    mStableFrames = 0;
+    mLowestFill = std::numeric_limits<size_t>::max();
+    mLongestPeriod = 0;
+}
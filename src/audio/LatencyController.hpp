@@ -0,0 +1,66 @@
+
+#pragma once
+
+#include <cstddef>
+
+//
+// Determines the size of the playback buffer when adaptive latency is enabled.
+//
+// The controller is updated once every render period with the number of
+// underruns so far, the amount of frames still in the buffer at the start of
+// the period (fill) and the length of the period. The size is:
+//  - grown quickly (doubled) whenever an underrun occurs
+//  - shrunk gradually after a window of stable playback. The lowest fill seen
+//    in the window is headroom that was never needed, half of it is removed.
+//    The size never goes below two of the longest periods seen in the window,
+//    so that timer jitter is still absorbed.
+//
+// All sizes are in frames, and are kept within the configured bounds.
+//
+class LatencyController {
+
+public:
+
+    LatencyController();
+
+    //
+    // Sets the bounds and the samplerate. The size is reset to the maximum
+    // so that playback starts safe and then converges.
+    //
+    void setup(size_t minSize, size_t maxSize, unsigned samplerate);
+
+    //
+    // Current target size of the buffer, in frames.
+    //
+    size_t size() const;
+
+    size_t minSize() const;
+
+    size_t maxSize() const;
+
+    //
+    // Updates the controller for a new period, and returns the new target
+    // size.
+    //
+    size_t update(unsigned underruns, size_t fill, size_t periodFrames);
+
+private:
+
+    void resetWindow();
+
+    size_t mMinSize;
+    size_t mMaxSize;
+    size_t mSize;
+
+    // length of stable playback, in frames, required before shrinking
+    size_t mStableWindow;
+    // frames of stable playback in the current window
+    size_t mStableFrames;
+    // lowest fill at the start of a period in the current window
+    size_t mLowestFill;
+    // longest period in the current window
+    size_t mLongestPeriod;
+
+    unsigned mLastUnderruns;
+
+};
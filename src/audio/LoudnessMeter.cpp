@@ -0,0 +1,238 @@
+
+#include "audio/LoudnessMeter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LOUDNESSMETER_SSE2
+#include <emmintrin.h>
+#endif
+
+#define TU LoudnessMeterTU
+namespace TU {
+
+constexpr double PI = 3.14159265358979323846;
+
+// absolute gate, in LUFS
+constexpr double ABSOLUTE_GATE = -70.0;
+// relative gate, in LU below the absolute-gated loudness
+constexpr double RELATIVE_GATE = -10.0;
+
+double toLoudness(double power) {
+    return -0.691 + 10.0 * std::log10(power);
+}
+
+double toPower(double loudness) {
+    return std::pow(10.0, (loudness + 0.691) / 10.0);
+}
+
+double toDecibels(double power) {
+    return 10.0 * std::log10(power);
+}
+
+}
+
+LoudnessMeter::LoudnessMeter(int samplerate) :
+    mShelf(),
+    mHighpass(),
+    mShelfState(),
+    mHighpassState(),
+    mSubBlockSize(std::max<size_t>(1, (size_t)std::lround(samplerate * 0.1))),
+    mSubBlockFrames(0),
+    mSubBlockSum(0.0),
+    mSubBlockSums(),
+    mSubBlockCount(0),
+    mBlocks(),
+    mPeak(0.0),
+    mSquares(0.0),
+    mFrames(0)
+{
+    // the filters from BS.1770 are specified at 48 kHz, these are the analog
+    // prototypes they were derived from, bilinear transformed for the given
+    // rate
+    {
+        constexpr double f0 = 1681.974450955533;
+        constexpr double G = 3.999843853973347;
+        constexpr double Q = 0.7071752369554196;
+        auto const K = std::tan(TU::PI * f0 / samplerate);
+        auto const Vh = std::pow(10.0, G / 20.0);
+        auto const Vb = std::pow(Vh, 0.4996667741545416);
+        auto const a0 = 1.0 + K / Q + K * K;
+        mShelf.b0 = (Vh + Vb * K / Q + K * K) / a0;
+        mShelf.b1 = 2.0 * (K * K - Vh) / a0;
+        mShelf.b2 = (Vh - Vb * K / Q + K * K) / a0;
+        mShelf.a1 = 2.0 * (K * K - 1.0) / a0;
+        mShelf.a2 = (1.0 - K / Q + K * K) / a0;
+    }
+    {
+        constexpr double f0 = 38.13547087602444;
+        constexpr double Q = 0.5003270373238773;
+        auto const K = std::tan(TU::PI * f0 / samplerate);
+        auto const a0 = 1.0 + K / Q + K * K;
+        mHighpass.b0 = 1.0;
+        mHighpass.b1 = -2.0;
+        mHighpass.b2 = 1.0;
+        mHighpass.a1 = 2.0 * (K * K - 1.0) / a0;
+        mHighpass.a2 = (1.0 - K / Q + K * K) / a0;
+    }
+}
+
+void LoudnessMeter::reset() {
+    std::fill_n(&mShelfState[0][0], 4, 0.0);
+    std::fill_n(&mHighpassState[0][0], 4, 0.0);
+    mSubBlockFrames = 0;
+    mSubBlockSum = 0.0;
+    std::fill_n(mSubBlockSums, SUB_BLOCKS, 0.0);
+    mSubBlockCount = 0;
+    mBlocks.clear();
+    mPeak = 0.0;
+    mSquares = 0.0;
+    mFrames = 0;
+}
+
+void LoudnessMeter::process(float const *samples, size_t frames) {
+    mFrames += frames;
+
+    while (frames) {
+        // up to the end of the current sub-block
+        auto const count = std::min(frames, mSubBlockSize - mSubBlockFrames);
+
+#ifdef LOUDNESSMETER_SSE2
+        // one lane per channel
+        auto const sb0 = _mm_set1_pd(mShelf.b0);
+        auto const sb1 = _mm_set1_pd(mShelf.b1);
+        auto const sb2 = _mm_set1_pd(mShelf.b2);
+        auto const sa1 = _mm_set1_pd(mShelf.a1);
+        auto const sa2 = _mm_set1_pd(mShelf.a2);
+        auto const ha1 = _mm_set1_pd(mHighpass.a1);
+        auto const ha2 = _mm_set1_pd(mHighpass.a2);
+        auto const absMask = _mm_castsi128_pd(_mm_set1_epi64x(0x7FFFFFFFFFFFFFFF));
+
+        auto s1 = _mm_loadu_pd(mShelfState[0]);
+        auto s2 = _mm_loadu_pd(mShelfState[1]);
+        auto h1 = _mm_loadu_pd(mHighpassState[0]);
+        auto h2 = _mm_loadu_pd(mHighpassState[1]);
+        auto peak = _mm_set1_pd(mPeak);
+        auto squares = _mm_setzero_pd();
+        auto weighted = _mm_setzero_pd();
+
+        for (size_t i = 0; i < count; ++i) {
+            auto const x = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(samples))));
+            samples += 2;
+
+            peak = _mm_max_pd(peak, _mm_and_pd(x, absMask));
+            squares = _mm_add_pd(squares, _mm_mul_pd(x, x));
+
+            auto const y = _mm_add_pd(_mm_mul_pd(sb0, x), s1);
+            s1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(sb1, x), _mm_mul_pd(sa1, y)), s2);
+            s2 = _mm_sub_pd(_mm_mul_pd(sb2, x), _mm_mul_pd(sa2, y));
+
+            // the high pass numerator is 1, -2, 1
+            auto const z = _mm_add_pd(y, h1);
+            h1 = _mm_add_pd(_mm_sub_pd(_mm_sub_pd(_mm_setzero_pd(), _mm_add_pd(y, y)), _mm_mul_pd(ha1, z)), h2);
+            h2 = _mm_sub_pd(y, _mm_mul_pd(ha2, z));
+
+            weighted = _mm_add_pd(weighted, _mm_mul_pd(z, z));
+        }
+
+        _mm_storeu_pd(mShelfState[0], s1);
+        _mm_storeu_pd(mShelfState[1], s2);
+        _mm_storeu_pd(mHighpassState[0], h1);
+        _mm_storeu_pd(mHighpassState[1], h2);
+
+        double lanes[2];
+        _mm_storeu_pd(lanes, peak);
+        mPeak = std::max(lanes[0], lanes[1]);
+        _mm_storeu_pd(lanes, squares);
+        mSquares += lanes[0] + lanes[1];
+        _mm_storeu_pd(lanes, weighted);
+        mSubBlockSum += lanes[0] + lanes[1];
+#else
+        for (size_t i = 0; i < count; ++i) {
+            for (int ch = 0; ch < 2; ++ch) {
+                double const x = *samples++;
+
+                mPeak = std::max(mPeak, std::abs(x));
+                mSquares += x * x;
+
+                auto const y = mShelf.b0 * x + mShelfState[0][ch];
+                mShelfState[0][ch] = mShelf.b1 * x - mShelf.a1 * y + mShelfState[1][ch];
+                mShelfState[1][ch] = mShelf.b2 * x - mShelf.a2 * y;
+
+                auto const z = y + mHighpassState[0][ch];
+                mHighpassState[0][ch] = -2.0 * y - mHighpass.a1 * z + mHighpassState[1][ch];
+                mHighpassState[1][ch] = y - mHighpass.a2 * z;
+
+                mSubBlockSum += z * z;
+            }
+        }
+#endif
+
+        frames -= count;
+        mSubBlockFrames += count;
+        if (mSubBlockFrames == mSubBlockSize) {
+            endSubBlock();
+        }
+    }
+}
+
+void LoudnessMeter::endSubBlock() {
+    mSubBlockSums[mSubBlockCount % SUB_BLOCKS] = mSubBlockSum;
+    ++mSubBlockCount;
+    mSubBlockSum = 0.0;
+    mSubBlockFrames = 0;
+
+    if (mSubBlockCount >= SUB_BLOCKS) {
+        // the channel weights for left and right are 1, so the power is the
+        // sum of both channels' mean squares
+        auto const sum = std::accumulate(mSubBlockSums, mSubBlockSums + SUB_BLOCKS, 0.0);
+        mBlocks.push_back(sum / (double)(mSubBlockSize * SUB_BLOCKS));
+    }
+}
+
+LoudnessMeter::Levels LoudnessMeter::levels() const {
+    constexpr auto SILENCE = -std::numeric_limits<double>::infinity();
+
+    Levels levels{ SILENCE, SILENCE, SILENCE };
+    if (mFrames == 0) {
+        return levels;
+    }
+
+    levels.peak = mPeak > 0.0 ? 20.0 * std::log10(mPeak) : SILENCE;
+    levels.rms = mSquares > 0.0 ? TU::toDecibels(mSquares / (double)(mFrames * 2)) : SILENCE;
+
+    // mean power of the blocks above the given threshold
+    auto const gatedMean = [this](double threshold) {
+        double sum = 0.0;
+        size_t count = 0;
+        for (auto power : mBlocks) {
+            if (power > threshold) {
+                sum += power;
+                ++count;
+            }
+        }
+        return count ? sum / (double)count : 0.0;
+    };
+
+    auto const absoluteMean = gatedMean(TU::toPower(TU::ABSOLUTE_GATE));
+    if (absoluteMean > 0.0) {
+        auto const relativeGate = TU::toPower(TU::toLoudness(absoluteMean) + TU::RELATIVE_GATE);
+        auto const mean = gatedMean(std::max(relativeGate, TU::toPower(TU::ABSOLUTE_GATE)));
+        if (mean > 0.0) {
+            levels.loudness = TU::toLoudness(mean);
+        }
+    }
+    return levels;
+}
+
+double LoudnessMeter::normalizeGain(double loudness, double target) {
+    if (!std::isfinite(loudness)) {
+        return 1.0;
+    }
+    return std::pow(10.0, (target - loudness) / 20.0);
+}
+
+#undef TU
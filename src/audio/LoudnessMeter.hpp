@@ -0,0 +1,92 @@
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+//
+// Measures the sample peak, RMS level and integrated loudness of stereo
+// audio as it is rendered, so that exports can be analyzed without reading
+// the files back.
+//
+// Loudness is measured as described by ITU-R BS.1770-4: the signal is
+// K-weighted and its power is taken over 400 ms blocks overlapping by 75%,
+// which are gated at -70 LUFS and then 10 LU below the ungated loudness.
+// Both channels are processed together, two lanes at a time with SSE2 when
+// available.
+//
+class LoudnessMeter {
+
+public:
+
+    //
+    // Levels in decibels, -infinity for silence. Peak and RMS are relative to
+    // full scale (dBFS) over both channels, loudness is in LUFS.
+    //
+    struct Levels {
+        double peak;
+        double rms;
+        double loudness;
+    };
+
+    explicit LoudnessMeter(int samplerate);
+
+    //
+    // Clears the measurement, for measuring another signal.
+    //
+    void reset();
+
+    //
+    // Adds the given interleaved stereo frames to the measurement.
+    //
+    void process(float const *samples, size_t frames);
+
+    //
+    // Levels of all frames processed since the last reset.
+    //
+    Levels levels() const;
+
+    //
+    // Linear gain that brings the given loudness to the target, both in LUFS.
+    // 1 when the loudness is not finite (the signal was silent).
+    //
+    static double normalizeGain(double loudness, double target);
+
+private:
+
+    // a gating block is made of 4 sub-blocks of 100 ms
+    static constexpr size_t SUB_BLOCKS = 4;
+
+    //
+    // Finishes the current 100 ms sub-block, adding a gating block once there
+    // are enough of them.
+    //
+    void endSubBlock();
+
+    // K-weighting filter, a high shelf then a high pass. Coefficients are
+    // normalized so that a0 is 1.
+    struct Biquad {
+        double b0, b1, b2, a1, a2;
+    };
+    Biquad mShelf;
+    Biquad mHighpass;
+
+    // transposed direct form II state of each filter, [register][channel]
+    double mShelfState[2][2];
+    double mHighpassState[2][2];
+
+    size_t mSubBlockSize;
+    size_t mSubBlockFrames;
+    // sum of the weighted squares in the current sub-block
+    double mSubBlockSum;
+    double mSubBlockSums[SUB_BLOCKS];
+    size_t mSubBlockCount;
+
+    // mean weighted power of each gating block
+    std::vector<double> mBlocks;
+
+    double mPeak;
+    double mSquares;
+    size_t mFrames;
+
+};
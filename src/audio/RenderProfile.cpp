@@ -0,0 +1,113 @@
+
+#include "audio/RenderProfile.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#define TU RenderProfileTU
+namespace TU {
+
+//
+// Gets the percentiles of the given values, the vector is reordered.
+// Uses the nearest-rank method.
+//
+RenderProfile::Percentiles percentiles(std::vector<float> &values) {
+    RenderProfile::Percentiles result{};
+    if (values.empty()) {
+        return result;
+    }
+
+    auto const rank = [&values](float percentile) {
+        auto const n = (size_t)std::ceil(percentile / 100.0f * values.size());
+        auto const nth = values.begin() + (std::max((size_t)1, n) - 1);
+        std::nth_element(values.begin(), nth, values.end());
+        return *nth;
+    };
+
+    result.p50 = rank(50.0f);
+    result.p95 = rank(95.0f);
+    result.p99 = rank(99.0f);
+    result.max = *std::max_element(values.begin(), values.end());
+    return result;
+}
+
+}
+
+RenderProfile::RenderProfile(size_t window) :
+    mPeriods(),
+    mIndex(0)
+{
+    mPeriods.reserve(std::max((size_t)1, window));
+}
+
+void RenderProfile::add(Period const& period) {
+    if (mPeriods.size() < mPeriods.capacity()) {
+        mPeriods.push_back(period);
+    } else {
+        mPeriods[mIndex] = period;
+        if (++mIndex == mPeriods.size()) {
+            mIndex = 0;
+        }
+    }
+}
+
+void RenderProfile::clear() {
+    mPeriods.clear();
+    mIndex = 0;
+}
+
+size_t RenderProfile::size() const {
+    return mPeriods.size();
+}
+
+RenderProfile::Period const& RenderProfile::at(size_t index) const {
+    return mPeriods[(mIndex + index) % mPeriods.size()];
+}
+
+float RenderProfile::load(Period const& period) {
+    if (period.interval <= 0.0f) {
+        return 0.0f;
+    }
+    return (period.step + period.synth + period.read) * 100.0f / period.interval;
+}
+
+RenderProfile::Stats RenderProfile::stats() const {
+    Stats stats{};
+    stats.periods = mPeriods.size();
+    if (stats.periods == 0) {
+        return stats;
+    }
+
+    std::vector<float> intervals;
+    std::vector<float> renders;
+    intervals.reserve(stats.periods);
+    renders.reserve(stats.periods);
+
+    float loadSum = 0.0f;
+    float stepSum = 0.0f;
+    float synthSum = 0.0f;
+    float readSum = 0.0f;
+    for (auto const& period : mPeriods) {
+        intervals.push_back(period.interval);
+        renders.push_back(period.render);
+        auto const periodLoad = load(period);
+        loadSum += periodLoad;
+        stats.loadMax = std::max(stats.loadMax, periodLoad);
+        stepSum += period.step;
+        synthSum += period.synth;
+        readSum += period.read;
+        stats.deferred += period.deferred;
+        stats.dropped += period.dropped;
+    }
+
+    auto const n = (float)stats.periods;
+    stats.interval = TU::percentiles(intervals);
+    stats.render = TU::percentiles(renders);
+    stats.loadAvg = loadSum / n;
+    stats.stepAvg = stepSum / n;
+    stats.synthAvg = synthSum / n;
+    stats.readAvg = readSum / n;
+    return stats;
+}
+
+#undef TU
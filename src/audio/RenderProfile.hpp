@@ -0,0 +1,98 @@
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+//
+// Rolling history of render period timings, for profiling the render thread.
+//
+// The render thread measures each period (see Period) and sends it to the GUI
+// thread, which adds it here. Only the most recent periods are kept, older
+// ones are discarded as new ones are added. stats() computes the percentiles
+// of the period interval and render duration, and the DSP load, over the
+// periods in the history.
+//
+// All times are in microseconds.
+//
+class RenderProfile {
+
+public:
+
+    // number of periods kept by default, 10 seconds at a 5 ms period
+    static constexpr size_t DEFAULT_WINDOW = 2000;
+
+    struct Period {
+        // time since the previous period began
+        float interval;
+        // time spent rendering this period
+        float render;
+        // time spent stepping the engine and instrument previewer
+        float step;
+        // time spent in Synth::run
+        float synth;
+        // time spent reading samples from the APU
+        float read;
+        // engine steps deferred, because the module was locked, and skipped,
+        // because too many were deferred
+        unsigned deferred;
+        unsigned dropped;
+    };
+
+    struct Percentiles {
+        float p50;
+        float p95;
+        float p99;
+        float max;
+    };
+
+    struct Stats {
+        // number of periods in the history
+        size_t periods;
+        Percentiles interval;
+        Percentiles render;
+        // time spent in step, synth and read as a percentage of the interval
+        float loadAvg;
+        float loadMax;
+        // average time spent per period
+        float stepAvg;
+        float synthAvg;
+        float readAvg;
+        // total engine steps deferred and skipped
+        unsigned deferred;
+        unsigned dropped;
+    };
+
+    explicit RenderProfile(size_t window = DEFAULT_WINDOW);
+
+    //
+    // Adds a period to the history, discarding the oldest period if full.
+    //
+    void add(Period const& period);
+
+    void clear();
+
+    //
+    // Number of periods in the history
+    //
+    size_t size() const;
+
+    //
+    // Gets a period from the history, index 0 is the oldest.
+    //
+    Period const& at(size_t index) const;
+
+    //
+    // DSP load of the given period, as a percentage of its interval
+    //
+    static float load(Period const& period);
+
+    Stats stats() const;
+
+private:
+
+    std::vector<Period> mPeriods;
+    // index of the oldest period once the history is full
+    size_t mIndex;
+
+};
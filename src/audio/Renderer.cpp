@@ -8,10 +8,48 @@
 #include <QMutexLocker>
 #include <QtDebug>
 
+#include <algorithm>
 #include <ratio>
 
 //static auto LOG_PREFIX = "[Renderer]";
 
+#define TU RendererTU
+namespace TU {
+
+// maximum number of GUI commands waiting for the render thread
+constexpr size_t COMMAND_QUEUE_SIZE = 64;
+
+// maximum number of engine frames that can be deferred while the module is
+// locked, beyond this frames are skipped
+constexpr int MAX_DEFERRED_FRAMES = 8;
+
+// maximum number of engine frames waiting to be heard, must be enough to
+// cover the largest buffer (500 ms is 30 frames at 60 Hz)
+constexpr size_t POSITION_QUEUE_SIZE = 128;
+
+// maximum number of period timings waiting for the GUI, timings are dropped
+// if the GUI does not collect them in time (see pollSignals)
+constexpr size_t TIMING_QUEUE_SIZE = 1024;
+
+// samplerate of the synth until a device is opened
+constexpr int DEFAULT_SAMPLERATE = 44100;
+
+// size of the scratch buffer used when converting to the device's format
+constexpr size_t SCRATCH_FRAMES = 1024;
+
+// interval at which the GUI thread emits the signals flagged by the render
+constexpr int SIGNAL_INTERVAL = 10;
+
+// flags for Renderer::mPendingSignals
+constexpr unsigned SIGNAL_FRAME = 0x1;
+constexpr unsigned SIGNAL_VISUALIZERS = 0x2;
+
+float toMicroseconds(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration<float, std::micro>(duration).count();
+}
+
+}
+
 
 // Renderer Notes
 //
@@ -23,6 +61,54 @@
 // utilization indicates that the callback is consuming faster than the rate the
 // audio is being produced. When this happens underruns occur, as the callback doesn't
 // get what it needs and there are now gaps in the playback.
+//
+// Alternatively, the Renderer can render in "callback" mode (SoundConfig::callbackRender).
+// In this mode there is no timer and no buffer, the audio callback asks the
+// Renderer for exactly the frames the device needs. This removes the latency
+// of the buffer and the jitter of the timer, at the cost of doing all of the
+// synthesis in the device's thread.
+//
+// GUI actions (play, previews, stepping, etc) do not lock the RenderContext
+// while rendering. Instead they are posted as Commands to a lock-free queue,
+// which the render thread drains at the start of every frame. The
+// RenderContext mutex is only contended for the rare configuration changes
+// (song, device, framerate) and when the render is stopped, in which case
+// commands are applied directly by the GUI thread.
+//
+// Likewise, the current engine frame is published by the render thread via a
+// Seqlock, so currentFrame() and isPlaying() never wait on the render.
+//
+// Samples for the visualizers are published at the end of each render via the
+// triple-buffered VisualizerBuffer, a repaint never holds up the render.
+//
+// The render thread does not allocate once rendering. It does not emit
+// signals either, since emitting across threads allocates an event. Instead
+// it flags which signals are pending and the GUI thread emits them from a
+// timer (pollSignals).
+//
+// The engine reads the module while stepping, which requires the module's
+// mutex. The render never blocks on it: when an edit is in progress the
+// engine step is deferred (the synth keeps running with the current
+// register state) and caught up on the following frames. Commands that reach
+// the engine, previewer or APU also read the module, and are likewise left
+// for a later frame along with the commands queued after them.
+//
+// Every engine frame is tagged with the position of its first sample in the
+// stream and sent to the GUI via the position queue. The GUI compares these
+// positions with the number of frames the device has played, so that the
+// frame shown is the one being heard rather than the one being buffered.
+//
+// Each period the render thread measures the time spent stepping, synthesizing
+// and reading samples, and sends it to the GUI via the timing queue for the
+// RenderProfile shown in the diagnostics.
+//
+// The stream's buffer is in the device's format. When it is s16, samples are
+// synthesized to a scratch buffer and converted while writing to the stream,
+// so that the audio callback only has to copy.
+//
+// When adaptive latency is enabled, a LatencyController adjusts the usable
+// size of the buffer every period, shrinking it while playback is stable and
+// growing it after an underrun. The configured latency is the maximum size.
 
 
 Renderer::RenderContext::RenderContext(Module &mod) :
@@ -31,18 +117,29 @@ Renderer::RenderContext::RenderContext(Module &mod) :
     step(false),
     song(nullptr),
     apu(),
-    synth(apu, 44100),
+    synth(apu, TU::DEFAULT_SAMPLERATE),
+    rc(apu, mod.data().instrumentTable(), mod.data().waveformTable()),
     engine(apu, &mod.data()),
     ip(),
     previewState(PreviewState::none),
     previewChannel(trackerboy::ChType::ch1),
-    state(State::stopped),
+    outputFlags(ChannelOutput::AllOn),
     stopCounter(0),
+    deferredFrames(0),
+    framesRendered(0),
     bufferSize(0),
+    adaptive(false),
+    latency(),
     watchdog(),
     lastPeriod(),
     periodTime(0),
-    writesSinceLastPeriod(0)
+    writesSinceLastPeriod(0),
+    stepTime(0),
+    synthTime(0),
+    readTime(0),
+    periodDeferred(0),
+    periodDropped(0),
+    scratch(std::make_unique<float[]>(TU::SCRATCH_FRAMES * 2))
 {
 }
 
@@ -50,19 +147,38 @@ Renderer::RenderContext::RenderContext(Module &mod) :
 
 Renderer::Renderer(Module &mod, QObject *parent) :
     QObject(parent),
-    mTimerThread(),
-    mTimer(new FastTimer),
+    mTimer(),
+    mSignalTimer(),
     mStream(),
     mVisBuffer(),
-    mOutputFlags(ChannelOutput::AllOn),
+    mState(State::stopped),
+    mStepping(false),
+    mCurrentFrame(),
+    mBufferStats(),
+    mDeferredFrames(0),
+    mDroppedFrames(0),
+    mCommands(),
+    mDeferredCommand(),
+    mCommandDeferred(false),
+    mPositions(),
+    mHeardFrame(),
+    mTimings(),
+    mProfile(),
+    mPendingSignals(0),
+    mLastPlaying(false),
     mRenderStartTime(),
+    mLatencySaved(0),
+    mOffline(false),
     mContext(mod)
 {
-    mTimer->setCallback(timerCallback, this);
-    mTimer->moveToThread(&mTimerThread);
-    connect(&mTimerThread, &QThread::finished, mTimer, &FastTimer::deleteLater);
-    mTimerThread.setObjectName(QStringLiteral("renderer timer thread"));
-    mTimerThread.start();
+    mTimer.setCallback(timerCallback, this);
+    mTimer.setRealtime(true);
+    mCommands.init(TU::COMMAND_QUEUE_SIZE);
+    mPositions.init(TU::POSITION_QUEUE_SIZE);
+    mTimings.init(TU::TIMING_QUEUE_SIZE);
+    mSignalTimer.setInterval(TU::SIGNAL_INTERVAL);
+    mSignalTimer.setTimerType(Qt::PreciseTimer);
+    connect(&mSignalTimer, &QTimer::timeout, this, &Renderer::pollSignals);
 
     connect(&mStream, &AudioStream::aborted, this,
         [this]() {
@@ -75,18 +191,19 @@ Renderer::Renderer(Module &mod, QObject *parent) :
 }
 
 Renderer::~Renderer() {
-    mTimer->stop();
+    mTimer.stop();
 
     if (mStream.isRunning()) {
         mStream.stop();
     }
-
-    mTimerThread.quit();
-    mTimerThread.wait();
 }
 
 void Renderer::setSong() {
     auto ctx = mContext.access();
+    // apply anything queued before the engine changes songs
+    if (drainCommands(ctx)) {
+        beginRender(ctx);
+    }
     ctx->song = ctx->mod.songShared();
     ctx->engine.setSong(ctx->song.get());
 
@@ -96,8 +213,10 @@ void Renderer::setSong() {
     if (mStream.isRunning()) {
         if (ctx->stepping) {
             _stopMusic(ctx);
+            mStepping = false;
         } else {
             _play(ctx, 0, 0, false);
+            beginRender(ctx);
         }
     }
 }
@@ -106,30 +225,70 @@ unsigned Renderer::statUnderruns() const {
     return mStream.underruns();
 }
 
-Renderer::BufferStats Renderer::statBuffer() {
-    auto handle = mContext.access();
-    // it is safe to access the writer since we have acquired access to mContext
+Renderer::BufferStats Renderer::statBuffer() const {
+    return mBufferStats.load();
+}
 
-    auto const size = handle->bufferSize;
+FastTimer::Stats Renderer::statTimer() const {
+    return mTimer.stats();
+}
+
+unsigned Renderer::statFrameRetries() const {
+    return mCurrentFrame.retries();
+}
+
+Renderer::DeferStats Renderer::statDeferredFrames() const {
     return {
-        (int)(size - mStream.writer().availableWrite()),
-        (int)size,
-        (int)handle->writesSinceLastPeriod,
-        std::chrono::duration<double, std::milli>{handle->periodTime}.count()
+        mDeferredFrames.load(std::memory_order_relaxed),
+        mDroppedFrames.load(std::memory_order_relaxed)
+    };
+}
+
+Renderer::DeviceStats Renderer::statDevice() const {
+    auto const period = mStream.devicePeriod();
+    auto const samplerate = std::max(1, mStream.samplerate());
+    return {
+        (int)period,
+        (int)mStream.devicePeriods(),
+        period * 1000.0 / samplerate,
+        mStream.deviceLatency()
     };
 }
 
+SampleFormat Renderer::statFormat() const {
+    return mStream.format();
+}
+
+RenderProfile const& Renderer::statProfile() {
+    drainTimings();
+    return mProfile;
+}
+
+void Renderer::drainTimings() {
+    auto reader = mTimings.reader();
+    RenderProfile::Period period;
+    while (reader.read(&period, 1)) {
+        mProfile.add(period);
+    }
+}
+
+int Renderer::statLatencySaved() const {
+    return mLatencySaved;
+}
+
 long Renderer::statElapsed() const {
     return (long)std::chrono::duration_cast<std::chrono::milliseconds>(
         Clock::now() - mRenderStartTime
     ).count();
 }
 
-int Renderer::samplerate() {
-    return mContext.access()->synth.samplerate();
+int Renderer::samplerate() const {
+    // the synth uses the stream's samplerate once it is opened
+    auto const samplerate = mStream.samplerate();
+    return samplerate ? samplerate : TU::DEFAULT_SAMPLERATE;
 }
 
-Guarded<VisualizerBuffer>& Renderer::visualizerBuffer() {
+VisualizerBuffer& Renderer::visualizerBuffer() {
     return mVisBuffer;
 }
 
@@ -138,93 +297,203 @@ bool Renderer::isRunning() {
 }
 
 bool Renderer::isStepping() {
-    return mContext.access()->stepping;
+    return mStepping.load(std::memory_order_relaxed);
 }
 
 bool Renderer::isPlaying() {
-    return !mContext.access()->currentEngineFrame.halted;
+    return !mCurrentFrame.load().halted;
 }
 
 trackerboy::Frame Renderer::currentFrame() {
-    auto handle = mContext.access();
-    return handle->currentEngineFrame;
+    auto const played = mStream.framesPlayed();
+    auto reader = mPositions.reader();
+
+    // pop every frame that has started playing, the last one is being heard
+    bool startedNewRow = false;
+    for (;;) {
+        size_t count = 1;
+        auto event = reader.acquireRead(count);
+        if (count == 0 || event->position > played) {
+            break;
+        }
+        // a row may start in a frame that is skipped over
+        startedNewRow |= event->frame.startedNewRow;
+        mHeardFrame = event->frame;
+        reader.commitRead(1);
+    }
+
+    auto frame = mHeardFrame;
+    frame.startedNewRow = startedNewRow;
+    return frame;
 }
 
 bool Renderer::setConfig(SoundConfig const &soundConfig, AudioEnumerator const& enumerator) {
 
-    // if there is rendering going at on when this function is called it will
-    // resume with a slight gap in playback if the config applied without error,
-    // otherwise the render is stopped
-
+    // if there is rendering going at on when this function is called, the
+    // stream switches to the new device while the old one keeps playing. If
+    // the format and samplerate did not change, the buffered audio is handed
+    // over and playback continues without a gap. If the new device could not
+    // be used, playback continues on the current one. If the config could
+    // not be applied and nothing is playing, the render is stopped
 
     bool wasRunning = mStream.isRunning();
     if (wasRunning) {
-        mTimer->stop();
+        // the buffer must not be written to during the switch, the device
+        // keeps playing what is in it meanwhile
+        mTimer.stop();
     }
 
-    mStream.open(
+    auto const callbackRender = soundConfig.callbackRender();
+    mStream.setRenderCallback(callbackRender ? renderCallback : nullptr, this);
+    mStream.setDeviceTiming(
+        soundConfig.lowLatency(),
+        soundConfig.devicePeriod(),
+        soundConfig.devicePeriods()
+    );
+    auto const opened = mStream.open(
         enumerator.device(soundConfig.backendIndex(), soundConfig.deviceIndex()),
         soundConfig.samplerate(),
-        soundConfig.latency()
+        soundConfig.latency(),
+        soundConfig.nativeFormat()
     );
 
-    if (mStream.isEnabled()) {
+    if (opened) {
 
-        mTimer->setInterval(soundConfig.period(), Qt::PreciseTimer);
-        
+        mTimer.setInterval(std::chrono::milliseconds(soundConfig.period()));
+        // in callback mode, the buffer that would've been filled ahead of time
+        // (and the silence played while it fills) is gone
+        mLatencySaved = callbackRender ? soundConfig.latency() : 0;
 
         // update the synthesizer (the guard isn't necessary here but we'll use it anyways)
         {
             auto handle = mContext.access();
-            
-            bool reloadRegisters = false;
-            auto const samplerate = soundConfig.samplerate();
-            if (samplerate != handle->synth.samplerate()) {
-                handle->synth.setSamplerate(samplerate);
-                reloadRegisters = wasRunning;
-            }
-            //handle->synth.apu().setQuality(static_cast<gbapu::Apu::Quality>(soundConfig.quality()));
-            handle->synth.setupBuffers();
 
-            if (reloadRegisters) {
-                // resizing the buffers in synth results in an APU reset so we need to
-                // rewrite channel registers
-                handle->engine.reload();
-            }
+            // the stream's samplerate, which is the device's when using its native format
+            auto const samplerate = mStream.samplerate();
+            setupSynth(handle, samplerate, wasRunning);
 
             handle->bufferSize = mStream.bufferSize();
+            // unless the buffer was handed over, the stream starts over
+            if (!mStream.keptBuffer()) {
+                resetPosition(handle);
+            }
+            handle->adaptive = soundConfig.adaptiveLatency() && !callbackRender;
+            if (handle->adaptive) {
+                // the configured latency is the upper bound, the stream's
+                // buffer is allocated for it. Below two device periods an
+                // underrun is certain, so that is the lowest it can go
+                handle->latency.setup(
+                    std::max(
+                        (size_t)(soundConfig.minLatency() * samplerate / 1000),
+                        std::min(mStream.devicePeriod() * 2, handle->bufferSize)
+                    ),
+                    handle->bufferSize,
+                    (unsigned)samplerate
+                );
+            }
 
 
-            mVisBuffer.access()->resize(handle->synth.framesize());
-
-
-
+            publishBufferStats(handle);
         }
 
-        if (wasRunning && mStream.isRunning()) {
-            mTimer->start();
+        if (wasRunning && mStream.isRunning() && !callbackRender) {
+            mTimer.start();
         }
 
         return true;
 
+    } else if (mStream.isEnabled()) {
+        // the current device is still playing, resume writing to it
+        if (wasRunning && mStream.isRunning() && !mStream.hasRenderCallback()) {
+            mTimer.start();
+        }
+        return false;
     } else {
-        // something went wrong
-        mContext.access()->state = State::stopped;
+        // something went wrong, the stream is disabled so the render is over.
+        // The error is reported by the return value
+        auto handle = mContext.access();
+        auto const wasRendering = mState != State::stopped;
+        mState = State::stopped;
+        handle.unlock();
+        mTimer.stop();
+        if (wasRendering) {
+            // emit anything flagged by the last render
+            mSignalTimer.stop();
+            pollSignals();
+            mVisBuffer.clear();
+            emit updateVisualizers();
+            emit audioStopped();
+        }
         return false;
     }
 }
 
+void Renderer::setupSynth(Handle &handle, int samplerate, bool wasRunning) {
+    bool reloadRegisters = false;
+    if (samplerate != handle->synth.samplerate()) {
+        handle->synth.setSamplerate(samplerate);
+        reloadRegisters = wasRunning;
+    }
+    //handle->synth.apu().setQuality(static_cast<gbapu::Apu::Quality>(soundConfig.quality()));
+    handle->synth.setupBuffers();
+
+    if (reloadRegisters) {
+        // resizing the buffers in synth results in an APU reset so we need to
+        // rewrite channel registers
+        handle->engine.reload();
+    }
+
+    // the render cannot write while we have the lock
+    mVisBuffer.resize(handle->synth.framesize());
+}
+
+void Renderer::beginOfflineRender(int samplerate) {
+    auto handle = mContext.access();
+    mOffline = true;
+
+    // what setConfig does, for a callback render
+    setupSynth(handle, samplerate, false);
+    handle->bufferSize = 0;
+    handle->adaptive = false;
+    resetPosition(handle);
+
+    // what beginRender does, without a device or timers to start
+    auto const now = Clock::now();
+    handle->lastPeriod = now;
+    handle->watchdog = now;
+    mRenderStartTime = now;
+    mState = State::running;
+    handle->stopCounter = 0;
+    publishBufferStats(handle);
+}
+
+void Renderer::renderOffline(float *out, size_t frames) {
+    render(out, frames);
+}
+
+bool Renderer::acceptsCommands() const {
+    return mStream.isEnabled() || mOffline;
+}
+
 void Renderer::beginRender(Handle &handle) {
-    if (handle->state == State::stopped) {
+    if (mState == State::stopped) {
 
+        // in callback mode the stream may still be running from the last render
+        auto const restarted = !mStream.isRunning();
         bool success = mStream.start();
 
         if (success) {
+            if (restarted) {
+                resetPosition(handle);
+            }
             auto const now = Clock::now();
             handle->lastPeriod = now;
             handle->watchdog = now;
             mRenderStartTime = now;
-            mTimer->start();
+            if (!mStream.hasRenderCallback()) {
+                mTimer.start();
+            }
+            mSignalTimer.start();
             handle.unlock();
             emit audioStarted();
             handle.relock();
@@ -238,187 +507,187 @@ void Renderer::beginRender(Handle &handle) {
     }
 
     // reset state to running
-    handle->state = State::running;
+    mState = State::running;
     handle->stopCounter = 0;
 }
 
-void Renderer::stopRender(Handle &handle, bool aborted) {
-
-
-    // this lambda must only be called from the same thread as the Renderer
-    auto stopRender_ = [this](bool aborted) {
-
-        auto success = mStream.stop();
-
-        mVisBuffer.access()->clear();
-        emit updateVisualizers();
+void Renderer::resetPosition(Handle &handle) {
+    handle->framesRendered = 0;
+    mPositions.reader().flush();
+}
 
-        if (aborted) {
-            mStream.disable();
-            emit audioError();
-        } else {
-            if (success) {
-                emit audioStopped();
-            } else {
-                emit audioError();
-            }
-        }
-    };
+void Renderer::stopRender(Handle &handle, bool aborted) {
 
     // determine if we are in the GUI thread (same thread as the Renderer)
     // this function is mostly called from the timer thread, occurs when:
     //  - the buffer has drained and we are stopping
     //  - the watchdog timer has exceeded 1 second (unknown problem with device)
-    // for these cases we need to invoke the lambda in the GUI thread (AudioStream is not thread-safe)
-
-    mTimer->stop();
+    // for these cases we need to call finishStop in the GUI thread (AudioStream is not thread-safe)
+    //
+    // Commands may have been posted after the render thread last drained the
+    // queue. These are applied when stopping, and if any of them needs the
+    // render the stop is cancelled.
 
     if (objectInCurrentThread(*this)) {
-        handle->state = State::stopped;
+        drainCommands(handle);
+        mState = State::stopped;
+        // unlock first, stopping waits for a tick in progress which needs the lock
         handle.unlock();
-        stopRender_(aborted);
+        mTimer.stop();
+        finishStop(aborted);
+    } else if (mStream.hasRenderCallback()) {
+        // called from the device's thread. We cannot block here since
+        // AudioStream::stop waits for the callback to return. Mark the render
+        // as stopped so that further callbacks are silent, and stop the
+        // stream later from the GUI thread.
+        mState = State::stopped;
+        handle.unlock();
+        QMetaObject::invokeMethod(this, [this, aborted]() {
+            auto handle = mContext.access();
+            // a new render may have begun before we got here
+            if (mState == State::stopped) {
+                if (drainCommands(handle) && !aborted) {
+                    // the stream is still running, just resume
+                    beginRender(handle);
+                } else {
+                    handle.unlock();
+                    finishStop(aborted);
+                }
+            }
+        }, Qt::QueuedConnection);
     } else {
-        // stopRender was called from mTimerThread, invoke the lambda in the renderer's thread
+        // stopRender was called from the timer's thread, finish in the renderer's thread
         handle.unlock();
-        QMetaObject::invokeMethod(this, [this, &stopRender_, aborted]() {
-            mContext.access()->state = State::stopped;
-            stopRender_(aborted);
+        QMetaObject::invokeMethod(this, [this, aborted]() {
+            auto handle = mContext.access();
+            if (drainCommands(handle) && !aborted) {
+                // keep rendering
+                mState = State::running;
+                handle->stopCounter = 0;
+                mStream.setDraining(false);
+            } else {
+                mState = State::stopped;
+                handle.unlock();
+                finishStop(aborted);
+            }
         }, Qt::BlockingQueuedConnection);
+
+        if (mState == State::stopped) {
+            // no more ticks after this one
+            mTimer.stop();
+        }
     }
 
 
 }
 
+void Renderer::finishStop(bool aborted) {
+    // this function must only be called from the same thread as the Renderer
+
+    auto success = mStream.stop();
+
+    // emit anything flagged by the last render
+    mSignalTimer.stop();
+    pollSignals();
+
+    // the render has stopped, so we are the only user of the buffer
+    mVisBuffer.clear();
+    emit updateVisualizers();
+
+    if (aborted) {
+        mStream.disable();
+        emit audioError();
+    } else {
+        if (success) {
+            emit audioStopped();
+        } else {
+            emit audioError();
+        }
+    }
+}
+
 
 
 // SLOTS
 
 void Renderer::clearDiagnostics() {
     mStream.resetUnderruns();
+    mTimer.resetStats();
+    mCurrentFrame.resetRetries();
+    mDeferredFrames = 0;
+    mDroppedFrames = 0;
+    mTimings.reader().flush();
+    mProfile.clear();
 }
 
 void Renderer::play(int pattern, int row, bool stepmode) {
 
-    if (mStream.isEnabled()) {
-        auto handle = mContext.access();
-        _play(handle, pattern, row, stepmode);
+    if (acceptsCommands()) {
+        mStepping = stepmode;
+        Command cmd{ CommandType::play };
+        cmd.pattern = pattern;
+        cmd.row = row;
+        cmd.stepping = stepmode;
+        postCommand(cmd);
     }
 }
 
 
 void Renderer::stepNextFrame() {
     
-    if (mStream.isEnabled()) {
-        auto handle = mContext.access();
-        if (handle->stepping) {
-            handle->step = true;
-        }
-
+    if (acceptsCommands()) {
+        postCommand({ CommandType::stepNextFrame });
     }
 }
 
 void Renderer::stepOut() {
-    if (mStream.isEnabled()) {
-        mContext.access()->stepping = false;
+    if (acceptsCommands()) {
+        mStepping = false;
+        postCommand({ CommandType::stepOut });
     }
 }
 
 void Renderer::jumpToPattern(int pattern) {
-    if (mStream.isEnabled()) {
-        auto ctx = mContext.access();
-        ctx->engine.jump(pattern);
+    if (acceptsCommands()) {
+        Command cmd{ CommandType::jumpToPattern };
+        cmd.pattern = pattern;
+        postCommand(cmd);
     }
 }
 
 void Renderer::setPatternRepeat(bool repeat) {
 
-    if (mStream.isEnabled()) {
-        mContext.access()->engine.repeatPattern(repeat);
+    if (acceptsCommands()) {
+        Command cmd{ CommandType::setPatternRepeat };
+        cmd.repeat = repeat;
+        postCommand(cmd);
     }
 }
 
 void Renderer::setPreviewNote(int note) {
-    if (mStream.isEnabled()) {
-        auto ctx = mContext.access();
-        switch (ctx->previewState) {
-            case PreviewState::waveform: {
-                auto freq = trackerboy::lookupToneNote(note);
-                ctx->apu.writeRegister(trackerboy::Apu::REG_NR33, (uint8_t)(freq & 0xFF));
-                ctx->apu.writeRegister(trackerboy::Apu::REG_NR34, (uint8_t)(freq >> 8));
-                break;
-            }
-            case PreviewState::instrument:
-                // update the current note
-                ctx->ip.play((uint8_t)note);
-                break;
-            default:
-                break;
-        
-        }
+    if (acceptsCommands()) {
+        Command cmd{ CommandType::setPreviewNote };
+        cmd.note = note;
+        postCommand(cmd);
     }
 }
 
 void Renderer::instrumentPreview(int note, int track, int instrumentId) {
-    if (mStream.isEnabled()) {
-        auto ctx = mContext.access();
-        switch (ctx->previewState) {
-            case PreviewState::instrument:
-            case PreviewState::waveform:
-                resetPreview(ctx);
-                [[fallthrough]];
-            case PreviewState::none: {
-                auto const& itable = ctx->mod.data().instrumentTable();
-                std::shared_ptr<const trackerboy::Instrument> inst = nullptr;
-                if (instrumentId != -1) {
-                    inst = itable.getShared((uint8_t)instrumentId);
-                }
-
-                if (track == -1) {
-                    // instrument preview
-                    Q_ASSERT(inst != nullptr); // must have an instrument
-                    ctx->previewChannel = inst->channel();
-                } else {
-                    // note preview
-                    ctx->previewChannel = static_cast<trackerboy::ChType>(track);
-                }
-
-                ctx->ip.setInstrument(std::move(inst), ctx->previewChannel);
-
-                ctx->previewState = PreviewState::instrument;
-                // unlock the channel for preview
-                ctx->engine.unlock(ctx->previewChannel);
-                ctx->ip.play((uint8_t)note);
-                break;
-            }
-        }
-        beginRender(ctx);
+    if (acceptsCommands()) {
+        Command cmd{ CommandType::instrumentPreview };
+        cmd.note = note;
+        cmd.track = track;
+        cmd.instrument = instrumentId;
+        postCommand(cmd);
     }
 }
 
 void Renderer::waveformPreview(int note, int waveId) {
-    if (mStream.isEnabled()) {
-        auto ctx = mContext.access();
-        switch (ctx->previewState) {
-            case PreviewState::instrument:
-            case PreviewState::waveform:
-                resetPreview(ctx);
-                [[fallthrough]];
-            case PreviewState::none:
-                ctx->previewState = PreviewState::waveform;
-                ctx->previewChannel = trackerboy::ChType::ch3;
-                // unlock the channel, no longer effected by music
-                ctx->engine.unlock(trackerboy::ChType::ch3);
-
-                trackerboy::ChannelState state(trackerboy::ChType::ch3);
-                state.playing = true;
-                state.frequency = trackerboy::lookupToneNote(note);
-                state.envelope = (uint8_t)waveId;
-                trackerboy::ChannelControl<trackerboy::ChType::ch3>::init(
-                    ctx->apu, ctx->mod.data().waveformTable(), state
-                );
-                break;
-        }
-        beginRender(ctx);
+    if (acceptsCommands()) {
+        Command cmd{ CommandType::waveformPreview };
+        cmd.note = note;
+        cmd.waveId = waveId;
+        postCommand(cmd);
     }
 }
 
@@ -430,20 +699,17 @@ void Renderer::updateFramerate() {
 
 void Renderer::stopPreview() {
 
-    if (mStream.isEnabled()) {
-        auto handle = mContext.access();
-        if (handle->previewState != PreviewState::none) {
-            resetPreview(handle);
-        }
+    if (acceptsCommands()) {
+        postCommand({ CommandType::stopPreview });
     }
     
 }
 
 void Renderer::stopMusic() {
     
-    if (mStream.isEnabled()) {
-        auto handle = mContext.access();
-        _stopMusic(handle);
+    if (acceptsCommands()) {
+        mStepping = false;
+        postCommand({ CommandType::stopMusic });
     }
 
 }
@@ -455,12 +721,14 @@ void Renderer::_stopMusic(Handle &handle) {
 
 void Renderer::forceStop() {
 
-    if (mStream.isEnabled()) {
+    if (acceptsCommands()) {
         auto handle = mContext.access();
-        if (handle->state != State::stopped) {
+        drainCommands(handle);
+        if (mState != State::stopped) {
             resetPreview(handle);
             handle->engine.halt();
             handle->stepping = false;
+            mStepping = false;
             stopRender(handle);
         }
     }
@@ -469,10 +737,9 @@ void Renderer::forceStop() {
 void Renderer::_play(Handle &handle, int orderNo, int rowNo, bool stepping) {
 
     handle->engine.play(orderNo, rowNo);
-    _setChannelOutput(handle, mOutputFlags);
+    _setChannelOutput(handle, handle->outputFlags);
     handle->stepping = stepping;
     handle->step = stepping;
-    beginRender(handle);
 
 }
 
@@ -484,35 +751,225 @@ void Renderer::resetPreview(Handle &handle) {
 }
 
 void Renderer::resetGlobalVolume() {
-    auto ctx = mContext.access();
-    ctx->apu.writeRegister(trackerboy::IApuIo::REG_NR50, 0x77);
-}
-
- void Renderer::setChannelOutput(ChannelOutput::Flags flags) {
-     mOutputFlags = flags;
-     auto ctx = mContext.access();
-     _setChannelOutput(ctx, flags);
- }
-
- void Renderer::_setChannelOutput(Handle &handle, ChannelOutput::Flags flags) {
-     int flag = ChannelOutput::CH1;
-     for (int i = 0; i < 4; ++i) {
-         auto ch = static_cast<trackerboy::ChType>(i);
-         if (flags.testFlag((ChannelOutput::Flag)(flag))) {
-             handle->engine.lock(ch);
-         } else {
-             // channel is disabled, keep unlocked
-             handle->engine.unlock(ch);
-         }
-         flag <<= 1;
-     }
- }
+    postCommand({ CommandType::resetGlobalVolume });
+}
+
+void Renderer::setChannelOutput(ChannelOutput::Flags flags) {
+    Command cmd{ CommandType::setChannelOutput };
+    cmd.outputFlags = (int)flags;
+    postCommand(cmd);
+}
+
+void Renderer::_setChannelOutput(Handle &handle, ChannelOutput::Flags flags) {
+    int flag = ChannelOutput::CH1;
+    for (int i = 0; i < 4; ++i) {
+        auto ch = static_cast<trackerboy::ChType>(i);
+        if (flags.testFlag((ChannelOutput::Flag)(flag))) {
+            handle->engine.lock(ch);
+        } else {
+            // channel is disabled, keep unlocked
+            handle->engine.unlock(ch);
+        }
+        flag <<= 1;
+    }
+}
+
+// COMMANDS
+
+void Renderer::postCommand(Command const& cmd) {
+    // this function must only be called from the GUI thread (single producer)
+
+    if (mState != State::stopped && mCommands.writer().write(&cmd, 1)) {
+        // the render thread will apply it at the start of the next frame
+        return;
+    }
+
+    // not rendering or the queue is full, apply it now
+    auto handle = mContext.access();
+    bool needsRender = drainCommands(handle);
+    tryApplyCommand(handle, cmd, true, needsRender);
+    if (needsRender) {
+        beginRender(handle);
+    }
+}
+
+bool Renderer::drainCommands(Handle &handle, bool wait) {
+    bool needsRender = false;
+
+    // a command deferred by an earlier drain goes first, to keep the order
+    if (mCommandDeferred) {
+        if (!tryApplyCommand(handle, mDeferredCommand, wait, needsRender)) {
+            return needsRender;
+        }
+        mCommandDeferred = false;
+    }
+
+    auto reader = mCommands.reader();
+    Command cmd;
+    while (reader.read(&cmd, 1)) {
+        if (!tryApplyCommand(handle, cmd, wait, needsRender)) {
+            mDeferredCommand = cmd;
+            mCommandDeferred = true;
+            break;
+        }
+    }
+    return needsRender;
+}
+
+bool Renderer::tryApplyCommand(Handle &handle, Command const& cmd, bool wait, bool &needsRender) {
+    // everything but the flag commands reaches the engine, previewer or APU,
+    // which read the song and the tables, so these are applied with the
+    // module locked like a step is
+    bool readsModule;
+    switch (cmd.type) {
+        case CommandType::stepNextFrame:
+        case CommandType::stepOut:
+        case CommandType::stopPreview:
+            readsModule = false;
+            break;
+        default:
+            readsModule = true;
+            break;
+    }
+    if (!readsModule) {
+        needsRender |= applyCommand(handle, cmd);
+        return true;
+    }
+
+    auto &mutex = handle->mod.mutex();
+    if (wait) {
+        mutex.lock();
+    } else if (!mutex.tryLock()) {
+        return false;
+    }
+    needsRender |= applyCommand(handle, cmd);
+    mutex.unlock();
+    return true;
+}
+
+void Renderer::drainCommandsRender(Handle &handle) {
+    // the render thread never waits on the module
+    if (drainCommands(handle, false)) {
+        // cancel the stop countdown, if any
+        mState = State::running;
+        handle->stopCounter = 0;
+        mStream.setDraining(false);
+    }
+}
+
+bool Renderer::applyCommand(Handle &handle, Command const& cmd) {
+
+    switch (cmd.type) {
+        case CommandType::play:
+            _play(handle, cmd.pattern, cmd.row, cmd.stepping);
+            return true;
+        case CommandType::stepNextFrame:
+            if (handle->stepping) {
+                handle->step = true;
+            }
+            break;
+        case CommandType::stepOut:
+            handle->stepping = false;
+            break;
+        case CommandType::jumpToPattern:
+            handle->engine.jump(cmd.pattern);
+            break;
+        case CommandType::setPatternRepeat:
+            handle->engine.repeatPattern(cmd.repeat);
+            break;
+        case CommandType::setPreviewNote:
+            switch (handle->previewState) {
+                case PreviewState::waveform: {
+                    auto freq = trackerboy::lookupToneNote(cmd.note);
+                    handle->apu.writeRegister(trackerboy::Apu::REG_NR33, (uint8_t)(freq & 0xFF));
+                    handle->apu.writeRegister(trackerboy::Apu::REG_NR34, (uint8_t)(freq >> 8));
+                    break;
+                }
+                case PreviewState::instrument:
+                    // update the current note
+                    handle->ip.play((uint8_t)cmd.note);
+                    break;
+                default:
+                    break;
+            }
+            break;
+        case CommandType::instrumentPreview: {
+            if (handle->previewState != PreviewState::none) {
+                resetPreview(handle);
+            }
+
+            std::shared_ptr<const trackerboy::Instrument> inst = nullptr;
+            if (cmd.instrument != -1) {
+                // the module was locked by tryApplyCommand
+                inst = handle->mod.data().instrumentTable().getShared((uint8_t)cmd.instrument);
+            }
+
+            if (cmd.track == -1) {
+                // instrument preview
+                Q_ASSERT(inst != nullptr); // must have an instrument
+                handle->previewChannel = inst->channel();
+            } else {
+                // note preview
+                handle->previewChannel = static_cast<trackerboy::ChType>(cmd.track);
+            }
+
+            handle->ip.setInstrument(std::move(inst), handle->previewChannel);
+
+            handle->previewState = PreviewState::instrument;
+            // unlock the channel for preview
+            handle->engine.unlock(handle->previewChannel);
+            handle->ip.play((uint8_t)cmd.note);
+            return true;
+        }
+        case CommandType::waveformPreview: {
+            if (handle->previewState != PreviewState::none) {
+                resetPreview(handle);
+            }
+            handle->previewState = PreviewState::waveform;
+            handle->previewChannel = trackerboy::ChType::ch3;
+            // unlock the channel, no longer effected by music
+            handle->engine.unlock(trackerboy::ChType::ch3);
+
+            trackerboy::ChannelState state(trackerboy::ChType::ch3);
+            state.playing = true;
+            state.frequency = trackerboy::lookupToneNote(cmd.note);
+            state.envelope = (uint8_t)cmd.waveId;
+            // the module was locked by tryApplyCommand
+            trackerboy::ChannelControl<trackerboy::ChType::ch3>::init(
+                handle->apu, handle->mod.data().waveformTable(), state
+            );
+            return true;
+        }
+        case CommandType::stopPreview:
+            if (handle->previewState != PreviewState::none) {
+                resetPreview(handle);
+            }
+            break;
+        case CommandType::stopMusic:
+            _stopMusic(handle);
+            break;
+        case CommandType::setChannelOutput:
+            handle->outputFlags = ChannelOutput::Flags(QFlag(cmd.outputFlags));
+            _setChannelOutput(handle, handle->outputFlags);
+            break;
+        case CommandType::resetGlobalVolume:
+            handle->apu.writeRegister(trackerboy::IApuIo::REG_NR50, 0x77);
+            break;
+    }
+
+    return false;
+}
 
 void Renderer::timerCallback(void *userData) {
     // called by FastTimer 
     static_cast<Renderer*>(userData)->render();
 }
 
+void Renderer::renderCallback(void *userData, void *out, size_t frames) {
+    // called by AudioStream from the device's thread
+    static_cast<Renderer*>(userData)->render(out, frames);
+}
+
 // this is the number of frames to output before stopping playback
 // (prevents a hard pop noise that may occur when stopping abruptly, as
 // the high pass filter will decay the signal to 0)
@@ -526,19 +983,37 @@ void Renderer::render() {
 
     auto handle = mContext.access();
 
-    if (handle->state == State::stopped) {
+    if (mState == State::stopped) {
         return;
     }
 
+    drainCommandsRender(handle);
+
 
     // diagnostics
     handle->periodTime = now - handle->lastPeriod;
     handle->lastPeriod = now;
     handle->writesSinceLastPeriod = 0;
+    handle->stepTime = Clock::duration::zero();
+    handle->synthTime = Clock::duration::zero();
+    handle->readTime = Clock::duration::zero();
+    handle->periodDeferred = 0;
+    handle->periodDropped = 0;
+
+
+    if (handle->adaptive && mState == State::running) {
+        auto const samplerate = handle->synth.samplerate();
+        auto const periodFrames = (size_t)(std::chrono::duration<double>(handle->periodTime).count() * samplerate);
+        // frames still waiting to be played
+        auto const fill = handle->bufferSize - mStream.availableWrite();
+        auto const size = handle->latency.update(mStream.underruns(), fill, periodFrames);
+        if (size != handle->bufferSize) {
+            mStream.setBufferSize(size);
+            handle->bufferSize = size;
+        }
+    }
 
-
-    auto writer = mStream.writer();
-    auto framesToRender = writer.availableWrite();
+    auto framesToRender = mStream.availableWrite();
 
     if (framesToRender) {
         // reset the watchdog
@@ -549,118 +1024,310 @@ void Renderer::render() {
         if (timeSinceLastWatchdogReset >= WATCHDOG_INTERVAL) {
             // we have gone 1 second without renderering anything
             // abort the render
-            handle.unlock();
             stopRender(handle, true);
         }
         // no frames to render, exit early
         return;
     }
 
-    
+    if (mState == State::stopping) {
+        if (framesToRender == handle->bufferSize) {
+            // the buffer has been drained, stop the callback
+            stopRender(handle);
+        }
+        return;
+    }
+
     auto frame = handle->currentEngineFrame;
-    auto const haltedBefore = frame.halted;
+    bool newFrame = false;
 
-    // cache a ref to the apu, we'll be using it often
-    auto &apu = handle->apu;
+    mVisBuffer.beginWrite(framesToRender);
+    if (mStream.format() == SampleFormat::s16) {
+        auto writer = mStream.writerS16();
+        fillBuffer(handle, writer, framesToRender, frame, newFrame);
+    } else {
+        auto writer = mStream.writer();
+        fillBuffer(handle, writer, framesToRender, frame, newFrame);
+    }
+    mVisBuffer.publish();
+
+    if (mState == State::stopping) {
+        // nothing else will be rendered, let the buffer drain
+        mStream.setDraining(true);
+    }
+
+    recordPeriod(handle, now);
+    finishRender(handle, frame, newFrame);
+
+}
+
+template <typename Writer>
+void Renderer::fillBuffer(Handle &handle, Writer &writer, size_t frames, trackerboy::Frame &frame, bool &newFrame) {
+    while (frames) {
+        size_t toWrite = frames;
+        auto writePtr = writer.acquireWrite(toWrite);
+        auto const written = renderTo(handle, writePtr, toWrite, frame, newFrame);
+        writer.commitWrite(written);
+        frames -= written;
+
+        if (written < toWrite) {
+            break; // stopping
+        }
+    }
+}
+
+size_t Renderer::renderTo(Handle &handle, float *out, size_t frames, trackerboy::Frame &frame, bool &newFrame) {
+    auto const written = synthesize(handle, out, frames, frame, newFrame);
+    // send a copy to the visualizer buffer as well
+    mVisBuffer.write(out, written);
+    return written;
+}
+
+size_t Renderer::renderTo(Handle &handle, int16_t *out, size_t frames, trackerboy::Frame &frame, bool &newFrame) {
+    // synthesize in chunks to the scratch buffer, then convert
+    auto const scratch = handle->scratch.get();
+    size_t total = 0;
+    while (total < frames) {
+        auto const toWrite = std::min(frames - total, TU::SCRATCH_FRAMES);
+        auto const written = synthesize(handle, scratch, toWrite, frame, newFrame);
+        mVisBuffer.write(scratch, written);
+        convertToS16(scratch, out + (total * 2), written * 2);
+        total += written;
+        if (written < toWrite) {
+            break; // stopping
+        }
+    }
+    return total;
+}
+
+void Renderer::render(void *out, size_t frames) {
+    // This function is called from the device's thread!
+    // Only used in callback render mode, out is already silent
+
+    auto now = Clock::now();
 
+    auto handle = mContext.access();
+
+    if (mState == State::stopped) {
+        return;
+    }
+
+    drainCommandsRender(handle);
+
+    // nothing is buffered, the output starts where the stream is at. An
+    // offline render has no stream, its position is what it has rendered
+    if (!mOffline) {
+        handle->framesRendered = mStream.framesPlayed();
+    }
+
+    // diagnostics, the period is the time between device callbacks
+    handle->periodTime = now - handle->lastPeriod;
+    handle->lastPeriod = now;
+    handle->writesSinceLastPeriod = 0;
+    handle->stepTime = Clock::duration::zero();
+    handle->synthTime = Clock::duration::zero();
+    handle->readTime = Clock::duration::zero();
+    handle->periodDeferred = 0;
+    handle->periodDropped = 0;
+
+    if (mState == State::stopping) {
+        // nothing is buffered, so there is nothing to drain
+        stopRender(handle);
+        return;
+    }
+
+    auto frame = handle->currentEngineFrame;
     bool newFrame = false;
 
-    auto visHandle = mVisBuffer.access();
-    visHandle->beginWrite(framesToRender);
+    // render straight into the device's buffer, in its format
+    mVisBuffer.beginWrite(frames);
+    if (!mOffline && mStream.format() == SampleFormat::s16) {
+        renderTo(handle, static_cast<int16_t*>(out), frames, frame, newFrame);
+    } else {
+        renderTo(handle, static_cast<float*>(out), frames, frame, newFrame);
+    }
+    mVisBuffer.publish();
 
-    while (framesToRender) {
+    recordPeriod(handle, now);
+    finishRender(handle, frame, newFrame);
+}
 
-        if (handle->state == State::stopping) {
-            if (writer.availableWrite() == handle->bufferSize) {
-                // the buffer has been drained, stop the callback
-                visHandle.unlock();
-                stopRender(handle);
-            }
-            return;
+size_t Renderer::synthesize(Handle &handle, float *out, size_t frames, trackerboy::Frame &frame, bool &newFrame) {
 
-        } else {
+    // cache a ref to the apu, we'll be using it often
+    auto &apu = handle->apu;
 
-            if (apu.samplesAvailable() == 0) {
-                // new frame
+    size_t written = 0;
+    while (written < frames) {
 
-                if (handle->state == State::stopping) {
-                    break; // stop, don't render any more
-                }
+        if (apu.samplesAvailable() == 0) {
+            // new frame
+            drainCommandsRender(handle);
 
-                if (handle->stopCounter) {
-                    if (--handle->stopCounter == 0) {
-                        handle->state = State::stopping;
-                        mStream.setDraining(true);
+            if (mState == State::stopping) {
+                break; // stop, don't render any more
+            }
+
+            if (handle->stopCounter) {
+                if (--handle->stopCounter == 0) {
+                    mState = State::stopping;
+                }
+            } else {
+                newFrame = true;
+
+                // the engine and previewer have read access to the module
+                // so the document must be locked when stepping. If the GUI
+                // is in the middle of an edit we don't wait for it, the step
+                // is deferred and made up on a later frame instead.
+                auto &mutex = handle->mod.mutex();
+                auto const stepStart = Clock::now();
+                if (mutex.tryLock()) {
+                    // catch up at most one deferred frame per frame, so
+                    // that the tempo is only briefly affected
+                    auto steps = 1;
+                    if (handle->deferredFrames) {
+                        --handle->deferredFrames;
+                        ++steps;
+                    }
+                    // the position is that of the last step, but a row may
+                    // have started in any of them
+                    bool startedNewRow = false;
+                    while (steps--) {
+                        stepFrame(handle, frame);
+                        startedNewRow |= frame.startedNewRow;
                     }
+                    frame.startedNewRow = startedNewRow;
+                    mutex.unlock();
+
+                    // the GUI shows this frame once its first sample is played
+                    // if the queue is full, the GUI is not keeping up and the
+                    // event is dropped
+                    PositionEvent const event{ handle->framesRendered + written, frame };
+                    mPositions.writer().write(&event, 1);
                 } else {
-                    newFrame = true;
-
-                    // the engine and previewer have read access to the module
-                    // so the document must be locked when stepping
-
-                    // step engine/previewer
-                    if (!handle->stepping || handle->step) {
-                        
-                        {
-                            QMutexLocker locker(&handle->mod.mutex());
-                            handle->engine.step(frame);
-                        }
-                        
-                        if (frame.startedNewRow) {
-                            handle->step = false;
-                        }
+                    if (handle->deferredFrames < TU::MAX_DEFERRED_FRAMES) {
+                        ++handle->deferredFrames;
+                    } else {
+                        // too far behind, this frame is skipped
+                        mDroppedFrames.fetch_add(1, std::memory_order_relaxed);
+                        ++handle->periodDropped;
                     }
+                    mDeferredFrames.fetch_add(1, std::memory_order_relaxed);
+                    ++handle->periodDeferred;
+                }
+                handle->stepTime += Clock::now() - stepStart;
 
-                    if (handle->previewState == PreviewState::instrument) {
-                        auto &mod = handle->mod.data();
-                        trackerboy::RuntimeContext rc(apu, mod.instrumentTable(), mod.waveformTable());
-                        
-                        {
-                            QMutexLocker locker(&handle->mod.mutex());
-                            handle->ip.step(rc);
-                        }
-                    }
+                if (frame.halted && handle->previewState == PreviewState::none) {
+                    // no longer doing anything, start the stop counter
+                    handle->stopCounter = STOP_FRAMES;
+                }
 
+            }
 
-                    if (frame.halted && handle->previewState == PreviewState::none) {
-                        // no longer doing anything, start the stop counter
-                        handle->stopCounter = STOP_FRAMES;
-                    }
+            auto const synthStart = Clock::now();
+            handle->synth.run();
+            handle->synthTime += Clock::now() - synthStart;
 
-                }
+        }
 
-                handle->synth.run();
+        size_t toWrite = std::min(frames - written, apu.samplesAvailable());
+        
+        // read from the apu to the output
+        auto const readStart = Clock::now();
+        apu.readSamples(out + (written * 2), toWrite);
+        handle->readTime += Clock::now() - readStart;
+        written += toWrite;
 
-            }
+    }
 
-            size_t toWrite = std::min(framesToRender, apu.samplesAvailable());
-            auto writePtr = writer.acquireWrite(toWrite);
-            
-            // read from the apu to the ringbuffer
-            apu.readSamples(writePtr, toWrite);
-            // send a copy to the visualizer buffer as well
-            visHandle->write(writePtr, toWrite);
-            
-            writer.commitWrite(toWrite);
-            
-            handle->writesSinceLastPeriod += toWrite;
-            framesToRender -= toWrite;
+    handle->writesSinceLastPeriod += written;
+    handle->framesRendered += written;
+    return written;
+}
+
+void Renderer::stepFrame(Handle &handle, trackerboy::Frame &frame) {
+    // step engine/previewer
+    if (!handle->stepping || handle->step) {
+        handle->engine.step(frame);
 
+        if (frame.startedNewRow) {
+            handle->step = false;
         }
+    }
 
+    if (handle->previewState == PreviewState::instrument) {
+        handle->ip.step(handle->rc);
     }
+}
 
-    if (handle->writesSinceLastPeriod) {
-        emit updateVisualizers();
+void Renderer::recordPeriod(Handle &handle, Clock::time_point start) {
+    RenderProfile::Period const period{
+        TU::toMicroseconds(handle->periodTime),
+        TU::toMicroseconds(Clock::now() - start),
+        TU::toMicroseconds(handle->stepTime),
+        TU::toMicroseconds(handle->synthTime),
+        TU::toMicroseconds(handle->readTime),
+        handle->periodDeferred,
+        handle->periodDropped
+    };
+    // dropped if the queue is full
+    mTimings.writer().write(&period, 1);
+    publishBufferStats(handle);
+}
+
+void Renderer::publishBufferStats(Handle &handle) {
+    // the holder of the context lock is the buffer's writer
+    auto const size = handle->bufferSize;
+    mBufferStats.store({
+        (int)(size - mStream.availableWrite()),
+        (int)size,
+        (int)handle->writesSinceLastPeriod,
+        std::chrono::duration<double, std::milli>{handle->periodTime}.count(),
+        handle->adaptive,
+        size * 1000.0 / handle->synth.samplerate()
+    });
+}
+
+void Renderer::finishRender(Handle &handle, trackerboy::Frame const& frame, bool newFrame) {
+
+    // signals are not emitted from here, a queued connection allocates an
+    // event for every emit. The GUI thread polls for them instead.
+    unsigned flags = 0;
+    if (handle->writesSinceLastPeriod != 0) {
+        flags |= TU::SIGNAL_VISUALIZERS;
     }
 
     if (newFrame) {
         handle->currentEngineFrame = frame;
-        handle.unlock(); // always unlock before emitting signals
-        if (haltedBefore != frame.halted) {
-            emit isPlayingChanged(!frame.halted);
-        }
-        emit frameSync();
+        mCurrentFrame.store(frame);
+        flags |= TU::SIGNAL_FRAME;
     }
+    handle.unlock();
+
+    if (flags) {
+        mPendingSignals.fetch_or(flags, std::memory_order_release);
+    }
+}
 
+void Renderer::pollSignals() {
+    auto const flags = mPendingSignals.exchange(0, std::memory_order_acquire);
+
+    // keep the queue from filling up, so that the profile always has the
+    // most recent periods, whether or not anyone is looking at it
+    drainTimings();
+
+    if (flags & TU::SIGNAL_VISUALIZERS) {
+        emit updateVisualizers();
+    }
+
+    auto const playing = isPlaying();
+    if (playing != mLastPlaying) {
+        mLastPlaying = playing;
+        emit isPlayingChanged(playing);
+    }
+
+    // frames that are buffered may start playing without a new render
+    if ((flags & TU::SIGNAL_FRAME) || mPositions.reader().availableRead()) {
+        emit frameSync();
+    }
 }
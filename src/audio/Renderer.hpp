@@ -3,12 +3,16 @@
 
 #include "audio/AudioStream.hpp"
 #include "audio/AudioEnumerator.hpp"
+#include "audio/LatencyController.hpp"
+#include "audio/RenderProfile.hpp"
+#include "audio/Ringbuffer.hpp"
 #include "audio/VisualizerBuffer.hpp"
 #include "config/data/SoundConfig.hpp"
 #include "core/ChannelOutput.hpp"
 #include "utils/FastTimer.hpp"
 #include "core/Module.hpp"
 #include "utils/Guarded.hpp"
+#include "utils/Seqlock.hpp"
 
 #include "trackerboy/apu/DefaultApu.hpp"
 #include "trackerboy/data/Song.hpp"
@@ -20,9 +24,12 @@
 #include "trackerboy/note.hpp"
 
 #include <QObject>
-#include <QThread>
+#include <QTimer>
 
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <memory>
 
 //
 // Class handles all sound renderering. Sound is sent to the
@@ -36,6 +43,13 @@ class Renderer : public QObject {
 
 public:
 
+    struct DeferStats {
+        // number of engine frames deferred due to the module being locked
+        unsigned deferred;
+        // number of deferred frames that could not be caught up on
+        unsigned dropped;
+    };
+
     struct BufferStats {
         // usage, in number of samples, of the buffer
         int usage;
@@ -45,6 +59,22 @@ public:
         int writesSinceLastPeriod;
         // duration of the last period, in milliseconds
         double lastPeriodMs;
+        // true if the buffer size is adjusted automatically
+        bool adaptive;
+        // current size of the buffer, in milliseconds
+        double latencyMs;
+    };
+
+    struct DeviceStats {
+        // size of a device period, in samples
+        int period;
+        // number of periods in the device's buffer
+        int periods;
+        // size of a device period, in milliseconds
+        double periodMs;
+        // latency of the device's buffer, in milliseconds, as reported by
+        // the backend
+        double latencyMs;
     };
 
     explicit Renderer(Module &mod, QObject *parent = nullptr);
@@ -59,9 +89,9 @@ public:
     unsigned statUnderruns() const;
 
     //
-    // Gets the current buffer statistics.
+    // Gets the buffer statistics of the last render period. Does not block.
     //
-    BufferStats statBuffer();
+    BufferStats statBuffer() const;
 
     //
     // Gets the elapsed time, in milliseconds, of the current render. Behavior
@@ -69,16 +99,58 @@ public:
     //
     long statElapsed() const;
 
+    //
+    // Gets the lateness statistics of the render timer.
+    //
+    FastTimer::Stats statTimer() const;
+
+    //
+    // Gets the number of times a read of the current frame had to be retried
+    // because the render thread was publishing a new one.
+    //
+    unsigned statFrameRetries() const;
+
+    //
+    // Gets the number of engine frames deferred because the module was
+    // being edited.
+    //
+    DeferStats statDeferredFrames() const;
+
+    //
+    // Gets the period size and latency picked by the backend for the output
+    // device.
+    //
+    DeviceStats statDevice() const;
+
+    //
+    // Gets the sample format of the output device.
+    //
+    SampleFormat statFormat() const;
+
+    //
+    // Gets the timing profile of the most recent render periods. Must be
+    // called from the GUI thread.
+    //
+    RenderProfile const& statProfile();
+
+    //
+    // Gets the latency, in milliseconds, saved by rendering in the audio
+    // callback instead of buffering ahead. 0 is returned when not rendering
+    // in the callback.
+    //
+    int statLatencySaved() const;
+
     //
     // Get the current samplerate
     //
-    int samplerate();
+    int samplerate() const;
 
     //
     // Accessor for the visualizer buffer. The updateVisualizers() signal is
-    // emitted when this buffer is modified.
+    // emitted when a new snapshot was published. Snapshots must only be taken
+    // from the GUI thread.
     //
-    Guarded<VisualizerBuffer>& visualizerBuffer();
+    VisualizerBuffer& visualizerBuffer();
 
     //
     // Determines if the renderer is renderering sound.
@@ -96,14 +168,32 @@ public:
     bool isPlaying();
 
     //
-    // Gets a copy of the current engine frame.
+    // Starts a render with no device, for driving the renderer without a
+    // sound card (ie tests). The synthesizer is set up for the given
+    // samplerate and commands are accepted as if a device was open. Must not
+    // be used with a configured device.
+    //
+    void beginOfflineRender(int samplerate);
+
+    //
+    // Renders the given number of frames to out (interleaved stereo float),
+    // as the device callback would. Only valid after beginOfflineRender.
+    //
+    void renderOffline(float *out, size_t frames);
+
+    //
+    // Gets the engine frame that is currently being played out by the
+    // device, so the latency of the buffer is accounted for. startedNewRow is
+    // only set if a new row was heard since the last call. Does not block,
+    // must be called from the GUI thread.
     //
     trackerboy::Frame currentFrame();
 
     //
     // Configures the output device with the given Sound config. If device
-    // cannot be configured, the renderer is disabled. This function must
-    // be called from the GUI thread.
+    // cannot be configured, false is returned and the renderer is disabled,
+    // unless audio is playing, which then continues on the current device.
+    // This function must be called from the GUI thread.
     //
     bool setConfig(SoundConfig const& config, AudioEnumerator const& enumerator);
 
@@ -212,7 +302,7 @@ signals:
     void audioError();
 
     //
-    // emitted when a new frame is renderered
+    // emitted when a new frame is renderered or heard
     //
     void frameSync();
 
@@ -251,7 +341,7 @@ private:
         // the current module
         Module &mod;
 
-        // indicates if step mode is enabled
+        // indicates if step mode is enabled (the render thread's copy of mStepping)
         bool stepping;
         // determines if the engine should step (ignored when mStepping = false)
         bool step;
@@ -260,7 +350,9 @@ private:
 
         trackerboy::DefaultApu apu;
         trackerboy::Synth synth;
-        //trackerboy::RuntimeContext mRc;
+        // apu, instrument and wave table for the previewer, kept here so
+        // that it isn't constructed every frame
+        trackerboy::RuntimeContext rc;
         // read access to the current song, wave table and instrument table
         trackerboy::Engine engine;
         // has read access to an Instrument and wave table
@@ -272,16 +364,39 @@ private:
 
         trackerboy::Frame currentEngineFrame;
 
-        State state;
+        // channel output flags, applied to the engine when playing
+        ChannelOutput::Flags outputFlags;
+
         int stopCounter;
 
+        // number of engine steps behind due to the module being locked
+        int deferredFrames;
+
+        // position of the next sample to be synthesized, in frames played
+        // by the stream (see AudioStream::framesPlayed)
+        uint64_t framesRendered;
+
         size_t bufferSize; // cache this here so we don't have to call mStream.bufferSize() in the render thread
 
+        // adaptive latency, adjusts bufferSize when enabled
+        bool adaptive;
+        LatencyController latency;
+
         // diagnostics
         Clock::time_point watchdog; // occurance of last watchdog reset
         Clock::time_point lastPeriod; // occurance of the last period
         Clock::duration periodTime; // time difference between the last period and the current one
         size_t writesSinceLastPeriod; // number of samples written for the last period
+        // time spent in the current period stepping, synthesizing and reading samples
+        Clock::duration stepTime;
+        Clock::duration synthTime;
+        Clock::duration readTime;
+        // engine steps deferred and skipped in the current period
+        unsigned periodDeferred;
+        unsigned periodDropped;
+
+        // synthesized samples waiting to be converted to the device's format
+        std::unique_ptr<float[]> scratch;
 
         RenderContext(Module &mod);
     };
@@ -289,6 +404,86 @@ private:
     // type alias for mutually exclusive access to the RenderContext
     using Handle = Locked<RenderContext>;
 
+    //
+    // An engine frame and the position of its first sample in the stream.
+    // The frame is heard once the stream has played up to the position.
+    //
+    struct PositionEvent {
+        uint64_t position;
+        trackerboy::Frame frame;
+    };
+
+    enum class CommandType : uint8_t {
+        play,
+        stepNextFrame,
+        stepOut,
+        jumpToPattern,
+        setPatternRepeat,
+        setPreviewNote,
+        instrumentPreview,
+        waveformPreview,
+        stopPreview,
+        stopMusic,
+        setChannelOutput,
+        resetGlobalVolume
+    };
+
+    //
+    // A GUI action for the render thread. Only the parameters used by the
+    // type are set, the rest are 0.
+    //
+    struct Command {
+        CommandType type;
+        int pattern;
+        int row;
+        int note;
+        int track;
+        int instrument;
+        int waveId;
+        int outputFlags;
+        bool stepping;
+        bool repeat;
+    };
+
+    //
+    // Posts a command from the GUI thread. If rendering, the command is
+    // queued and applied by the render thread at the start of the next
+    // frame. Otherwise, it is applied immediately.
+    //
+    void postCommand(Command const& cmd);
+
+    //
+    // Applies all queued commands. Only the holder of the RenderContext lock
+    // may drain, making it the single consumer of the queue. Returns true if
+    // any of the commands requires the render to be running.
+    //
+    // Most commands read the module (see tryApplyCommand), when wait is false
+    // and the module is locked the command is deferred along with the
+    // commands after it, until a later drain.
+    //
+    bool drainCommands(Handle &handle, bool wait = true);
+
+    //
+    // Applies the command, locking the module for the commands that read it.
+    // Returns false if the command was not applied because wait is false and
+    // the module is locked. needsRender is set if the command requires the
+    // render to be running.
+    //
+    bool tryApplyCommand(Handle &handle, Command const& cmd, bool wait, bool &needsRender);
+
+    //
+    // Applies the command to the context, returns true if the command
+    // requires the render to be running. The module must be locked, except
+    // for stepNextFrame, stepOut and stopPreview.
+    //
+    bool applyCommand(Handle &handle, Command const& cmd);
+
+    //
+    // Drains the queue from the render thread. Cancels a pending stop if a
+    // command needs the render to keep running.
+    //
+    void drainCommandsRender(Handle &handle);
+
     // sets up the engine to play starting at the given pattern and row
     void _play(Handle &handle, int pattern, int row, bool stepping = false);
 
@@ -297,20 +492,41 @@ private:
     // utility function for preview slots
     void resetPreview(Handle &handle);
 
-    void previewNoteOrInstrument(int note, int track = -1, int instrument = -1);
-
     void _setChannelOutput(Handle &handle, ChannelOutput::Flags flags);
 
+    //
+    // Restarts the position count and discards any pending position events.
+    // Call when the stream was (re)started. Must be called from the GUI
+    // thread.
+    //
+    void resetPosition(Handle &handle);
+
+    //
+    // Sets the synthesizer up for the given samplerate and resizes the
+    // visualizer buffer to its frame. The engine is reloaded if the
+    // samplerate changed while wasRunning.
+    //
+    void setupSynth(Handle &handle, int samplerate, bool wasRunning);
+
+    //
+    // Determines if commands can be posted, there is an open device or an
+    // offline render.
+    //
+    bool acceptsCommands() const;
+
     // stream management -----------------------------------------------------
 
     //
     // Start the audio callback thread for the configured device. If the audio
-    // callback thread is already running, the stop countdown is cancelled
+    // callback thread is already running, the stop countdown is cancelled.
+    // Must be called from the GUI thread.
     //
     void beginRender(Handle &handle);
 
     static void timerCallback(void *userData);
 
+    static void renderCallback(void *userData, void *out, size_t frames);
+
     //
     // Fills the playback buffer with newly renderered samples. Stops rendering
     // if there is no work to do and the buffer has drained completely.
@@ -319,23 +535,138 @@ private:
     //
     void render();
 
+    //
+    // Renders the given number of frames directly into the device's output
+    // buffer, used instead of render() when rendering in the callback. out
+    // is in the stream's format.
+    //
+    // This function is called from the device's thread.
+    //
+    void render(void *out, size_t frames);
+
+    //
+    // Renders the given number of frames to the stream's buffer via the
+    // given writer.
+    //
+    template <typename Writer>
+    void fillBuffer(Handle &handle, Writer &writer, size_t frames, trackerboy::Frame &frame, bool &newFrame);
+
+    //
+    // Synthesizes up to frames samples into out in the out's format, and
+    // sends a copy to the visualizer buffer. Returns the number of frames
+    // renderered, see synthesize().
+    //
+    size_t renderTo(Handle &handle, float *out, size_t frames, trackerboy::Frame &frame, bool &newFrame);
+    size_t renderTo(Handle &handle, int16_t *out, size_t frames, trackerboy::Frame &frame, bool &newFrame);
+
+    //
+    // Synthesizes up to frames samples into out, stepping the engine and
+    // previewer as needed. Less than frames is returned if the render began
+    // stopping. newFrame is set to true if the engine was stepped.
+    //
+    size_t synthesize(Handle &handle, float *out, size_t frames, trackerboy::Frame &frame, bool &newFrame);
+
+    //
+    // Steps the engine and instrument previewer for one frame. The module
+    // must be locked.
+    //
+    void stepFrame(Handle &handle, trackerboy::Frame &frame);
+
+    //
+    // Updates the current engine frame and flags the signals to emit at the
+    // end of a render. The handle is unlocked.
+    //
+    void finishRender(Handle &handle, trackerboy::Frame const& frame, bool newFrame);
+
+    //
+    // Emits the signals flagged by the render thread. Called periodically
+    // from the GUI thread while rendering.
+    //
+    void pollSignals();
+
+    //
+    // Adds the period timings sent by the render thread to the profile.
+    //
+    void drainTimings();
+
+    //
+    // Sends the timings of the period that began at the given time to the
+    // GUI thread.
+    //
+    void recordPeriod(Handle &handle, Clock::time_point start);
+
+    //
+    // Publishes the buffer statistics for statBuffer().
+    //
+    void publishBufferStats(Handle &handle);
+
     //
     // Immediately stops the render without letting the buffer drain.
     //
     void stopRender(Handle &handle, bool aborted = false);
 
+    //
+    // Stops the stream and notifies that audio has stopped. Must be called
+    // from the Renderer's thread.
+    //
+    void finishStop(bool aborted);
+
     // class members ---------------------------------------------------------
 
-    QThread mTimerThread;
-    FastTimer *mTimer;      // thread-safe: yes
+    FastTimer mTimer;       // thread-safe: no (only the GUI thread and the callback may stop)
+    QTimer mSignalTimer;    // GUI thread, polls for signals to emit
 
     AudioStream mStream;    // thread-safe: no
-    Guarded<VisualizerBuffer> mVisBuffer;
-
-    ChannelOutput::Flags mOutputFlags;
+    VisualizerBuffer mVisBuffer; // written by the holder of the context lock, read by the GUI
+
+    // render state, written by the holder of the context lock. The GUI
+    // checks it without locking to determine whether commands are queued
+    // or applied immediately.
+    std::atomic<State> mState;
+
+    // published state for queries from the GUI thread
+    // step mode requested by the GUI, written by the GUI thread so that
+    // consecutive actions see their own changes before the render applies them
+    std::atomic_bool mStepping;
+    // last engine frame renderered, written by the render thread
+    Seqlock<trackerboy::Frame> mCurrentFrame;
+    // buffer diagnostics, written by the holder of the context lock, so
+    // there is only one writer at a time
+    Seqlock<BufferStats> mBufferStats;
+
+    // diagnostics for engine steps deferred while the module was locked
+    std::atomic_uint mDeferredFrames;
+    std::atomic_uint mDroppedFrames;
+
+    // GUI -> render thread commands
+    Ringbuffer<Command> mCommands;
+    // a command taken from the queue that could not be applied yet, since
+    // the module was locked. Accessed by the holder of the context lock.
+    Command mDeferredCommand;
+    bool mCommandDeferred;
+
+    // render thread -> GUI engine frames, tagged with their position
+    Ringbuffer<PositionEvent> mPositions;
+    // last engine frame heard, only accessed by the GUI thread
+    trackerboy::Frame mHeardFrame;
+
+    // render thread -> GUI period timings
+    Ringbuffer<RenderProfile::Period> mTimings;
+    // history of the timings, only accessed by the GUI thread
+    RenderProfile mProfile;
+
+    // signals for the GUI thread to emit, set by the render thread
+    std::atomic_uint mPendingSignals;
+    // last value of isPlayingChanged emitted, only accessed by the GUI thread
+    bool mLastPlaying;
 
     Clock::time_point mRenderStartTime;
 
+    int mLatencySaved;
+
+    // set by beginOfflineRender, there is no stream to render to
+    bool mOffline;
+
     //
     // All variables accessible from multiple threads are stored in the RenderContext
     // struct, access to them is guarded by a mutex.
@@ -1,81 +1,45 @@
-
 #pragma once
 
-#include "miniaudio.h"
-
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
 
 //
-// Wrapper for a miniaudio ringbuffer, ma_rb.
+// Lock-free, single-producer single-consumer ringbuffer.
+//
+// One thread writes to the buffer using a Writer while another thread reads
+// from it using a Reader. Neither side ever blocks or takes a lock, making the
+// buffer suitable for transferring audio between the render thread and the
+// device callback.
+//
+// All counts and indices are in frames, a frame being `channels` elements of
+// T. The read and write indices are free-running counters and are masked
+// with the capacity of the storage when accessed. The storage is rounded up
+// to the next power of two so that this masking can be done instead of a
+// modulo, the usable size of the buffer is still the size given to init().
+//
+// The read index and the write index are kept on separate cache lines, each
+// alongside a cached copy of the other index owned by the same side. This
+// way the producer and consumer only touch each other's cache line when the
+// cached copy says there is not enough room (or data).
 //
-class RingbufferBase {
-
-public:
-
-    ~RingbufferBase();
-    
-    void uninit();
-
-    void reset();
-
-protected:
-    RingbufferBase();
-
-    void init(size_t buffersize, void* buffer = nullptr);
-
-
-    // convenience "high level" read/write methods
-
-    size_t write(void const *buffer, size_t sizeInBytes);
-
-    size_t read(void *buffer, size_t sizeInBytes);
-
-    size_t fullRead(void *buffer, size_t sizeInBytes);
-
-    size_t fullWrite(void const *buffer, size_t sizeInBytes);
-
-    // "low level" read/write access
-    void* acquireRead(size_t &outSize);
-
-    void commitRead(size_t size);
-
-    void* acquireWrite(size_t &outSize);
-
-    void commitWrite(size_t size);
-
-    size_t availableRead();
-
-    size_t availableWrite();
-
-    void seekRead(size_t bytes);
-
-    void seekWrite(size_t bytes);
-
-    size_t size() const;
-
-private:
-
-    bool mInitialized;
-    ma_rb mRingbuffer;
-
-    size_t mSize;
-
-};
-
-// thin template idiom
-
 template <typename T, size_t channels = 1>
-class Ringbuffer : public RingbufferBase {
+class Ringbuffer {
     static_assert(channels > 0, "channels cannot be 0");
-    static constexpr auto SIZE_UNIT = sizeof(T) * channels;
+    static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+
+    static constexpr size_t CACHE_LINE = 64;
 
 public:
 
-    // read interface for the ringbuffer
+    // read interface for the ringbuffer, only one thread may read at a time
     class Reader {
 
         Ringbuffer<T, channels> &mRb;
-    
+
     public:
 
         Reader(Ringbuffer<T, channels> &rb) :
@@ -83,31 +47,46 @@ public:
         {
         }
 
+        //
+        // Reads up to count frames into the given buffer, handling the case
+        // where the data wraps around the end of the storage. The number of
+        // frames read is returned.
+        //
         size_t read(T *data, size_t count) {
-            return mRb.read(data, count * SIZE_UNIT) / SIZE_UNIT;
-        }
-
-        size_t fullRead(T *data, size_t count) {
-            return mRb.fullRead(data, count * SIZE_UNIT) / SIZE_UNIT;
+            auto const index = mRb.mReadIndex.load(std::memory_order_relaxed);
+            count = std::min(count, available(index, count));
+            if (count) {
+                mRb.copyOut(index, data, count);
+                mRb.mReadIndex.store(index + count, std::memory_order_release);
+            }
+            return count;
         }
 
+        //
+        // Gets a pointer to the next contiguous region of frames available
+        // for reading. outCount is the requested amount, and is set to the
+        // actual amount that can be read from the returned pointer.
+        //
         T* acquireRead(size_t &outCount) {
-            size_t size = outCount * SIZE_UNIT;
-            auto result = static_cast<T*>(mRb.acquireRead(size));
-            outCount = size / SIZE_UNIT;
-            return result;
+            auto const index = mRb.mReadIndex.load(std::memory_order_relaxed);
+            outCount = std::min({ outCount, available(index, outCount), mRb.contiguous(index) });
+            return mRb.at(index);
         }
 
         void commitRead(size_t count) {
-            mRb.commitRead(count * SIZE_UNIT);
+            auto const index = mRb.mReadIndex.load(std::memory_order_relaxed);
+            mRb.mReadIndex.store(index + count, std::memory_order_release);
         }
 
-        size_t availableRead() {
-            return mRb.availableRead() / SIZE_UNIT;
+        size_t availableRead() const {
+            return mRb.mWriteIndex.load(std::memory_order_acquire) -
+                   mRb.mReadIndex.load(std::memory_order_relaxed);
         }
 
         void seekRead(size_t count) {
-            mRb.seekRead(count * SIZE_UNIT);
+            auto const index = mRb.mReadIndex.load(std::memory_order_relaxed);
+            count = std::min(count, available(index, count));
+            mRb.mReadIndex.store(index + count, std::memory_order_release);
         }
 
         //
@@ -117,12 +96,25 @@ public:
             seekRead(availableRead());
         }
 
+    private:
+
+        // frames available for reading, the cached write index is only
+        // refreshed if it cannot satisfy the request
+        size_t available(size_t readIndex, size_t wanted) {
+            auto avail = mRb.mWriteCache - readIndex;
+            if (avail < wanted) {
+                mRb.mWriteCache = mRb.mWriteIndex.load(std::memory_order_acquire);
+                avail = mRb.mWriteCache - readIndex;
+            }
+            return avail;
+        }
+
     };
 
-    // write interface for the ringbuffer
+    // write interface for the ringbuffer, only one thread may write at a time
     class Writer {
-        Ringbuffer<T, channels> &mRb;
 
+        Ringbuffer<T, channels> &mRb;
 
     public:
         Writer(Ringbuffer<T, channels> &rb) :
@@ -130,40 +122,79 @@ public:
         {
         }
 
+        //
+        // Writes up to count frames from the given buffer, handling the case
+        // where the data wraps around the end of the storage. The number of
+        // frames written is returned.
+        //
         size_t write(T const *data, size_t count) {
-            return mRb.write(data, count * SIZE_UNIT) / SIZE_UNIT;
-        }
-
-        size_t fullWrite(T const *data, size_t count) {
-            return mRb.fullWrite(data, count * SIZE_UNIT) / SIZE_UNIT;
+            auto const index = mRb.mWriteIndex.load(std::memory_order_relaxed);
+            count = std::min(count, available(index, count));
+            if (count) {
+                mRb.copyIn(index, data, count);
+                mRb.mWriteIndex.store(index + count, std::memory_order_release);
+            }
+            return count;
         }
 
+        //
+        // Gets a pointer to the next contiguous region of frames available
+        // for writing. outCount is the requested amount, and is set to the
+        // actual amount that can be written to the returned pointer.
+        //
         T* acquireWrite(size_t &outCount) {
-            size_t size = outCount * SIZE_UNIT;
-            auto result = static_cast<T*>(mRb.acquireWrite(size));
-            outCount = size / SIZE_UNIT;
-            return result;
+            auto const index = mRb.mWriteIndex.load(std::memory_order_relaxed);
+            outCount = std::min({ outCount, available(index, outCount), mRb.contiguous(index) });
+            return mRb.at(index);
         }
 
         void commitWrite(size_t count) {
-            mRb.commitWrite(count * SIZE_UNIT);
+            auto const index = mRb.mWriteIndex.load(std::memory_order_relaxed);
+            mRb.mWriteIndex.store(index + count, std::memory_order_release);
         }
 
-        size_t availableWrite() {
-            return mRb.availableWrite() / SIZE_UNIT;
+        size_t availableWrite() const {
+            return mRb.free(
+                mRb.mWriteIndex.load(std::memory_order_relaxed) -
+                mRb.mReadIndex.load(std::memory_order_acquire)
+            );
         }
 
+        //
+        // Changes the usable size of the buffer, up to its capacity. If the
+        // buffer currently holds more than the new size, nothing can be
+        // written until the reader has caught up. Only the writer uses the
+        // size, so it can be changed at any time by the writer.
+        //
+        void setSize(size_t count) {
+            mRb.mSize = std::min(count, mRb.capacity());
+        }
 
-        void seekWrite(size_t count) {
-            mRb.seekWrite(count * SIZE_UNIT);
+    private:
+
+        // frames available for writing, the cached read index is only
+        // refreshed if it cannot satisfy the request
+        size_t available(size_t writeIndex, size_t wanted) {
+            auto avail = mRb.free(writeIndex - mRb.mReadCache);
+            if (avail < wanted) {
+                mRb.mReadCache = mRb.mReadIndex.load(std::memory_order_acquire);
+                avail = mRb.free(writeIndex - mRb.mReadCache);
+            }
+            return avail;
         }
 
     };
 
 
     Ringbuffer() :
-        RingbufferBase() 
-    { 
+        mData(),
+        mSize(0),
+        mMask(0),
+        mReadIndex(0),
+        mWriteCache(0),
+        mWriteIndex(0),
+        mReadCache(0)
+    {
     }
 
     Reader reader() {
@@ -174,17 +205,95 @@ public:
         return { *this };
     }
 
-    void init(size_t count, T* buffer = nullptr) {
-        RingbufferBase::init(count * SIZE_UNIT, buffer);
+    //
+    // Allocates storage for count frames. The buffer is emptied. Must not be
+    // called while either side is accessing the buffer.
+    //
+    void init(size_t count) {
+        size_t storage = 1;
+        while (storage < count) {
+            storage <<= 1;
+        }
+        mData = std::make_unique<T[]>(storage * channels);
+        mSize = count;
+        mMask = storage - 1;
+        reset();
+    }
+
+    //
+    // Empties the buffer. Must not be called while either side is accessing
+    // the buffer.
+    //
+    void reset() {
+        mReadIndex.store(0, std::memory_order_relaxed);
+        mWriteCache = 0;
+        mWriteIndex.store(0, std::memory_order_relaxed);
+        mReadCache = 0;
     }
 
+    //
+    // Size of the buffer, in frames.
+    //
     size_t size() const {
-        return RingbufferBase::size() / SIZE_UNIT;
+        return mSize;
     }
 
+    //
+    // Maximum size of the buffer, in frames. This is the size of the
+    // allocated storage, which may be larger than the size given to init().
+    //
+    size_t capacity() const {
+        return mMask + 1;
+    }
+
+private:
+
+    // number of frames that can be written when used frames are in the buffer
+    size_t free(size_t used) const {
+        return used < mSize ? mSize - used : 0;
+    }
+
+    T* at(size_t index) {
+        return mData.get() + ((index & mMask) * channels);
+    }
+
+    // number of frames from the given index to the end of the storage
+    size_t contiguous(size_t index) const {
+        return capacity() - (index & mMask);
+    }
+
+    void copyIn(size_t index, T const *data, size_t count) {
+        auto const first = std::min(count, contiguous(index));
+        std::copy_n(data, first * channels, at(index));
+        std::copy_n(data + (first * channels), (count - first) * channels, mData.get());
+    }
+
+    void copyOut(size_t index, T *data, size_t count) {
+        auto const first = std::min(count, contiguous(index));
+        std::copy_n(at(index), first * channels, data);
+        std::copy_n(mData.get(), (count - first) * channels, data + (first * channels));
+    }
+
+    // non-copyable, non-movable
+    Ringbuffer(Ringbuffer const&) = delete;
+    Ringbuffer& operator=(Ringbuffer const&) = delete;
+
+    std::unique_ptr<T[]> mData;
+    size_t mSize;
+    size_t mMask;
+
+    // consumer's cache line
+    alignas(CACHE_LINE) std::atomic_size_t mReadIndex;
+    size_t mWriteCache;
+
+    // producer's cache line
+    alignas(CACHE_LINE) std::atomic_size_t mWriteIndex;
+    size_t mReadCache;
+
 };
 
 //
 // ringbuffer typedef for audio used in the application
 //
 using AudioRingbuffer = Ringbuffer<float, 2>;
+using S16Ringbuffer = Ringbuffer<int16_t, 2>;
@@ -0,0 +1,245 @@
+
+#include "audio/SampleFormat.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SAMPLEFORMAT_SSE2
+#include <emmintrin.h>
+#endif
+
+#define TU SampleFormatTU
+namespace TU {
+
+constexpr float S16_SCALE = 32767.0f;
+constexpr float S24_SCALE = 8388607.0f;
+
+// number of set bits in a 4-bit mask, for counting clipped lanes
+constexpr size_t MASK_BITS[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+//
+// Converts a single sample, rounding to nearest like the SSE2 conversion
+//
+int16_t toS16(float sample) {
+    return (int16_t)std::lrint(std::clamp(sample, -1.0f, 1.0f) * S16_SCALE);
+}
+
+//
+// Advances a dither lane (xorshift32) and returns its new value
+//
+uint32_t nextState(uint32_t &state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+//
+// Maps random bits to a float in [0, 1) by using them as the mantissa
+//
+float toUnit(uint32_t bits) {
+    bits = (bits >> 9) | 0x3F800000u;
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f - 1.0f;
+}
+
+//
+// Scales, dithers and rounds a single sample, counting it if it clips. Lane
+// is the dither generator to use, so that the scalar and SSE2 conversions
+// produce the same noise.
+//
+int32_t quantize(float sample, float scale, Dither *dither, size_t lane, size_t &clipped) {
+    if (std::abs(sample) > 1.0f) {
+        ++clipped;
+    }
+    sample *= scale;
+    if (dither) {
+        auto &state = dither->state[lane & 3];
+        auto const u1 = toUnit(nextState(state));
+        sample += u1 - toUnit(nextState(state));
+    }
+    return (int32_t)std::lrint(std::clamp(sample, -scale, scale));
+}
+
+#ifdef SAMPLEFORMAT_SSE2
+
+//
+// SSE2 version of quantize, four samples at a time. The dither state is kept
+// in a register and stored back when finished.
+//
+class Quantizer {
+
+public:
+    Quantizer(float scale, Dither *dither) :
+        mScale(_mm_set1_ps(scale)),
+        mMin(_mm_set1_ps(-scale)),
+        mOne(_mm_set1_ps(1.0f)),
+        mAbsMask(_mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF))),
+        mDither(dither),
+        mState(dither ? _mm_loadu_si128(reinterpret_cast<__m128i const*>(dither->state)) : _mm_setzero_si128()),
+        mClipped(0)
+    {
+    }
+
+    __m128i operator()(float const *in) {
+        auto x = _mm_loadu_ps(in);
+        auto const clips = _mm_cmpgt_ps(_mm_and_ps(x, mAbsMask), mOne);
+        mClipped += MASK_BITS[_mm_movemask_ps(clips)];
+        x = _mm_mul_ps(x, mScale);
+        if (mDither) {
+            auto const u1 = nextUnit();
+            x = _mm_add_ps(x, _mm_sub_ps(u1, nextUnit()));
+        }
+        return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(x, mMin), mScale));
+    }
+
+    //
+    // Stores the dither state and returns the number of clipped samples
+    //
+    size_t finish() {
+        if (mDither) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(mDither->state), mState);
+        }
+        return mClipped;
+    }
+
+private:
+
+    __m128 nextUnit() {
+        mState = _mm_xor_si128(mState, _mm_slli_epi32(mState, 13));
+        mState = _mm_xor_si128(mState, _mm_srli_epi32(mState, 17));
+        mState = _mm_xor_si128(mState, _mm_slli_epi32(mState, 5));
+        auto const bits = _mm_or_si128(_mm_srli_epi32(mState, 9), _mm_set1_epi32(0x3F800000));
+        return _mm_sub_ps(_mm_castsi128_ps(bits), mOne);
+    }
+
+    __m128 const mScale;
+    __m128 const mMin;
+    __m128 const mOne;
+    __m128 const mAbsMask;
+    Dither *mDither;
+    __m128i mState;
+    size_t mClipped;
+
+};
+
+#endif
+
+//
+// Stores the low 24 bits of a sample, little endian
+//
+void storeS24(uint8_t *out, int32_t sample) {
+    out[0] = (uint8_t)sample;
+    out[1] = (uint8_t)(sample >> 8);
+    out[2] = (uint8_t)(sample >> 16);
+}
+
+}
+
+size_t sampleSize(SampleFormat format) noexcept {
+    return format == SampleFormat::s16 ? sizeof(int16_t) : sizeof(float);
+}
+
+void convertToS16(float const *in, int16_t *out, size_t samples) noexcept {
+
+#ifdef SAMPLEFORMAT_SSE2
+    // 8 samples at a time. Clamping is needed before the conversion, as
+    // out of range values convert to INT_MIN, packing saturates the rest
+    auto const min = _mm_set1_ps(-1.0f);
+    auto const max = _mm_set1_ps(1.0f);
+    auto const scale = _mm_set1_ps(TU::S16_SCALE);
+    for (; samples >= 8; samples -= 8) {
+        auto lo = _mm_loadu_ps(in);
+        auto hi = _mm_loadu_ps(in + 4);
+        lo = _mm_mul_ps(_mm_min_ps(_mm_max_ps(lo, min), max), scale);
+        hi = _mm_mul_ps(_mm_min_ps(_mm_max_ps(hi, min), max), scale);
+        auto const packed = _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), packed);
+        in += 8;
+        out += 8;
+    }
+#endif
+
+    // the remaining samples, or all of them without SSE2
+    while (samples--) {
+        *out++ = TU::toS16(*in++);
+    }
+}
+
+Dither::Dither(uint32_t seed) noexcept :
+    state()
+{
+    // xorshift must not be seeded with zero
+    for (auto &lane : state) {
+        seed = seed * 747796405u + 2891336453u;
+        lane = seed ? seed : 1;
+    }
+}
+
+size_t convertToPcm16(float const *in, int16_t *out, size_t samples, Dither *dither) noexcept {
+    size_t clipped = 0;
+    size_t i = 0;
+
+#ifdef SAMPLEFORMAT_SSE2
+    // samples are clamped to the 16-bit range, so packing doesn't saturate
+    TU::Quantizer quantizer(TU::S16_SCALE, dither);
+    for (; i + 8 <= samples; i += 8) {
+        auto const lo = quantizer(in + i);
+        auto const hi = quantizer(in + i + 4);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(lo, hi));
+    }
+    clipped = quantizer.finish();
+#endif
+
+    for (; i < samples; ++i) {
+        out[i] = (int16_t)TU::quantize(in[i], TU::S16_SCALE, dither, i, clipped);
+    }
+    return clipped;
+}
+
+size_t convertToPcm24(float const *in, uint8_t *out, size_t samples, Dither *dither) noexcept {
+    size_t clipped = 0;
+    size_t i = 0;
+
+#ifdef SAMPLEFORMAT_SSE2
+    // there's no 3-byte store, the quantized samples are packed one by one
+    TU::Quantizer quantizer(TU::S24_SCALE, dither);
+    for (; i + 4 <= samples; i += 4) {
+        alignas(16) int32_t quantized[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(quantized), quantizer(in + i));
+        for (size_t j = 0; j < 4; ++j) {
+            TU::storeS24(out + (i + j) * 3, quantized[j]);
+        }
+    }
+    clipped = quantizer.finish();
+#endif
+
+    for (; i < samples; ++i) {
+        TU::storeS24(out + i * 3, TU::quantize(in[i], TU::S24_SCALE, dither, i, clipped));
+    }
+    return clipped;
+}
+
+size_t convertToInt(float const *in, int32_t *out, size_t samples, int bits, Dither *dither) noexcept {
+    auto const scale = bits == 24 ? TU::S24_SCALE : TU::S16_SCALE;
+    size_t clipped = 0;
+    size_t i = 0;
+
+#ifdef SAMPLEFORMAT_SSE2
+    TU::Quantizer quantizer(scale, dither);
+    for (; i + 4 <= samples; i += 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), quantizer(in + i));
+    }
+    clipped = quantizer.finish();
+#endif
+
+    for (; i < samples; ++i) {
+        out[i] = TU::quantize(in[i], scale, dither, i, clipped);
+    }
+    return clipped;
+}
+
+#undef TU
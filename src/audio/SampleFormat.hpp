@@ -0,0 +1,52 @@
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+//
+// Sample formats that audio can be written in for an output device. Audio is
+// always synthesized as 32-bit float, s16 output is converted from it.
+//
+enum class SampleFormat {
+    f32,    // 32-bit float, -1.0 to 1.0
+    s16     // signed 16-bit integer
+};
+
+//
+// Size, in bytes, of a single sample in the given format.
+//
+size_t sampleSize(SampleFormat format) noexcept;
+
+//
+// Converts the given number of float samples to signed 16-bit integers.
+// Samples outside of -1.0 to 1.0 are clamped. Uses SSE2 when available.
+//
+void convertToS16(float const *in, int16_t *out, size_t samples) noexcept;
+
+//
+// State for TPDF dither: triangular noise of +/- 1 LSB that is added to
+// samples before they are quantized to an integer format. The noise sequence
+// continues across calls using the same state.
+//
+struct Dither {
+    explicit Dither(uint32_t seed = 1) noexcept;
+
+    // one xorshift generator per SIMD lane
+    uint32_t state[4];
+};
+
+//
+// Converts float samples to integer PCM for export. Unlike convertToS16,
+// TPDF dither is added when a Dither is given, and the number of clipped
+// samples (samples outside of -1.0 to 1.0) is returned. 24-bit samples are
+// packed into 3 bytes, little endian. Uses SSE2 when available.
+//
+size_t convertToPcm16(float const *in, int16_t *out, size_t samples, Dither *dither) noexcept;
+size_t convertToPcm24(float const *in, uint8_t *out, size_t samples, Dither *dither) noexcept;
+
+//
+// Same as the above, but the samples are left unpacked as 32-bit integers,
+// for encoders. Bits is the bit depth to quantize to, 16 or 24.
+//
+size_t convertToInt(float const *in, int32_t *out, size_t samples, int bits, Dither *dither) noexcept;
@@ -0,0 +1,41 @@
+
+#pragma once
+
+#include <cstddef>
+
+//
+// A file that rendered audio is written to as interleaved float samples.
+// Implemented by Wav and Flac so that exports can write either.
+//
+class SampleWriter {
+
+public:
+
+    virtual ~SampleWriter() = default;
+
+    //
+    // Determines if no error has occurred so far.
+    //
+    virtual bool good() const = 0;
+
+    //
+    // Writes the given number of samples (frames) from the buffer. The buffer
+    // should be at least the size of nsamples * channels.
+    //
+    virtual void write(float const buf[], std::size_t nsamples) = 0;
+
+    //
+    // Number of samples written so far that were clipped when converting to
+    // an integer format.
+    //
+    virtual std::size_t clipCount() const = 0;
+
+    //
+    // Writes any remaining data, completes the file and closes it. Returns
+    // false if this or any earlier write failed, so the caller knows if the
+    // file is complete. Nothing may be written afterwards. Called by the
+    // destructor if not called before, with the result lost.
+    //
+    virtual bool finish() = 0;
+
+};
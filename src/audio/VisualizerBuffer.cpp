@@ -5,18 +5,65 @@
 
 #include <QtGlobal>
 
+VisualizerBuffer::Snapshot::Snapshot(float const *data, size_t size) :
+    mData(data),
+    mSize(size)
+{
+}
+
+size_t VisualizerBuffer::Snapshot::size() const {
+    return mSize;
+}
+
+void VisualizerBuffer::Snapshot::read(size_t index, float &outLeft, float &outRight) const {
+    Q_ASSERT(index < mSize);
+
+    auto buf = mData + (index * 2);
+    outLeft = *buf++;
+    outRight = *buf;
+}
+
+void VisualizerBuffer::Snapshot::averageSample(float index, float bin, float &outLeft, float &outRight) const {
+
+    // determine the number of samples to average, with a minimum of 1 sample
+    int samples = std::max(1, (int)((index + bin) - (int)index));
+
+    // the snapshot is in order, so the bin stops at the newest sample
+    auto const start = std::min((size_t)index, mSize - 1);
+    samples = (int)std::min((size_t)samples, mSize - start);
+    auto buf = mData + (start * 2);
+
+    float sumLeft = 0.0f;
+    float sumRight = 0.0f;
+    for (int i = 0; i < samples; ++i) {
+        sumLeft += *buf++;
+        sumRight += *buf++;
+    }
+
+    outLeft = (float)sumLeft / samples;
+    outRight = (float)sumRight / samples;
+
+}
+
+
 VisualizerBuffer::VisualizerBuffer() :
     mBufferData(),
     mBufferSize(0),
     mIndex(0),
-    mIgnoreCounter(0)
+    mIgnoreCounter(0),
+    mBack(0),
+    mMiddle(1),
+    mFront(2)
 {
 }
 
 void VisualizerBuffer::clear() {
-    std::fill_n(mBufferData.get(), mBufferSize * 2, 0.0f);
+    std::fill_n(mBufferData.get(), mBufferSize * 2 * (1 + SNAPSHOTS), 0.0f);
     mIndex = 0;
     mIgnoreCounter = 0;
+    mBack = 0;
+    mMiddle = 1;
+    mFront = 2;
 }
 
 void VisualizerBuffer::resize(size_t size) {
@@ -24,7 +71,7 @@ void VisualizerBuffer::resize(size_t size) {
     if (mBufferSize != size) {
         mBufferSize = size;
 
-        auto samples = size * 2;
+        auto samples = size * 2 * (1 + SNAPSHOTS);
         mBufferData = std::make_unique<float[]>(samples);
 
         // resize the buffer clears it
@@ -36,42 +83,6 @@ size_t VisualizerBuffer::size() const {
     return mBufferSize;
 }
 
-
-void VisualizerBuffer::read(size_t index, float &outLeft, float &outRight) {
-    Q_ASSERT(index < mBufferSize);
-
-    index = (index + mIndex) % mBufferSize;
-
-    auto buf = mBufferData.get() + (index * 2);
-    outLeft = *buf++;
-    outRight = *buf;
-
-}
-
-void VisualizerBuffer::averageSample(float index, float bin, float &outLeft, float &outRight) {
-    
-    // determine the number of samples to average, with a minimum of 1 sample
-    int samples = std::max(1, (int)((index + bin) - (int)index));
-
-    size_t bufIndex = (mIndex + (size_t)index) % mBufferSize;
-    auto buf = mBufferData.get() + (bufIndex * 2);
-
-    float sumLeft = 0.0f;
-    float sumRight = 0.0f;
-    for (int i = 0; i < samples; ++i) {
-        sumLeft += *buf++;
-        sumRight += *buf++;
-        if (++bufIndex == mBufferSize) {
-            bufIndex = 0;
-            buf = mBufferData.get();
-        }
-    }
-    
-    outLeft = (float)sumLeft / samples;
-    outRight = (float)sumRight / samples;
-
-}
-
 void VisualizerBuffer::beginWrite(size_t amount) {
 
     if (amount > mBufferSize) {
@@ -121,3 +132,34 @@ void VisualizerBuffer::write(float buf[], size_t amount) {
     }
 
 }
+
+void VisualizerBuffer::publish() {
+    if (mBufferSize == 0) {
+        return;
+    }
+
+    // unrotate into the back snapshot, oldest sample first
+    auto const ring = mBufferData.get();
+    auto const oldest = mIndex * 2;
+    auto const samples = mBufferSize * 2;
+    auto dest = snapshotData(mBack);
+    dest = std::copy(ring + oldest, ring + samples, dest);
+    std::copy(ring, ring + oldest, dest);
+
+    // the back snapshot becomes the middle one, the old middle one is ours
+    auto const prev = mMiddle.exchange((uint8_t)(mBack | FRESH), std::memory_order_acq_rel);
+    mBack = prev & INDEX_MASK;
+}
+
+VisualizerBuffer::Snapshot VisualizerBuffer::snapshot() {
+    if (mMiddle.load(std::memory_order_relaxed) & FRESH) {
+        // take the newly published snapshot, giving back our old one
+        auto const prev = mMiddle.exchange((uint8_t)mFront, std::memory_order_acq_rel);
+        mFront = prev & INDEX_MASK;
+    }
+    return { snapshotData(mFront), mBufferSize };
+}
+
+float* VisualizerBuffer::snapshotData(int index) {
+    return mBufferData.get() + (mBufferSize * 2 * (1 + index));
+}
@@ -1,35 +1,79 @@
 #pragma once
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 
 
 //
 // Audio buffer for visualizers.
-// 
-// 
-// The buffer is a rotating sample buffer, with newest data at the end of the buffer
-// The index determines the starting and ending position of the buffer
-// 
+//
+// The renderer (producer) writes samples to a rotating sample buffer, with
+// newest data at the end of the buffer. The index determines the starting
+// and ending position of the buffer
+//
 // 0 0 0 0 0
 // ^
-// 
+//
 // write A B C to the buffer (0 is now the oldest, C is the newest)
-// 
+//
 // A B C 0 0
 //       ^
-// 
+//
 // write D E F to the buffer (B is now the oldest, F is the newest)
-// 
+//
 // F B C D E
 //   ^
-// 
+//
 // When the index gets to the end of the buffer, it wraps (rotates) to the start
 // The index points to the oldest sample in the buffer, the sample before it is the newest.
 //
+// Visualizers (consumer) never read the rotating buffer directly. When the
+// producer has finished a block of writes it calls publish(), which copies
+// the buffer, oldest sample first, into one of three snapshots. The
+// snapshots are exchanged as a triple buffer: the producer owns the back
+// snapshot, the consumer owns the front snapshot and the middle one is
+// swapped atomically with either side. Neither side ever waits for the other,
+// so a slow repaint cannot delay the render and the consumer always gets the
+// latest complete snapshot.
+//
+// Only one thread may write/publish and only one thread may take snapshots.
+// clear() and resize() must be called from the consumer's thread while the
+// producer is not writing.
+//
 class VisualizerBuffer {
 
 public:
+
+    //
+    // A read-only view of a published snapshot, with the oldest sample at
+    // index 0. Valid until the next call to snapshot().
+    //
+    class Snapshot {
+
+    public:
+
+        size_t size() const;
+
+        void read(size_t index, float &outLeft, float &outRight) const;
+
+        //
+        // Computes the average left and right samples for the given index and bin
+        // size. Bin size refers to the ratio of samples per pixel. ie, a bin size
+        // of 2.5 means that 2.5 samples are represented by a single pixel.
+        //
+        void averageSample(float index, float bin, float &outLeft, float &outRight) const;
+
+    private:
+        friend class VisualizerBuffer;
+
+        Snapshot(float const *data, size_t size);
+
+        float const *mData;
+        size_t mSize;
+    };
+
     VisualizerBuffer();
     ~VisualizerBuffer() = default;
 
@@ -39,15 +83,6 @@ public:
 
     size_t size() const;
 
-    void read(size_t index, float &outLeft, float &outRight);
-
-    //
-    // Computes the average left and right samples for the given index and bin
-    // size. Bin size refers to the ratio of samples per pixel. ie, a bin size
-    // of 2.5 means that 2.5 samples are represented by a single pixel.
-    //
-    void averageSample(float index, float bin, float &outLeft, float &outRight);
-
     //
     // Begin a write operation. If amount is greater than this buffer's
     // capacity, then some of the data written when calling write will
@@ -59,9 +94,30 @@ public:
 
     void write(float buf[], size_t amount);
 
+    //
+    // Makes everything written so far visible to the consumer.
+    //
+    void publish();
+
+    //
+    // Gets the most recently published snapshot. Never blocks.
+    //
+    Snapshot snapshot();
+
 
 private:
 
+    VisualizerBuffer(VisualizerBuffer const&) = delete;
+    VisualizerBuffer& operator=(VisualizerBuffer const&) = delete;
+
+    static constexpr int SNAPSHOTS = 3;
+    // set in mMiddle when the middle snapshot was published but not yet taken
+    static constexpr uint8_t FRESH = 0x4;
+    static constexpr uint8_t INDEX_MASK = 0x3;
+
+    float* snapshotData(int index);
+
+    // rotating buffer followed by the 3 snapshots
     std::unique_ptr<float[]> mBufferData;
     size_t mBufferSize;
 
@@ -69,4 +125,11 @@ private:
 
     size_t mIgnoreCounter;
 
+    // snapshot owned by the producer
+    int mBack;
+    // snapshot shared by both, index | FRESH
+    std::atomic_uint8_t mMiddle;
+    // snapshot owned by the consumer
+    int mFront;
+
 };
@@ -1,9 +1,19 @@
 
 #include "audio/Wav.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <cstring>
+#include <new>
 
+#if defined(__unix__) || defined(__APPLE__)
+#define WAV_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace WavPrivate {
 
@@ -15,7 +25,7 @@ namespace WavPrivate {
 struct WavHeader {
 
     // [B] indicates that this field is set in the Wav constructor
-    // [F] indicates that this field is set in the Wav destructor
+    // [F] indicates that this field is set in Wav::finish
     // = indicates the field's initial value
 
     // RIFF chunk
@@ -25,12 +35,12 @@ struct WavHeader {
     // fmt subchunk
     char fmtId[4];              // = "fmt "
     uint32_t fmtChunkSize;      // = 18
-    uint16_t fmtTag;            // = 0x3 for IEEE_FLOAT
+    uint16_t fmtTag;            // [B] 0x3 for IEEE_FLOAT, 0x1 for PCM
     uint16_t fmtChannels;       // [B]
     uint32_t fmtSampleRate;     // [B]
-    uint32_t fmtAvgBytesPerSec; // [B] = 4 * fmtSampleRate * fmtChannels
-    uint16_t fmtBlockAlign;     // [B] = 4 * fmtChannels
-    uint16_t fmtBitsPerSample;  // = 32
+    uint32_t fmtAvgBytesPerSec; // [B] = fmtBlockAlign * fmtSampleRate
+    uint16_t fmtBlockAlign;     // [B] = sample size * fmtChannels
+    uint16_t fmtBitsPerSample;  // [B] 32, 24 or 16
     uint16_t fmtCbSize;         // = 0
     // fact subchunk
     char factId[4];             // = "fact"
@@ -67,76 +77,365 @@ struct WavHeader {
 
 #pragma pack(pop)
 
+// alignment of the block, so that writes are page aligned in memory
+constexpr std::size_t BLOCK_ALIGN = 4096;
+
+//
+// Allocates disk space for the first size bytes of the file, extending it if
+// needed. Unlike ftruncate, writes to the space cannot fail for lack of it.
+//
+bool reserve(int fd, std::size_t size) {
+    #ifdef __APPLE__
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        return false;
+    }
+    if ((off_t)size > st.st_size) {
+        fstore_t store{ F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t)size - st.st_size, 0 };
+        if (::fcntl(fd, F_PREALLOCATE, &store) == -1) {
+            return false;
+        }
+    }
+    return ::ftruncate(fd, (off_t)size) == 0;
+    #else
+    return ::posix_fallocate(fd, 0, (off_t)size) == 0;
+    #endif
+}
+
+// mappings grow by at least this many bytes
+constexpr std::size_t MAP_GROWTH = 16 << 20;
+
+// samples converted at a time for integer formats
+constexpr std::size_t SCRATCH_SAMPLES = 4096;
+
+//
+// Size, in bytes, of a single sample in the given format
+//
+std::size_t sampleSize(Wav::Format format) {
+    switch (format) {
+        case Wav::Format::pcm16:
+            return 2;
+        case Wav::Format::pcm24:
+            return 3;
+        default:
+            return 4;
+    }
+}
+
+//
+// Creates the header for a file with the given number of samples written.
+//
+WavHeader makeHeader(Wav::Format format, int channels, int samplerate, std::size_t samples) {
+    WavHeader header;
+    auto const size = sampleSize(format);
+    if (format != Wav::Format::float32) {
+        header.fmtTag = 0x1;
+    }
+    header.fmtBitsPerSample = (uint16_t)(size * 8);
+    header.fmtChannels = (uint16_t)channels;
+    header.fmtSampleRate = (uint32_t)samplerate;
+    uint16_t bytesPerChannel = (uint16_t)(channels * size);
+    header.fmtAvgBytesPerSec = bytesPerChannel * samplerate;
+    header.fmtBlockAlign = bytesPerChannel;
+
+    uint32_t totalSamples = static_cast<uint32_t>(samples);
+    uint32_t dataChunkSize = totalSamples * bytesPerChannel;
+    header.factSampleCount = totalSamples;
+    header.dataChunkSize = dataChunkSize;
+
+    // chunk size totals
+    // 4: riff chunk
+    // 18 + 8: fmt chunk
+    // 4 + 8: fact chunk
+    // = 42
+    // 8 + dataChunkSize + (0 or 1)
+    // (also equal to the filesize - 8)
+    header.chunkSize = 50 + dataChunkSize + (dataChunkSize & 1);
+    return header;
 }
 
+}
 
 
-Wav::Wav(std::string const& filename, int channels, int samplerate) :
-    mStream(filename, std::ios::out | std::ios::binary),
+
+Wav::Wav(
+    std::string const& filename,
+    int channels,
+    int samplerate,
+    Format format,
+    Mode mode,
+    std::size_t reserveSamples
+) :
+    mFilename(filename),
+    mMode(mode),
+    mFormat(format),
+    mGood(true),
+    mFinished(false),
     mSampleCount(0),
     mChannels(channels),
-    mSamplingRate(samplerate)
+    mSamplingRate(samplerate),
+    mDithering(false),
+    mDither(),
+    mClipped(0),
+    mScratch(),
+    mStream(),
+    mBlock(nullptr),
+    mBlockUsed(0),
+    mFd(-1),
+    mMap(nullptr),
+    mMapSize(0),
+    mMapUsed(0)
 {
     assert(channels > 0);
     assert(samplerate > 0);
 
-    WavPrivate::WavHeader header;
-    header.fmtChannels = mChannels;
-    header.fmtSampleRate = mSamplingRate;
-    uint16_t bytesPerChannel = mChannels * 4;
-    header.fmtAvgBytesPerSec = bytesPerChannel * mSamplingRate;
-    header.fmtBlockAlign = bytesPerChannel;
+    // the header is rewritten when finished, this just reserves its space
+    auto const header = WavPrivate::makeHeader(mFormat, mChannels, mSamplingRate, 0);
 
+    if (mFormat != Format::float32) {
+        mScratch = std::make_unique<char[]>(WavPrivate::SCRATCH_SAMPLES * WavPrivate::sampleSize(mFormat));
+    }
 
-    mStream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    #ifdef WAV_MMAP
+    if (mMode == Mode::mapped) {
+        mFd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        auto const size = sizeof(header) + (reserveSamples * header.fmtBlockAlign);
+        if (mFd != -1 && map(std::max(size, WavPrivate::MAP_GROWTH))) {
+            writeMapped(reinterpret_cast<const char *>(&header), sizeof(header));
+            return;
+        }
+        // no space for the reservation or no mapping, the buffered stream
+        // will report a full disk as an error instead
+        unmap();
+        if (mFd != -1) {
+            ::close(mFd);
+            mFd = -1;
+        }
+    }
+    #else
+    (void)reserveSamples;
+    #endif
 
+    mMode = Mode::buffered;
+    mGood = openBuffered(0);
+    writeBuffered(reinterpret_cast<const char *>(&header), sizeof(header));
 }
 
 Wav::~Wav() {
-    uint32_t totalSamples = static_cast<uint32_t>(mSampleCount);
-    uint32_t dataChunkSize = totalSamples * mChannels * 4;
+    if (!mFinished) {
+        finish();
+    }
+    if (mBlock) {
+        ::operator delete(mBlock, std::align_val_t(WavPrivate::BLOCK_ALIGN));
+    }
+}
 
-    // chunk size totals
-    // 4: riff chunk
-    // 18 + 8: fmt chunk
-    // 4 + 8: fact chunk
-    // = 42
-    // 8 + dataChunkSize + (0 or 1)
-    uint32_t chunkSize = 50 + dataChunkSize;
+bool Wav::good() const {
+    return mGood;
+}
 
-    // do we need a pad byte?
-    if (dataChunkSize & 1) {
-        // yes, write a single 0 to the end of the data chunk
-        uint8_t zero = 0;
-        mStream.write(reinterpret_cast<const char *>(&zero), sizeof(zero));
-        ++chunkSize;
+Wav::Mode Wav::mode() const {
+    return mMode;
+}
+
+Wav::Format Wav::format() const {
+    return mFormat;
+}
+
+void Wav::setDither(bool dither) {
+    mDithering = dither;
+}
+
+std::size_t Wav::clipCount() const {
+    return mClipped;
+}
+
+void Wav::write(float const buf[], std::size_t nsamples) {
+    if (!mGood || mFinished) {
+        return;
     }
 
-    // overwrite the chunk size for the entire file (also equal to the filesize - 8)
-    mStream.seekp(offsetof(WavPrivate::WavHeader, chunkSize));
-    mStream.write(reinterpret_cast<const char *>(&chunkSize), sizeof(chunkSize));
+    if (mFormat == Format::float32) {
+        writeData(reinterpret_cast<const char*>(buf), mChannels * nsamples * sizeof(float));
+    } else {
+        // convert in chunks that fit in the scratch buffer
+        auto const dither = mDithering ? &mDither : nullptr;
+        auto const size = WavPrivate::sampleSize(mFormat);
+        auto remaining = mChannels * nsamples;
+        while (remaining && mGood) {
+            auto const count = std::min(remaining, WavPrivate::SCRATCH_SAMPLES);
+            if (mFormat == Format::pcm16) {
+                mClipped += convertToPcm16(buf, reinterpret_cast<int16_t*>(mScratch.get()), count, dither);
+            } else {
+                mClipped += convertToPcm24(buf, reinterpret_cast<uint8_t*>(mScratch.get()), count, dither);
+            }
+            writeData(mScratch.get(), count * size);
+            buf += count;
+            remaining -= count;
+        }
+    }
 
-    // overwrite the sample count in the fact subchunk
-    mStream.seekp(offsetof(WavPrivate::WavHeader, factSampleCount));
-    mStream.write(reinterpret_cast<const char *>(&totalSamples), sizeof(totalSamples));
+    if (mGood) {
+        mSampleCount += nsamples;
+    }
+}
 
-    // overwrite the chunk size of the data subchunk
-    mStream.seekp(offsetof(WavPrivate::WavHeader, dataChunkSize));
-    mStream.write(reinterpret_cast<const char *>(&dataChunkSize), sizeof(dataChunkSize));
+void Wav::writeData(char const *data, std::size_t bytes) {
+    if (mMode == Mode::mapped) {
+        writeMapped(data, bytes);
+    } else {
+        writeBuffered(data, bytes);
+    }
 }
 
-std::ofstream const& Wav::stream() const {
-    return mStream;
+void Wav::flush() {
+    if (mMode == Mode::buffered && mGood && mBlockUsed) {
+        mStream.write(mBlock, mBlockUsed);
+        mBlockUsed = 0;
+        mGood = mStream.good();
+    }
 }
 
-void Wav::write(float buf[], std::size_t nsamples) {
+void Wav::writeBuffered(char const *data, std::size_t bytes) {
+    while (bytes && mGood) {
+        auto const toCopy = std::min(bytes, BLOCK_SIZE - mBlockUsed);
+        std::memcpy(mBlock + mBlockUsed, data, toCopy);
+        mBlockUsed += toCopy;
+        data += toCopy;
+        bytes -= toCopy;
+        if (mBlockUsed == BLOCK_SIZE) {
+            flush();
+        }
+    }
+}
 
-    std::size_t totalSamples = mChannels * nsamples;
-    mStream.write(reinterpret_cast<const char*>(buf), totalSamples * sizeof(float));
-    if (!mStream.good()) {
-        return;
+void Wav::writeMapped(char const *data, std::size_t bytes) {
+    if (mMapUsed + bytes > mMapSize) {
+        // exceeded the reservation, grow by at least half
+        auto const size = std::max(mMapUsed + bytes, mMapSize + std::max(mMapSize / 2, WavPrivate::MAP_GROWTH));
+        if (!map(size)) {
+            // the rest is written buffered, which fails normally if the disk
+            // is full
+            if (mappedToBuffered()) {
+                writeBuffered(data, bytes);
+            } else {
+                mGood = false;
+            }
+            return;
+        }
     }
+    std::memcpy(mMap + mMapUsed, data, bytes);
+    mMapUsed += bytes;
+}
 
-    mSampleCount += nsamples;
+bool Wav::openBuffered(std::size_t position) {
+    // our block does the buffering, so the stream doesn't need to
+    mStream.rdbuf()->pubsetbuf(nullptr, 0);
+    if (position) {
+        mStream.open(mFilename, std::ios::in | std::ios::out | std::ios::binary);
+        mStream.seekp((std::streamoff)position);
+    } else {
+        mStream.open(mFilename, std::ios::out | std::ios::binary);
+    }
+    mBlock = static_cast<char*>(::operator new(BLOCK_SIZE, std::align_val_t(WavPrivate::BLOCK_ALIGN)));
+    mBlockUsed = 0;
+    return mStream.good();
+}
 
+bool Wav::map(std::size_t size) {
+    #ifdef WAV_MMAP
+    if (!unmap()) {
+        return false;
+    }
+    // ftruncate alone would leave a sparse file, and a write to an unbacked
+    // page of the mapping raises SIGBUS when the disk is full
+    if (!WavPrivate::reserve(mFd, size)) {
+        return false;
+    }
+    auto const addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+    mMap = static_cast<char*>(addr);
+    mMapSize = size;
+    return true;
+    #else
+    (void)size;
+    return false;
+    #endif
+}
+
+bool Wav::mappedToBuffered() {
+    #ifdef WAV_MMAP
+    // keep what was written so far, and continue after it
+    auto const used = mMapUsed;
+    auto good = unmap();
+    good = ::ftruncate(mFd, (off_t)used) == 0 && good;
+    good = ::close(mFd) == 0 && good;
+    mFd = -1;
+    mMode = Mode::buffered;
+    return good && openBuffered(used);
+    #else
+    return false;
+    #endif
+}
+
+bool Wav::unmap() {
+    #ifdef WAV_MMAP
+    if (mMap) {
+        auto const result = ::munmap(mMap, mMapSize);
+        mMap = nullptr;
+        mMapSize = 0;
+        return result == 0;
+    }
+    #endif
+    return true;
+}
+
+bool Wav::finish() {
+    if (mFinished) {
+        return mGood;
+    }
+    mFinished = true;
+
+    auto const header = WavPrivate::makeHeader(mFormat, mChannels, mSamplingRate, mSampleCount);
+    auto const padded = (header.dataChunkSize & 1) != 0;
+    // do we need a pad byte?
+    uint8_t const zero = 0;
+
+    if (padded) {
+        // yes, write a single 0 to the end of the data chunk. In mapped mode
+        // this can need a larger mapping, and continue buffered if the
+        // mapping could not grow
+        writeData(reinterpret_cast<const char *>(&zero), sizeof(zero));
+    }
+
+    if (mMode == Mode::mapped) {
+        #ifdef WAV_MMAP
+        std::memcpy(mMap, &header, sizeof(header));
+        auto const used = mMapUsed;
+        if (!unmap()) {
+            mGood = false;
+        }
+        // drop the unused part of the reservation
+        if (::ftruncate(mFd, (off_t)used) != 0) {
+            mGood = false;
+        }
+        if (::close(mFd) != 0) {
+            mGood = false;
+        }
+        mFd = -1;
+        #endif
+        return mGood;
+    }
+
+    flush();
+
+    // overwrite the header with the final sizes
+    mStream.seekp(0);
+    mStream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    mStream.close();
+    // close() sets failbit if the file could not be closed
+    mGood = mGood && !mStream.fail();
+    return mGood;
 }
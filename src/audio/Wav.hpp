@@ -8,7 +8,8 @@
 ** and samplerate. Then write as many samples you want to it via the write
 ** method. Note that for multichannel data, the samples are interleaved.
 **
-** This library only writes wav files using 32-bit float samples.
+** Samples are always given as 32-bit float, and are written as float or
+** converted to 16-bit or 24-bit integer PCM.
 **
 ** stoneface86
 **
@@ -43,38 +44,105 @@
 
 #pragma once
 
+#include "audio/SampleFormat.hpp"
+#include "audio/SampleWriter.hpp"
+
 #include <cstddef>
 #include <fstream>
+#include <memory>
 #include <string>
 
 
-class Wav {
+class Wav : public SampleWriter {
 
 public:
 
+    enum class Mode {
+        // samples are collected in a large block and written when it fills
+        buffered,
+        // the file's space is reserved and it is written through a memory
+        // mapping. Falls back to buffered where mmap is unavailable, or when
+        // the space cannot be reserved (a full disk would otherwise fault
+        // while writing to the mapping).
+        mapped
+    };
+
+    enum class Format {
+        float32,
+        pcm16,
+        pcm24
+    };
+
+    // size of the block used in buffered mode, in bytes
+    static constexpr std::size_t BLOCK_SIZE = 1 << 20;
+
+    //
+    // Opens a wav file for writing sample data with the given channel count,
+    // samplerate and format. Existing files will be overwritten.
+    //
+    // In mapped mode, reserveSamples is the expected number of samples, disk
+    // space is reserved for it and the reservation grown when exceeded.
+    //
+    explicit Wav(
+        std::string const& filename,
+        int channels,
+        int samplerate,
+        Format format = Format::float32,
+        Mode mode = Mode::buffered,
+        std::size_t reserveSamples = 0
+    );
+
+    //
+    // Calls finish() if it wasn't called already.
+    //
+    virtual ~Wav();
+
+    //
+    // Determines if no error has occurred so far. Since samples are
+    // buffered, errors from write() may only be reported on a later write or
+    // flush().
+    //
+    virtual bool good() const override;
 
     //
-    // Opens a wav file for writing sample data with the given channel count
-    // and samplerate. Existing files will be overwritten.
+    // Gets the mode used, which is buffered if mapped was requested but is
+    // unavailable, or if the mapping could not be reserved or grown.
     //
-    explicit Wav(std::string const& filename, int channels, int samplerate);
+    Mode mode() const;
+
+    Format format() const;
 
     //
-    // Adjusts the wav header with the final number of samples written and
-    // closes the file.
+    // Enables TPDF dither when converting to an integer format. Off by
+    // default, has no effect for float32.
     //
-    ~Wav();
+    void setDither(bool dither);
 
     //
-    // Get the stream used by the wav writer.
+    // Number of samples written so far that were outside of -1.0 to 1.0, and
+    // were clipped by the conversion to an integer format. Always 0 for
+    // float32.
     //
-    std::ofstream const& stream() const;
+    virtual std::size_t clipCount() const override;
 
     //
     // Writes the given number of samples from the given buffer to the wav
     // file. The buffer should be at least the size of nsamples * channels.
     //
-    void write(float buf[], std::size_t nsamples);
+    virtual void write(float const buf[], std::size_t nsamples) override;
+
+    //
+    // Writes the buffered samples to the file. Only needed in buffered mode.
+    //
+    void flush();
+
+    //
+    // Writes any buffered samples, adjusts the wav header with the final
+    // number of samples written and closes the file. In mapped mode the
+    // unused part of the reservation is truncated. Returns false if any of
+    // this, or an earlier write, failed.
+    //
+    virtual bool finish() override;
 
 private:
 
@@ -86,10 +154,70 @@ private:
     Wav(Wav &&wav) = delete;
     Wav& operator=(Wav &&wav) = delete;
 
-    std::ofstream mStream;
+    //
+    // Writes already converted sample data.
+    //
+    void writeData(char const *data, std::size_t bytes);
+
+    //
+    // Copies bytes to the block, flushing it whenever full.
+    //
+    void writeBuffered(char const *data, std::size_t bytes);
+
+    //
+    // Copies bytes to the mapping, growing the file if needed.
+    //
+    void writeMapped(char const *data, std::size_t bytes);
+
+    //
+    // Opens the stream and allocates the block for buffered mode. The file
+    // is opened at the given position, keeping its contents if not 0.
+    //
+    bool openBuffered(std::size_t position);
+
+    //
+    // Reserves disk space for the given size and maps the file with it,
+    // replacing the current mapping.
+    //
+    bool map(std::size_t size);
+
+    //
+    // Continues writing in buffered mode after the mapping could not grow.
+    //
+    bool mappedToBuffered();
+
+    //
+    // Unmaps the current mapping, returns false on failure.
+    //
+    bool unmap();
+
+    std::string mFilename;
+    Mode mMode;
+    Format mFormat;
+    bool mGood;
+    bool mFinished;
     std::size_t mSampleCount;
 
     int mChannels;
     int mSamplingRate;
 
+    // integer formats
+    bool mDithering;
+    Dither mDither;
+    std::size_t mClipped;
+    // converted samples, before they are written
+    std::unique_ptr<char[]> mScratch;
+
+    // buffered mode
+    std::ofstream mStream;
+    char *mBlock;
+    std::size_t mBlockUsed;
+
+    // mapped mode
+    int mFd;
+    char *mMap;
+    std::size_t mMapSize;
+    // bytes written to the mapping, including the header
+    std::size_t mMapUsed;
+
 };
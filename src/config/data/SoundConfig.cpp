@@ -17,7 +17,14 @@ SoundConfig::SoundConfig() :
     mDeviceIndex(0),
     mSamplerateIndex(4),
     mLatency(40),
-    mPeriod(5)
+    mPeriod(5),
+    mCallbackRender(false),
+    mAdaptiveLatency(false),
+    mMinLatency(10),
+    mNativeFormat(false),
+    mLowLatency(true),
+    mDevicePeriod(0),
+    mDevicePeriods(0)
 {
 }
 
@@ -45,6 +52,34 @@ int SoundConfig::period() const {
     return mPeriod;
 }
 
+bool SoundConfig::callbackRender() const {
+    return mCallbackRender;
+}
+
+bool SoundConfig::adaptiveLatency() const {
+    return mAdaptiveLatency;
+}
+
+int SoundConfig::minLatency() const {
+    return mMinLatency;
+}
+
+bool SoundConfig::nativeFormat() const {
+    return mNativeFormat;
+}
+
+bool SoundConfig::lowLatency() const {
+    return mLowLatency;
+}
+
+int SoundConfig::devicePeriod() const {
+    return mDevicePeriod;
+}
+
+int SoundConfig::devicePeriods() const {
+    return mDevicePeriods;
+}
+
 void SoundConfig::setBackendIndex(int index) {
     if (index >= -1) {
         mBackendIndex = index;
@@ -92,6 +127,47 @@ void SoundConfig::setPeriod(int period) {
     mPeriod = period;
 }
 
+void SoundConfig::setCallbackRender(bool callbackRender) {
+    mCallbackRender = callbackRender;
+}
+
+void SoundConfig::setAdaptiveLatency(bool adaptive) {
+    mAdaptiveLatency = adaptive;
+}
+
+void SoundConfig::setMinLatency(int latency) {
+    if (latency < MIN_LATENCY || latency > MAX_LATENCY) {
+        qWarning() << TU::LOG_PREFIX << "invalid minimum latency";
+        return;
+    }
+
+    mMinLatency = latency;
+}
+
+void SoundConfig::setNativeFormat(bool nativeFormat) {
+    mNativeFormat = nativeFormat;
+}
+
+void SoundConfig::setLowLatency(bool lowLatency) {
+    mLowLatency = lowLatency;
+}
+
+void SoundConfig::setDevicePeriod(int period) {
+    if (period < 0 || period > MAX_DEVICE_PERIOD) {
+        qWarning() << TU::LOG_PREFIX << "invalid device period";
+        return;
+    }
+    mDevicePeriod = period;
+}
+
+void SoundConfig::setDevicePeriods(int periods) {
+    if (periods < 0 || periods > MAX_DEVICE_PERIODS) {
+        qWarning() << TU::LOG_PREFIX << "invalid device period count";
+        return;
+    }
+    mDevicePeriods = periods;
+}
+
 void SoundConfig::readSettings(QSettings &settings, AudioEnumerator &enumerator) {
     settings.beginGroup(Keys::Sound);
 
@@ -127,6 +203,13 @@ void SoundConfig::readSettings(QSettings &settings, AudioEnumerator &enumerator)
     setSamplerate(settings.value(Keys::samplerate, samplerate()).toInt());
     setLatency(settings.value(Keys::latency, mLatency).toInt());
     setPeriod(settings.value(Keys::period, mPeriod).toInt());
+    setCallbackRender(settings.value(Keys::callbackRender, mCallbackRender).toBool());
+    setAdaptiveLatency(settings.value(Keys::adaptiveLatency, mAdaptiveLatency).toBool());
+    setMinLatency(settings.value(Keys::minLatency, mMinLatency).toInt());
+    setNativeFormat(settings.value(Keys::nativeFormat, mNativeFormat).toBool());
+    setLowLatency(settings.value(Keys::lowLatency, mLowLatency).toBool());
+    setDevicePeriod(settings.value(Keys::devicePeriod, mDevicePeriod).toInt());
+    setDevicePeriods(settings.value(Keys::devicePeriods, mDevicePeriods).toInt());
 
     settings.endGroup();
 }
@@ -147,6 +230,13 @@ void SoundConfig::writeSettings(QSettings &settings, AudioEnumerator const& enum
     settings.setValue(Keys::samplerate, samplerate());
     settings.setValue(Keys::latency, mLatency);
     settings.setValue(Keys::period, mPeriod);
+    settings.setValue(Keys::callbackRender, mCallbackRender);
+    settings.setValue(Keys::adaptiveLatency, mAdaptiveLatency);
+    settings.setValue(Keys::minLatency, mMinLatency);
+    settings.setValue(Keys::nativeFormat, mNativeFormat);
+    settings.setValue(Keys::lowLatency, mLowLatency);
+    settings.setValue(Keys::devicePeriod, mDevicePeriod);
+    settings.setValue(Keys::devicePeriods, mDevicePeriods);
 
     settings.endGroup();
 }
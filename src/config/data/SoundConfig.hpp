@@ -15,6 +15,10 @@ public:
     static constexpr int MIN_LATENCY = 1;
     static constexpr int MAX_LATENCY = 500;
 
+    // 0 lets the backend decide for both
+    static constexpr int MAX_DEVICE_PERIOD = 100;
+    static constexpr int MAX_DEVICE_PERIODS = 16;
+
     SoundConfig();
     
     int backendIndex() const;
@@ -24,6 +28,47 @@ public:
     int latency() const;
     int period() const;
 
+    //
+    // Determines if audio is rendered directly in the device's data callback,
+    // instead of being buffered ahead by a timer. The latency and period
+    // settings are not used when enabled.
+    //
+    bool callbackRender() const;
+
+    //
+    // Determines if the buffer size is adjusted automatically during
+    // playback. When enabled, the buffer size is kept between minLatency()
+    // and latency().
+    //
+    bool adaptiveLatency() const;
+
+    int minLatency() const;
+
+    //
+    // Determines if the device's native format and samplerate is used
+    // instead of samplerate() and 32-bit float, to avoid conversion and
+    // resampling in the device callback.
+    //
+    bool nativeFormat() const;
+
+    //
+    // Determines if the device is opened with the low latency performance
+    // profile, otherwise the conservative profile is used.
+    //
+    bool lowLatency() const;
+
+    //
+    // Size of the device's period, in milliseconds, to request from the
+    // backend. 0 lets the backend decide.
+    //
+    int devicePeriod() const;
+
+    //
+    // Number of periods in the device's buffer to request from the backend.
+    // 0 lets the backend decide.
+    //
+    int devicePeriods() const;
+
     void setBackendIndex(int index);
 
     void setDeviceIndex(int index);
@@ -35,6 +80,20 @@ public:
     void setLatency(int latency);
 
     void setPeriod(int period);
+
+    void setCallbackRender(bool callbackRender);
+
+    void setAdaptiveLatency(bool adaptive);
+
+    void setMinLatency(int latency);
+
+    void setNativeFormat(bool nativeFormat);
+
+    void setLowLatency(bool lowLatency);
+
+    void setDevicePeriod(int period);
+
+    void setDevicePeriods(int periods);
     
     void readSettings(QSettings &settings, AudioEnumerator &enumerator);
 
@@ -47,4 +106,11 @@ private:
     int mSamplerateIndex;        // index of the current samplerate
     int mLatency;                // latency, or internal buffer size, in milliseconds
     int mPeriod;                 // period, in milliseconds
+    bool mCallbackRender;        // render in the device callback (pull mode)
+    bool mAdaptiveLatency;       // adjust the buffer size during playback
+    int mMinLatency;             // lower bound of the buffer size when adaptive, in milliseconds
+    bool mNativeFormat;          // use the device's native format and samplerate
+    bool mLowLatency;            // low latency performance profile for the device
+    int mDevicePeriod;           // device period, in milliseconds (0 for default)
+    int mDevicePeriods;          // number of device periods (0 for default)
 };
@@ -15,12 +15,14 @@ QString const PianoInput { QStringLiteral("PianoInput") };
 QString const Shortcuts { QStringLiteral("Shortcuts") };
 QString const Sound { QStringLiteral("Sound") };
 
+QString const adaptiveLatency { QStringLiteral("adaptiveLatency") };
 QString const api { QStringLiteral("api") };
 QString const autosave { QStringLiteral("autosave") };
 QString const autosaveInterval { QStringLiteral("autosaveInterval") };
 QString const backupCopy { QStringLiteral("backupCopy") };
 QString const bindingsLower { QStringLiteral("bindingsLower") };
 QString const bindingsUpper { QStringLiteral("bindingsUpper") };
+QString const callbackRender { QStringLiteral("callbackRender") };
 QString const cursorWrap { QStringLiteral("cursorWrap") };
 QString const cursorWrapPattern { QStringLiteral("cursorWrapPattern") };
 QString const deviceName { QStringLiteral("deviceName") };
@@ -34,6 +36,11 @@ QString const rownoHex ( QStringLiteral("rownoHex") );
 QString const samplerate { QStringLiteral("samplerate") };
 QString const period { QStringLiteral("period") };
 QString const latency { QStringLiteral("latency") };
+QString const minLatency { QStringLiteral("minLatency") };
+QString const nativeFormat { QStringLiteral("nativeFormat") };
+QString const lowLatency { QStringLiteral("lowLatency") };
+QString const devicePeriod { QStringLiteral("devicePeriod") };
+QString const devicePeriods { QStringLiteral("devicePeriods") };
 QString const deviceId { QStringLiteral("deviceId") };
 QString const noteCut { QStringLiteral("noteCut") };
 
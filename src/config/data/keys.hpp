@@ -26,12 +26,14 @@ extern QString const PianoInput;
 extern QString const Shortcuts;
 extern QString const Sound;
 
+extern QString const adaptiveLatency;
 extern QString const api;
 extern QString const autosave;
 extern QString const autosaveInterval;
 extern QString const backupCopy;
 extern QString const bindingsUpper;
 extern QString const bindingsLower;
+extern QString const callbackRender;
 extern QString const cursorWrap;
 extern QString const cursorWrapPattern;
 extern QString const deviceName;
@@ -45,6 +47,11 @@ extern QString const rownoHex;
 extern QString const samplerate;
 extern QString const period;
 extern QString const latency;
+extern QString const minLatency;
+extern QString const nativeFormat;
+extern QString const lowLatency;
+extern QString const devicePeriod;
+extern QString const devicePeriods;
 extern QString const deviceId;
 extern QString const noteCut;
 
@@ -5,6 +5,7 @@
 #include "midi/MidiEnumerator.hpp"
 #include "utils/connectutils.hpp"
 
+#include <QCheckBox>
 #include <QComboBox>
 #include <QGridLayout>
 #include <QGroupBox>
@@ -13,6 +14,8 @@
 #include <QSignalBlocker>
 #include <QSpinBox>
 
+#include <algorithm>
+
 //
 // QGroupBox subclass containing a combobox for an API and Device
 // Used for selecting a MIDI input device and Audio output device
@@ -118,6 +121,37 @@ SoundConfigTab::SoundConfigTab(
     mSamplerateCombo = new QComboBox;
     audioLayout->addWidget(mSamplerateCombo, 2, 1);
 
+    // row 3, callback render
+    mCallbackRenderCheck = new QCheckBox(tr("Render in audio callback (lower latency)"));
+    audioLayout->addWidget(mCallbackRenderCheck, 3, 0, 1, 2);
+
+    // row 4, adaptive buffer size
+    mAdaptiveLatencyCheck = new QCheckBox(tr("Adjust buffer size automatically (up to the buffer size)"));
+    audioLayout->addWidget(mAdaptiveLatencyCheck, 4, 0, 1, 2);
+
+    // row 5, minimum buffer size
+    audioLayout->addWidget(new QLabel(tr("Minimum buffer size")), 5, 0);
+    mMinLatencySpin = new QSpinBox;
+    audioLayout->addWidget(mMinLatencySpin, 5, 1);
+
+    // row 6, native format
+    mNativeFormatCheck = new QCheckBox(tr("Use the device's native format and sample rate"));
+    audioLayout->addWidget(mNativeFormatCheck, 6, 0, 1, 2);
+
+    // row 7, device performance profile
+    mLowLatencyCheck = new QCheckBox(tr("Low latency device profile"));
+    audioLayout->addWidget(mLowLatencyCheck, 7, 0, 1, 2);
+
+    // row 8, device period
+    audioLayout->addWidget(new QLabel(tr("Device period")), 8, 0);
+    mDevicePeriodSpin = new QSpinBox;
+    audioLayout->addWidget(mDevicePeriodSpin, 8, 1);
+
+    // row 9, device period count
+    audioLayout->addWidget(new QLabel(tr("Device periods")), 9, 0);
+    mDevicePeriodsSpin = new QSpinBox;
+    audioLayout->addWidget(mDevicePeriodsSpin, 9, 1);
+
     audioGroup->setLayout(audioLayout);
 
     mMidiGroup = new DeviceGroup(tr("MIDI Input"));
@@ -143,6 +177,13 @@ SoundConfigTab::SoundConfigTab(
     mSamplerateCombo->setCurrentIndex(soundConfig.samplerateIndex());
     mLatencySpin->setValue(soundConfig.latency());
     mPeriodSpin->setValue(soundConfig.period());
+    mCallbackRenderCheck->setChecked(soundConfig.callbackRender());
+    mAdaptiveLatencyCheck->setChecked(soundConfig.adaptiveLatency());
+    mMinLatencySpin->setValue(soundConfig.minLatency());
+    mNativeFormatCheck->setChecked(soundConfig.nativeFormat());
+    mSamplerateCombo->setEnabled(!soundConfig.nativeFormat());
+    mLowLatencyCheck->setChecked(soundConfig.lowLatency());
+    updateLatencyControls();
 
     auto setupTimeSpinbox = [](QSpinBox &spin, int min, int max) {
         spin.setSuffix(tr(" ms"));
@@ -151,6 +192,14 @@ SoundConfigTab::SoundConfigTab(
     };
     setupTimeSpinbox(*mLatencySpin, SoundConfig::MIN_LATENCY, SoundConfig::MAX_LATENCY);
     setupTimeSpinbox(*mPeriodSpin, SoundConfig::MIN_PERIOD, SoundConfig::MAX_PERIOD);
+    setupTimeSpinbox(*mMinLatencySpin, SoundConfig::MIN_LATENCY, SoundConfig::MAX_LATENCY);
+    // 0 for the device settings lets the backend decide
+    setupTimeSpinbox(*mDevicePeriodSpin, 0, SoundConfig::MAX_DEVICE_PERIOD);
+    mDevicePeriodSpin->setSpecialValueText(tr("Default"));
+    mDevicePeriodsSpin->setRange(0, SoundConfig::MAX_DEVICE_PERIODS);
+    mDevicePeriodsSpin->setSpecialValueText(tr("Default"));
+    mDevicePeriodSpin->setValue(soundConfig.devicePeriod());
+    mDevicePeriodsSpin->setValue(soundConfig.devicePeriods());
 
     mMidiGroup->init(mMidiEnumerator, midiConfig.backendIndex(), midiConfig.portIndex());
 
@@ -158,6 +207,22 @@ SoundConfigTab::SoundConfigTab(
     connect(mSamplerateCombo, qOverload<int>(&QComboBox::currentIndexChanged), this, &SoundConfigTab::setDirty<Config::CategorySound>);
     connect(mLatencySpin, qOverload<int>(&QSpinBox::valueChanged), this, &SoundConfigTab::setDirty<Config::CategorySound>);
     connect(mPeriodSpin, qOverload<int>(&QSpinBox::valueChanged), this, &SoundConfigTab::setDirty<Config::CategorySound>);
+    connect(mMinLatencySpin, qOverload<int>(&QSpinBox::valueChanged), this, &SoundConfigTab::setDirty<Config::CategorySound>);
+    connect(mDevicePeriodSpin, qOverload<int>(&QSpinBox::valueChanged), this, &SoundConfigTab::setDirty<Config::CategorySound>);
+    connect(mDevicePeriodsSpin, qOverload<int>(&QSpinBox::valueChanged), this, &SoundConfigTab::setDirty<Config::CategorySound>);
+    lazyconnect(mLowLatencyCheck, toggled, this, setDirty<Config::CategorySound>);
+    auto toggled = [this]() {
+        updateLatencyControls();
+        setDirty(Config::CategorySound);
+    };
+    connect(mCallbackRenderCheck, &QCheckBox::toggled, this, toggled);
+    connect(mAdaptiveLatencyCheck, &QCheckBox::toggled, this, toggled);
+    connect(mNativeFormatCheck, &QCheckBox::toggled, this,
+        [this](bool checked) {
+            // the device decides the samplerate
+            mSamplerateCombo->setEnabled(!checked);
+            setDirty(Config::CategorySound);
+        });
 
     connect(mAudioGroup->mApiCombo, qOverload<int>(&QComboBox::currentIndexChanged), this, &SoundConfigTab::audioApiChanged);
     connect(mAudioGroup->mDeviceCombo, qOverload<int>(&QComboBox::currentIndexChanged), this, &SoundConfigTab::setDirty<Config::CategorySound>);
@@ -176,10 +241,26 @@ void SoundConfigTab::apply(SoundConfig &soundConfig) {
 
     soundConfig.setLatency(mLatencySpin->value());
     soundConfig.setPeriod(mPeriodSpin->value());
+    soundConfig.setCallbackRender(mCallbackRenderCheck->isChecked());
+    soundConfig.setAdaptiveLatency(mAdaptiveLatencyCheck->isChecked());
+    soundConfig.setMinLatency(std::min(mMinLatencySpin->value(), mLatencySpin->value()));
+    soundConfig.setNativeFormat(mNativeFormatCheck->isChecked());
+    soundConfig.setLowLatency(mLowLatencyCheck->isChecked());
+    soundConfig.setDevicePeriod(mDevicePeriodSpin->value());
+    soundConfig.setDevicePeriods(mDevicePeriodsSpin->value());
 
     clean();
 }
 
+void SoundConfigTab::updateLatencyControls() {
+    // buffer settings only apply to timer rendering
+    auto const timerRender = !mCallbackRenderCheck->isChecked();
+    mLatencySpin->setEnabled(timerRender);
+    mPeriodSpin->setEnabled(timerRender);
+    mAdaptiveLatencyCheck->setEnabled(timerRender);
+    mMinLatencySpin->setEnabled(timerRender && mAdaptiveLatencyCheck->isChecked());
+}
+
 void SoundConfigTab::apply(MidiConfig &midiConfig) {
     auto const enabled = mMidiGroup->isChecked();
     midiConfig.setEnabled(enabled);
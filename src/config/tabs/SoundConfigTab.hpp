@@ -5,6 +5,7 @@
 class AudioEnumerator;
 class MidiEnumerator;
 
+class QCheckBox;
 class QComboBox;
 class QGroupBox;
 class QSpinBox;
@@ -36,6 +37,8 @@ private:
 
     Q_DISABLE_COPY(SoundConfigTab)
 
+    void updateLatencyControls();
+
     void audioRescan();
     void midiRescan();
 
@@ -60,6 +63,13 @@ private:
     QSpinBox *mLatencySpin;
     QSpinBox *mPeriodSpin;
     QComboBox *mSamplerateCombo;
+    QCheckBox *mCallbackRenderCheck;
+    QCheckBox *mAdaptiveLatencyCheck;
+    QSpinBox *mMinLatencySpin;
+    QCheckBox *mNativeFormatCheck;
+    QCheckBox *mLowLatencyCheck;
+    QSpinBox *mDevicePeriodSpin;
+    QSpinBox *mDevicePeriodsSpin;
 
 
 };
@@ -6,19 +6,36 @@
 #include "export/WavExporter.hpp"
 
 #include <QCheckBox>
+#include <QComboBox>
 #include <QDialogButtonBox>
+#include <QDoubleSpinBox>
 #include <QFileDialog>
 #include <QFileInfo>
+#include <QFormLayout>
 #include <QGroupBox>
 #include <QLabel>
 #include <QLineEdit>
+#include <QListWidget>
 #include <QProgressBar>
 #include <QPushButton>
 #include <QRadioButton>
 #include <QSpinBox>
 #include <QStackedLayout>
+#include <QStringList>
 #include <QStringView>
 
+#include <algorithm>
+#include <limits>
+#include <optional>
+
+#define TU ExportWavDialogTU
+namespace TU {
+
+// interval at which the progress bars are updated while exporting
+constexpr int PROGRESS_INTERVAL = 50;
+
+}
+
 ExportWavDialog::ExportWavDialog(
     Module const& mod,
     ModuleFile const& modFile,
@@ -29,9 +46,12 @@ ExportWavDialog::ExportWavDialog(
     mModule(mod),
     mSamplerate(samplerate),
     mExporter(nullptr),
-    mTimeEditDuration(60)
+    mTimeEditDuration(60),
+    mProgressTimer()
 {
     setModal(true);
+    mProgressTimer.setInterval(TU::PROGRESS_INTERVAL);
+    connect(&mProgressTimer, &QTimer::timeout, this, &ExportWavDialog::pollProgress);
     setWindowTitle(tr("Export to WAV"));
 
     auto layout = new QVBoxLayout;
@@ -49,6 +69,12 @@ ExportWavDialog::ExportWavDialog(
     durationLayout->addWidget(new QLabel(tr("mm:ss")), 1, 2);
     mDurationGroup->setLayout(durationLayout);
 
+    mSongsGroup = new QGroupBox(tr("Songs"));
+    auto songsLayout = new QVBoxLayout;
+    mSongList = new QListWidget;
+    songsLayout->addWidget(mSongList);
+    mSongsGroup->setLayout(songsLayout);
+
     mChannelsGroup = new QGroupBox(tr("Channels"));
     auto channelLayout = new QHBoxLayout;
     int ch = 1;
@@ -83,6 +109,56 @@ ExportWavDialog::ExportWavDialog(
     channelLayout->addStretch();
     mChannelsGroup->setLayout(channelLayout);
 
+    mFormatGroup = new QGroupBox(tr("Format"));
+    auto formatLayout = new QHBoxLayout;
+    mFormatCombo = new QComboBox;
+    auto addFormat = [this](QString const& text, Wav::Format format, bool flac) {
+        mFormatCombo->addItem(text, (int)format);
+        mFormatCombo->setItemData(mFormatCombo->count() - 1, flac, FLAC_ROLE);
+    };
+    addFormat(tr("32-bit float WAV"), Wav::Format::float32, false);
+    addFormat(tr("16-bit PCM WAV"), Wav::Format::pcm16, false);
+    addFormat(tr("24-bit PCM WAV"), Wav::Format::pcm24, false);
+    addFormat(tr("16-bit FLAC"), Wav::Format::pcm16, true);
+    addFormat(tr("24-bit FLAC"), Wav::Format::pcm24, true);
+    mDitherCheck = new QCheckBox(tr("Dither"));
+    mDitherCheck->setEnabled(false);
+    formatLayout->addWidget(mFormatCombo);
+    formatLayout->addWidget(mDitherCheck);
+    formatLayout->addStretch();
+    auto levelsLayout = new QHBoxLayout;
+    mAnalyzeCheck = new QCheckBox(tr("Measure levels"));
+    mNormalizeCheck = new QCheckBox(tr("Normalize to"));
+    mNormalizeSpin = new QDoubleSpinBox;
+    mNormalizeSpin->setRange(-70.0, 0.0);
+    mNormalizeSpin->setDecimals(1);
+    mNormalizeSpin->setValue(-14.0);
+    mNormalizeSpin->setSuffix(tr(" LUFS"));
+    mNormalizeSpin->setEnabled(false);
+    levelsLayout->addWidget(mAnalyzeCheck);
+    levelsLayout->addWidget(mNormalizeCheck);
+    levelsLayout->addWidget(mNormalizeSpin);
+    levelsLayout->addStretch();
+    auto formatGroupLayout = new QVBoxLayout;
+    formatGroupLayout->addLayout(formatLayout);
+    formatGroupLayout->addLayout(levelsLayout);
+    mFormatGroup->setLayout(formatGroupLayout);
+    connect(mNormalizeCheck, &QCheckBox::toggled, mNormalizeSpin, &QDoubleSpinBox::setEnabled);
+    // dither only applies to the integer formats
+    connect(mFormatCombo, qOverload<int>(&QComboBox::currentIndexChanged), this,
+        [this]() {
+            mDitherCheck->setEnabled(mFormatCombo->currentData().toInt() != (int)Wav::Format::float32);
+
+            // keep the destination's extension in line with the container
+            auto const flac = isFlacSelected();
+            auto const from = flac ? QStringLiteral(".wav") : QStringLiteral(".flac");
+            auto destination = mSingleDestination->text();
+            if (destination.endsWith(from, Qt::CaseInsensitive)) {
+                destination.chop(from.size());
+                mSingleDestination->setText(destination + (flac ? QStringLiteral(".flac") : QStringLiteral(".wav")));
+            }
+        });
+
     mDestinationGroup = new QGroupBox(tr("Destination"));
     auto destinationLayout = new QVBoxLayout;
     mSeparateChannelsCheck = new QCheckBox(tr("Export each channel separately"));
@@ -109,6 +185,10 @@ ExportWavDialog::ExportWavDialog(
     separateLayout->addWidget(new QLabel(tr("Prefix")), 1, 0);
     mSeparatePrefix = new QLineEdit;
     separateLayout->addWidget(mSeparatePrefix, 1, 1);
+    mSeparateMixCheck = new QCheckBox(tr("Also export the mix"));
+    separateLayout->addWidget(mSeparateMixCheck, 2, 0, 1, 3);
+    mSinglePassCheck = new QCheckBox(tr("Render all channels in a single pass"));
+    separateLayout->addWidget(mSinglePassCheck, 3, 0, 1, 3);
     separateLayout->setContentsMargins(0, 0, 0, 0);
     separateLayout->setColumnStretch(1, 1);
     separateContainer->setLayout(separateLayout);
@@ -117,7 +197,8 @@ ExportWavDialog::ExportWavDialog(
     mDestinationStack->addWidget(separateContainer);
     mDestinationGroup->setLayout(destinationLayout);
 
-    mProgress = new QProgressBar;
+    // one progress bar per song, added when exporting
+    mProgressLayout = new QFormLayout;
     mStatusLabel = new QLabel;
 
     auto buttons = new QDialogButtonBox;
@@ -126,9 +207,11 @@ ExportWavDialog::ExportWavDialog(
     buttons->addButton(QDialogButtonBox::Cancel);
 
     layout->addWidget(mDurationGroup);
+    layout->addWidget(mSongsGroup);
     layout->addWidget(mChannelsGroup);
+    layout->addWidget(mFormatGroup);
     layout->addWidget(mDestinationGroup);
-    layout->addWidget(mProgress);
+    layout->addLayout(mProgressLayout);
     layout->addWidget(mStatusLabel);
     layout->addWidget(buttons);
     layout->setSizeConstraint(QLayout::SizeConstraint::SetFixedSize);
@@ -140,7 +223,20 @@ ExportWavDialog::ExportWavDialog(
     mLoopSpin->setRange(1, 100);
     mTimeEdit->setInputMask(QStringLiteral("99:99"));
     mTimeEdit->setMaxLength(5);
-    mProgress->setAlignment(Qt::AlignVCenter | Qt::AlignHCenter);
+
+    // all songs are listed, only the current one is exported by default
+    {
+        auto const& songs = mModule.data().songs();
+        for (int i = 0; i < (int)songs.size(); ++i) {
+            auto const song = songs.get(i);
+            auto item = new QListWidgetItem(
+                QStringLiteral("%1# %2").arg(QString::number(i + 1), QString::fromStdString(song->name())),
+                mSongList
+            );
+            item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+            item->setCheckState(song == mModule.song() ? Qt::Checked : Qt::Unchecked);
+        }
+    }
     
     connect(buttons, &QDialogButtonBox::accepted, this, &ExportWavDialog::accept);
     connect(buttons, &QDialogButtonBox::rejected, this, &ExportWavDialog::reject);
@@ -192,7 +288,7 @@ ExportWavDialog::ExportWavDialog(
                 this,
                 tr("Select destination"),
                 mSingleDestination->text(),
-                tr("WAV files (*.wav)")
+                isFlacSelected() ? tr("FLAC files (*.flac)") : tr("WAV files (*.wav)")
             );
 
             if (filename.isEmpty()) {
@@ -245,15 +341,43 @@ void ExportWavDialog::accept() {
     if (!isExporting) {
         if (mExporter == nullptr) {
             mExporter = new WavExporter(mModule, mSamplerate, this);
-            connect(mExporter, &WavExporter::progressMax, mProgress, &QProgressBar::setMaximum);
-            connect(mExporter, &WavExporter::progress, mProgress, &QProgressBar::setValue);
+            connect(mExporter, &WavExporter::progressMax, this,
+                [this](int song, int max) {
+                    if (song < (int)mProgressBars.size()) {
+                        mProgressBars[song]->setMaximum(max);
+                    }
+                });
             connect(mExporter, &WavExporter::finished, this,
                 [this]() {
+                    mProgressTimer.stop();
+                    pollProgress();
                     if (mExporter->failed()) {
                         mStatusLabel->setText(tr("Export failed"));
                     } else {
-                        mProgress->setValue(mProgress->maximum());
-                        mStatusLabel->setText(tr("Export complete"));
+                        for (auto bar : mProgressBars) {
+                            bar->setValue(bar->maximum());
+                        }
+                        auto const clipped = mExporter->clipCount();
+                        auto status = clipped
+                            ? tr("Export complete, %n sample(s) clipped", nullptr, (int)clipped)
+                            : tr("Export complete");
+                        // the levels of every file are listed in the tooltip,
+                        // the status shows the loudest peak
+                        QStringList fileLevels;
+                        auto peak = -std::numeric_limits<double>::infinity();
+                        for (auto const& file : mExporter->levels()) {
+                            fileLevels.append(tr("%1: peak %2 dBFS, RMS %3 dBFS, loudness %4 LUFS").arg(
+                                QFileInfo(file.filename).fileName(),
+                                QString::number(file.levels.peak, 'f', 1),
+                                QString::number(file.levels.rms, 'f', 1),
+                                QString::number(file.levels.loudness, 'f', 1)));
+                            peak = std::max(peak, file.levels.peak);
+                        }
+                        if (!fileLevels.isEmpty()) {
+                            status += tr(", peak %1 dBFS").arg(peak, 0, 'f', 1);
+                        }
+                        mStatusLabel->setText(status);
+                        mStatusLabel->setToolTip(fileLevels.join(QChar('\n')));
                     }
                     mExportButton->setEnabled(true);
                     setGroupsEnabled(true);
@@ -287,15 +411,57 @@ void ExportWavDialog::accept() {
             mExporter->setSeparate(true);
             mExporter->setDestination(mSeparateDestination->text());
             mExporter->setSeparatePrefix(mSeparatePrefix->text());
+            mExporter->setSeparateMix(mSeparateMixCheck->isChecked());
+            mExporter->setSinglePass(mSinglePassCheck->isChecked());
         } else {
             mExporter->setSeparate(false);
             mExporter->setDestination(mSingleDestination->text());
         }
 
+        {
+            auto const format = (Wav::Format)mFormatCombo->currentData().toInt();
+            mExporter->setFormat(format);
+            mExporter->setDither(format != Wav::Format::float32 && mDitherCheck->isChecked());
+            mExporter->setFlac(isFlacSelected());
+        }
+
+        mExporter->setAnalyze(mAnalyzeCheck->isChecked());
+        if (mNormalizeCheck->isChecked()) {
+            mExporter->setNormalize(mNormalizeSpin->value());
+        } else {
+            mExporter->setNormalize(std::nullopt);
+        }
+
+        QVector<int> songs;
+        for (int i = 0; i < mSongList->count(); ++i) {
+            if (mSongList->item(i)->checkState() == Qt::Checked) {
+                songs.append(i);
+            }
+        }
+        if (songs.isEmpty()) {
+            mStatusLabel->setText(tr("No songs selected"));
+            return;
+        }
+        mExporter->setSongs(songs);
+
+        // a progress bar for each song, in the same order
+        while (mProgressLayout->rowCount()) {
+            mProgressLayout->removeRow(0);
+        }
+        mProgressBars.clear();
+        for (auto index : songs) {
+            auto bar = new QProgressBar;
+            bar->setAlignment(Qt::AlignVCenter | Qt::AlignHCenter);
+            bar->setValue(0);
+            mProgressLayout->addRow(QStringLiteral("%1#").arg(index + 1), bar);
+            mProgressBars.push_back(bar);
+        }
+
         mStatusLabel->setText(tr("Exporting..."));
-        mProgress->setValue(0);
+        mStatusLabel->setToolTip(QString());
         setGroupsEnabled(false);
         mExporter->start();
+        mProgressTimer.start();
         mExportButton->setEnabled(false);
     }
 
@@ -313,8 +479,22 @@ void ExportWavDialog::reject() {
     QDialog::reject();
 }
 
+bool ExportWavDialog::isFlacSelected() const {
+    return mFormatCombo->currentData(FLAC_ROLE).toBool();
+}
+
+void ExportWavDialog::pollProgress() {
+    for (int song = 0; song < (int)mProgressBars.size(); ++song) {
+        mProgressBars[song]->setValue(mExporter->progress(song));
+    }
+}
+
 void ExportWavDialog::setGroupsEnabled(bool enabled) {
     mDurationGroup->setEnabled(enabled);
+    mSongsGroup->setEnabled(enabled);
     mChannelsGroup->setEnabled(enabled);
+    mFormatGroup->setEnabled(enabled);
     mDestinationGroup->setEnabled(enabled);
 }
+
+#undef TU
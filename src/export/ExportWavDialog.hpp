@@ -6,11 +6,16 @@ class ModuleFile;
 class WavExporter;
 
 class QCheckBox;
+class QComboBox;
 #include <QDialog>
+#include <QTimer>
 class QDialogButtonBox;
+class QDoubleSpinBox;
+class QFormLayout;
 class QGroupBox;
 class QLabel;
 class QLineEdit;
+class QListWidget;
 class QProgressBar;
 class QPushButton;
 class QRadioButton;
@@ -18,6 +23,7 @@ class QSpinBox;
 class QStackedLayout;
 
 #include <array>
+#include <vector>
 
 class ExportWavDialog : public QDialog {
 
@@ -37,6 +43,17 @@ public:
     virtual void reject() override;
 
 private:
+    // item data role of the format combo, true for the FLAC formats
+    static constexpr int FLAC_ROLE = Qt::UserRole + 1;
+
+    bool isFlacSelected() const;
+
+    //
+    // Updates the progress bars from the exporter, called periodically by
+    // mProgressTimer while exporting.
+    //
+    void pollProgress();
+
     void setGroupsEnabled(bool enabled);
 
     Module const& mModule;
@@ -45,22 +62,35 @@ private:
     unsigned mTimeEditDuration;
 
     QGroupBox *mDurationGroup;
+    QGroupBox *mSongsGroup;
     QGroupBox *mChannelsGroup;
+    QGroupBox *mFormatGroup;
     QGroupBox *mDestinationGroup;
 
     QRadioButton *mLoopRadio;
     QRadioButton *mTimeRadio;
     QSpinBox *mLoopSpin;
     QLineEdit *mTimeEdit;
+    QListWidget *mSongList;
     std::array<QCheckBox*, 4> mChannelChecks;
+    QComboBox *mFormatCombo;
+    QCheckBox *mDitherCheck;
+    QCheckBox *mAnalyzeCheck;
+    QCheckBox *mNormalizeCheck;
+    QDoubleSpinBox *mNormalizeSpin;
 
     QCheckBox *mSeparateChannelsCheck;
     QStackedLayout *mDestinationStack;
     QLineEdit *mSingleDestination;
     QLineEdit *mSeparateDestination;
     QLineEdit *mSeparatePrefix;
+    QCheckBox *mSeparateMixCheck;
+    QCheckBox *mSinglePassCheck;
 
-    QProgressBar *mProgress;
+    QFormLayout *mProgressLayout;
+    // one per exported song
+    std::vector<QProgressBar*> mProgressBars;
+    QTimer mProgressTimer;
     QLabel *mStatusLabel;
     QPushButton *mExportButton;
 
@@ -0,0 +1,226 @@
+
+#include "export/HeadlessExport.hpp"
+
+#include "core/Module.hpp"
+#include "core/ModuleFile.hpp"
+#include "export/WavExporter.hpp"
+
+#include <QCoreApplication>
+#include <QFileInfo>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+
+#define TU HeadlessExportTU
+namespace TU {
+
+static auto const EXPORT_WAV = "export-wav";
+
+constexpr int DEFAULT_SAMPLERATE = 44100;
+constexpr int MIN_SAMPLERATE = 8000;
+constexpr int MAX_SAMPLERATE = 192000;
+
+// range of --normalize, in LUFS
+constexpr double MIN_LOUDNESS = -70.0;
+constexpr double MAX_LOUDNESS = 0.0;
+
+QString tr(char const *str) {
+    return QCoreApplication::translate("HeadlessExport", str);
+}
+
+//
+// Parses a non-negative integer option, writing an error if invalid.
+//
+bool parseInt(QCommandLineParser const& parser, QCommandLineOption const& option, int min, int max, int &outValue) {
+    if (!parser.isSet(option)) {
+        return true;
+    }
+
+    bool ok;
+    auto const value = parser.value(option).toInt(&ok);
+    if (!ok || value < min || value > max) {
+        fprintf(stderr, "%s\n", qPrintable(
+            tr("invalid value for --%1, expected %2 to %3")
+                .arg(option.names().first())
+                .arg(min)
+                .arg(max)));
+        return false;
+    }
+    outValue = value;
+    return true;
+}
+
+//
+// Formats a level in decibels for the report, silence is shown as -inf.
+//
+QString formatLevel(double level) {
+    return std::isfinite(level) ? QString::number(level, 'f', 1) : QStringLiteral("-inf");
+}
+
+}
+
+HeadlessExport::HeadlessExport() :
+    mExportWavOption(
+        TU::EXPORT_WAV,
+        TU::tr("Export the module to the given wav file and exit, without starting the GUI"),
+        TU::tr("file")),
+    mSongOption(
+        QStringLiteral("song"),
+        TU::tr("Index of the song to export (default 0)"),
+        TU::tr("index")),
+    mLoopsOption(
+        QStringLiteral("loops"),
+        TU::tr("Number of times to play the song (default 1)"),
+        TU::tr("count")),
+    mSamplerateOption(
+        QStringLiteral("samplerate"),
+        TU::tr("Samplerate of the exported file (default 44100)"),
+        TU::tr("rate")),
+    mStemsOption(
+        QStringLiteral("stems"),
+        TU::tr("Export each channel to a separate file")),
+    mMmapOption(
+        QStringLiteral("mmap"),
+        TU::tr("Write the exported files through a memory mapping")),
+    mFormatOption(
+        QStringLiteral("format"),
+        TU::tr("Sample format of the exported files: float, 16 or 24 (default float)"),
+        TU::tr("format")),
+    mDitherOption(
+        QStringLiteral("dither"),
+        TU::tr("Add dither when exporting to 16 or 24-bit")),
+    mAnalyzeOption(
+        QStringLiteral("analyze"),
+        TU::tr("Report the peak, RMS and loudness of each exported file")),
+    mNormalizeOption(
+        QStringLiteral("normalize"),
+        TU::tr("Normalize each exported file to the given integrated loudness"),
+        TU::tr("LUFS"))
+{
+}
+
+bool HeadlessExport::isRequested(int argc, char *argv[]) {
+    // the option may be given as --export-wav file or --export-wav=file
+    auto const len = strlen(TU::EXPORT_WAV);
+    for (int i = 1; i < argc; ++i) {
+        auto arg = argv[i];
+        if (arg[0] == '-' && arg[1] == '-' && strncmp(arg + 2, TU::EXPORT_WAV, len) == 0 &&
+            (arg[len + 2] == '\0' || arg[len + 2] == '=')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void HeadlessExport::addOptions(QCommandLineParser &parser) {
+    parser.addOption(mExportWavOption);
+    parser.addOption(mSongOption);
+    parser.addOption(mLoopsOption);
+    parser.addOption(mSamplerateOption);
+    parser.addOption(mStemsOption);
+    parser.addOption(mMmapOption);
+    parser.addOption(mFormatOption);
+    parser.addOption(mDitherOption);
+    parser.addOption(mAnalyzeOption);
+    parser.addOption(mNormalizeOption);
+}
+
+HeadlessExport::Result HeadlessExport::run(QCommandLineParser const& parser, QString const& moduleFile) {
+
+    auto const destination = parser.value(mExportWavOption);
+    if (moduleFile.isEmpty() || destination.isEmpty()) {
+        fputs(qPrintable(TU::tr("a module file and destination are required for export\n")), stderr);
+        return Result::badArguments;
+    }
+
+    int songIndex = 0;
+    int loops = 1;
+    int samplerate = TU::DEFAULT_SAMPLERATE;
+    if (!TU::parseInt(parser, mSongOption, 0, 255, songIndex) ||
+        !TU::parseInt(parser, mLoopsOption, 1, 1000, loops) ||
+        !TU::parseInt(parser, mSamplerateOption, TU::MIN_SAMPLERATE, TU::MAX_SAMPLERATE, samplerate)) {
+        return Result::badArguments;
+    }
+
+    auto format = Wav::Format::float32;
+    if (parser.isSet(mFormatOption)) {
+        auto const value = parser.value(mFormatOption);
+        if (value == QStringLiteral("16")) {
+            format = Wav::Format::pcm16;
+        } else if (value == QStringLiteral("24")) {
+            format = Wav::Format::pcm24;
+        } else if (value != QStringLiteral("float")) {
+            fprintf(stderr, "%s\n", qPrintable(TU::tr("invalid format: %1").arg(value)));
+            return Result::badArguments;
+        }
+    }
+
+    std::optional<double> normalizeTarget;
+    if (parser.isSet(mNormalizeOption)) {
+        bool ok;
+        auto const value = parser.value(mNormalizeOption).toDouble(&ok);
+        if (!ok || value < TU::MIN_LOUDNESS || value > TU::MAX_LOUDNESS) {
+            fprintf(stderr, "%s\n", qPrintable(
+                TU::tr("invalid value for --normalize, expected %1 to %2")
+                    .arg(TU::MIN_LOUDNESS)
+                    .arg(TU::MAX_LOUDNESS)));
+            return Result::badArguments;
+        }
+        normalizeTarget = value;
+    }
+
+    Module mod;
+    ModuleFile file;
+    if (!file.open(moduleFile, mod)) {
+        fprintf(stderr, "%s\n", qPrintable(TU::tr("could not open module: %1").arg(moduleFile)));
+        return Result::openFailed;
+    }
+
+    if ((size_t)songIndex >= mod.data().songs().size()) {
+        fprintf(stderr, "%s\n", qPrintable(TU::tr("module has no song %1").arg(songIndex)));
+        return Result::badArguments;
+    }
+    mod.setSong(songIndex);
+
+    WavExporter exporter(mod, samplerate);
+    exporter.setDuration(loops);
+    exporter.setMappedOutput(parser.isSet(mMmapOption));
+    exporter.setFormat(format);
+    exporter.setDither(parser.isSet(mDitherOption));
+    exporter.setFlac(destination.endsWith(QStringLiteral(".flac"), Qt::CaseInsensitive));
+    exporter.setAnalyze(parser.isSet(mAnalyzeOption));
+    exporter.setNormalize(normalizeTarget);
+    if (parser.isSet(mStemsOption)) {
+        // stems go next to the destination, named after it
+        QFileInfo info(destination);
+        exporter.setSeparate(true);
+        exporter.setDestination(info.absolutePath());
+        exporter.setSeparatePrefix(info.completeBaseName());
+    } else {
+        exporter.setDestination(destination);
+    }
+
+    // no event loop is needed, just wait for the export to finish
+    exporter.start();
+    exporter.wait();
+
+    if (exporter.failed()) {
+        fprintf(stderr, "%s\n", qPrintable(TU::tr("export failed: %1").arg(destination)));
+        return Result::exportFailed;
+    }
+    if (auto const clipped = exporter.clipCount()) {
+        fprintf(stderr, "%s\n", qPrintable(TU::tr("%1 sample(s) clipped").arg(clipped)));
+    }
+    for (auto const& file : exporter.levels()) {
+        printf("%s\n", qPrintable(TU::tr("%1: peak %2 dBFS, RMS %3 dBFS, loudness %4 LUFS").arg(
+            file.filename,
+            TU::formatLevel(file.levels.peak),
+            TU::formatLevel(file.levels.rms),
+            TU::formatLevel(file.levels.loudness))));
+    }
+    return Result::success;
+}
+
+#undef TU
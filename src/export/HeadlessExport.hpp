@@ -0,0 +1,71 @@
+
+#pragma once
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+
+//
+// Command-line export. Exports a module to wav without creating the GUI or
+// opening an audio device, so that modules can be rendered from scripts:
+//
+//   trackerboy --export-wav out.wav [--song 0] [--loops 1] [--samplerate 44100] [--stems] module.tbm
+//
+// The files are written as 32-bit float unless --format 16 or --format 24 is
+// given, --dither adds dither to these. The number of clipped samples is
+// reported on stderr. A destination ending in .flac is encoded as FLAC, in
+// 16-bit unless --format 24 is given.
+//
+// --analyze reports the peak, RMS and integrated loudness of each file on
+// stdout, measured while rendering. --normalize LUFS renders each file twice
+// to bring it to the given loudness, and reports its levels as well.
+//
+// With --stems, each channel is exported to its own file next to the
+// destination, named after it (out.ch1.wav, out.ch2.wav, ...).
+//
+class HeadlessExport {
+
+public:
+
+    enum class Result {
+        success,
+        badArguments,
+        openFailed,
+        exportFailed
+    };
+
+    HeadlessExport();
+
+    //
+    // Determines if a headless export was requested by the given arguments.
+    // This is checked before the application is created, so that no GUI is
+    // created for an export.
+    //
+    static bool isRequested(int argc, char *argv[]);
+
+    //
+    // Adds the export options to the given parser.
+    //
+    void addOptions(QCommandLineParser &parser);
+
+    //
+    // Exports the given module file using the options from the parser. Errors
+    // are written to stderr.
+    //
+    Result run(QCommandLineParser const& parser, QString const& moduleFile);
+
+private:
+
+    Q_DISABLE_COPY(HeadlessExport)
+
+    QCommandLineOption mExportWavOption;
+    QCommandLineOption mSongOption;
+    QCommandLineOption mLoopsOption;
+    QCommandLineOption mSamplerateOption;
+    QCommandLineOption mStemsOption;
+    QCommandLineOption mMmapOption;
+    QCommandLineOption mFormatOption;
+    QCommandLineOption mDitherOption;
+    QCommandLineOption mAnalyzeOption;
+    QCommandLineOption mNormalizeOption;
+
+};
@@ -0,0 +1,67 @@
+
+#include "export/MeterSink.hpp"
+
+#include <algorithm>
+
+
+MeterSink::MeterSink(int samplerate, RenderSink *downstream) :
+    mDownstream(downstream),
+    mMeter(samplerate),
+    mGain(1.0f),
+    mAcquired(nullptr),
+    mScratch()
+{
+}
+
+void MeterSink::setGain(float gain) {
+    mGain = gain;
+}
+
+LoudnessMeter const& MeterSink::meter() const {
+    return mMeter;
+}
+
+void MeterSink::begin(size_t frames) {
+    mMeter.reset();
+    if (mDownstream) {
+        mDownstream->begin(frames);
+    }
+}
+
+float* MeterSink::acquire(size_t frames) {
+    mAcquired = mDownstream ? mDownstream->acquire(frames) : nullptr;
+    return mAcquired;
+}
+
+bool MeterSink::commit(size_t frames) {
+    applyGain(mAcquired, frames);
+    mMeter.process(mAcquired, frames);
+    mAcquired = nullptr;
+    return mDownstream->commit(frames);
+}
+
+bool MeterSink::write(float const *samples, size_t frames) {
+    if (mGain != 1.0f) {
+        mScratch.assign(samples, samples + (frames * 2));
+        applyGain(mScratch.data(), frames);
+        samples = mScratch.data();
+    }
+    mMeter.process(samples, frames);
+    return mDownstream ? mDownstream->write(samples, frames) : true;
+}
+
+void MeterSink::end() {
+    if (mDownstream) {
+        mDownstream->end();
+    }
+}
+
+void MeterSink::applyGain(float *samples, size_t frames) {
+    if (mGain != 1.0f) {
+        auto const gain = mGain;
+        std::transform(samples, samples + (frames * 2), samples,
+            [gain](float sample) {
+                return sample * gain;
+            });
+    }
+}
@@ -0,0 +1,54 @@
+
+#pragma once
+
+#include "audio/LoudnessMeter.hpp"
+#include "export/OfflineRenderer.hpp"
+
+#include <cstddef>
+#include <vector>
+
+//
+// Measures the levels of the rendered samples on their way to another sink,
+// optionally applying a gain first so that the levels are those of the
+// output. Without a downstream sink, the samples are only measured.
+//
+// When the downstream sink provides storage, the samples are measured and
+// scaled in place before being committed, so no copy is made.
+//
+class MeterSink : public RenderSink {
+
+public:
+
+    explicit MeterSink(int samplerate, RenderSink *downstream = nullptr);
+
+    //
+    // Linear gain applied to the samples, 1 by default.
+    //
+    void setGain(float gain);
+
+    LoudnessMeter const& meter() const;
+
+    virtual void begin(size_t frames) override;
+
+    virtual float* acquire(size_t frames) override;
+
+    virtual bool commit(size_t frames) override;
+
+    virtual bool write(float const *samples, size_t frames) override;
+
+    virtual void end() override;
+
+private:
+
+    void applyGain(float *samples, size_t frames);
+
+    RenderSink *mDownstream;
+    LoudnessMeter mMeter;
+    float mGain;
+
+    // storage acquired from the downstream sink
+    float *mAcquired;
+    // for scaling samples given to write()
+    std::vector<float> mScratch;
+
+};
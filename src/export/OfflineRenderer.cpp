@@ -0,0 +1,299 @@
+
+#include "export/OfflineRenderer.hpp"
+
+#include "audio/FanoutApu.hpp"
+
+#include "trackerboy/apu/DefaultApu.hpp"
+#include "trackerboy/Synth.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <variant>
+
+#define TU OfflineRendererTU
+namespace TU {
+
+//
+// An extra output for a single pass render, driven by the engine's APU.
+//
+struct Stem {
+
+    Stem(trackerboy::Module const& mod, int samplerate) :
+        apu(),
+        synth(apu, samplerate, mod.framerate())
+    {
+    }
+
+    trackerboy::DefaultApu apu;
+    trackerboy::Synth synth;
+};
+
+//
+// Locks the given channels for music playback, the rest are unlocked.
+//
+void lockChannels(trackerboy::Engine &engine, ChannelOutput::Flags channels) {
+    for (int ch = 0; ch < 4; ++ch) {
+        if (channels.testFlag((ChannelOutput::Flag)(1 << ch))) {
+            engine.lock(static_cast<trackerboy::ChType>(ch));
+        } else {
+            engine.unlock(static_cast<trackerboy::ChType>(ch));
+        }
+    }
+}
+
+}
+
+void RenderSink::begin(size_t frames) {
+    (void)frames;
+}
+
+float* RenderSink::acquire(size_t frames) {
+    (void)frames;
+    return nullptr;
+}
+
+bool RenderSink::commit(size_t frames) {
+    (void)frames;
+    return true;
+}
+
+void RenderSink::end() {
+}
+
+BufferSink::BufferSink() :
+    mSamples(),
+    mFrames(0)
+{
+}
+
+std::vector<float> const& BufferSink::samples() const {
+    return mSamples;
+}
+
+std::vector<float> BufferSink::take() {
+    mFrames = 0;
+    return std::move(mSamples);
+}
+
+void BufferSink::begin(size_t frames) {
+    mSamples.clear();
+    mSamples.reserve(frames * 2);
+    mFrames = 0;
+}
+
+float* BufferSink::acquire(size_t frames) {
+    // only grows past the reservation if the expected length was short
+    mSamples.resize((mFrames + frames) * 2);
+    return mSamples.data() + (mFrames * 2);
+}
+
+bool BufferSink::commit(size_t frames) {
+    mFrames += frames;
+    mSamples.resize(mFrames * 2);
+    return true;
+}
+
+bool BufferSink::write(float const *samples, size_t frames) {
+    mSamples.insert(mSamples.end(), samples, samples + (frames * 2));
+    mFrames += frames;
+    return true;
+}
+
+CallbackSink::CallbackSink(Callback callback) :
+    mCallback(std::move(callback))
+{
+}
+
+bool CallbackSink::write(float const *samples, size_t frames) {
+    return mCallback(samples, frames);
+}
+
+FileSink::FileSink(SampleWriter &file) :
+    mFile(file)
+{
+}
+
+bool FileSink::write(float const *samples, size_t frames) {
+    mFile.write(samples, frames);
+    return mFile.good();
+}
+
+
+OfflineRenderer::OfflineRenderer(trackerboy::Module const& mod, int samplerate) :
+    mModule(mod),
+    mSamplerate(samplerate),
+    mSong(0),
+    mDuration(1),
+    mChannels(ChannelOutput::AllOn),
+    mExpectedFrames()
+{
+}
+
+void OfflineRenderer::setSong(int index) {
+    mSong = index;
+    mExpectedFrames.reset();
+}
+
+void OfflineRenderer::setDuration(trackerboy::Player::Duration duration) {
+    mDuration = duration;
+    mExpectedFrames.reset();
+}
+
+void OfflineRenderer::setChannels(ChannelOutput::Flags channels) {
+    mChannels = channels;
+}
+
+int OfflineRenderer::samplerate() const {
+    return mSamplerate;
+}
+
+size_t OfflineRenderer::expectedFrames() const {
+    if (!mExpectedFrames) {
+        mExpectedFrames = countFrames();
+    }
+    return *mExpectedFrames;
+}
+
+size_t OfflineRenderer::countFrames() const {
+    // samples per engine frame, rounded up
+    auto const frameSamples = (size_t)std::ceil(mSamplerate / (double)mModule.framerate());
+
+    if (auto secs = std::get_if<std::chrono::seconds>(&mDuration)) {
+        // one extra engine frame in case the last one is partial
+        return (size_t)secs->count() * mSamplerate + frameSamples;
+    }
+
+    auto const song = this->song();
+    if (song == nullptr) {
+        return 0;
+    }
+
+    // step through the song without an APU being run, register writes are
+    // just stored
+    trackerboy::DefaultApu apu;
+    trackerboy::Engine engine(apu, &mModule);
+    engine.setSong(song);
+    trackerboy::Player player(engine);
+    player.start(mDuration);
+    size_t frames = 0;
+    for (;;) {
+        player.step();
+        if (!player.isPlaying()) {
+            break;
+        }
+        ++frames;
+    }
+    return frames * frameSamples;
+}
+
+int OfflineRenderer::progressMax() const {
+    auto const song = this->song();
+    if (song == nullptr) {
+        return 0;
+    }
+
+    trackerboy::DefaultApu apu;
+    trackerboy::Engine engine(apu, &mModule);
+    engine.setSong(song);
+    trackerboy::Player player(engine);
+    player.start(mDuration);
+    return player.progressMax();
+}
+
+bool OfflineRenderer::render(RenderSink &sink, ProgressCallback const& progress) {
+    Output const output{ mChannels, &sink };
+    return render(&output, 1, progress);
+}
+
+bool OfflineRenderer::render(Output const *outputs, size_t count, ProgressCallback const& progress) {
+    assert(count > 0);
+
+    auto const song = this->song();
+    if (song == nullptr) {
+        return false;
+    }
+
+    // the first output is the engine's APU, the others receive its register
+    // writes
+    FanoutApu apu(outputs[0].channels);
+    trackerboy::Synth synth(apu, mSamplerate, mModule.framerate());
+    std::vector<std::unique_ptr<TU::Stem>> stems;
+    stems.reserve(count - 1);
+    ChannelOutput::Flags channels = outputs[0].channels;
+    for (size_t i = 1; i < count; ++i) {
+        auto &stem = stems.emplace_back(std::make_unique<TU::Stem>(mModule, mSamplerate));
+        apu.addOutput(stem->apu, outputs[i].channels);
+        channels |= outputs[i].channels;
+    }
+
+    trackerboy::Engine engine(apu, &mModule);
+    engine.setSong(song);
+    // every channel of an output is played, the APUs pick which ones they
+    // output
+    TU::lockChannels(engine, channels);
+
+    trackerboy::Player player(engine);
+    player.start(mDuration);
+
+    auto const expected = expectedFrames();
+    for (size_t i = 0; i < count; ++i) {
+        outputs[i].sink->begin(expected);
+    }
+
+    // for sinks that don't provide their own storage
+    std::vector<float> buffer(synth.framesize() * 2);
+
+    auto const output = [&buffer](trackerboy::DefaultApu &outApu, trackerboy::Synth &outSynth, RenderSink &sink) {
+        outSynth.run();
+        auto const frames = outSynth.framesize();
+        if (auto dest = sink.acquire(frames)) {
+            return sink.commit(outApu.readSamples(dest, frames));
+        }
+        auto const samplesRead = outApu.readSamples(buffer.data(), frames);
+        return sink.write(buffer.data(), samplesRead);
+    };
+
+    auto const run = [&]() {
+        for (;;) {
+
+            if (progress && !progress(player.progress())) {
+                return false;
+            }
+
+            // the engine steps once for all of the outputs
+            player.step();
+            if (!player.isPlaying()) {
+                return true;
+            }
+
+            if (!output(apu, synth, *outputs[0].sink)) {
+                return false;
+            }
+            for (size_t i = 1; i < count; ++i) {
+                auto &stem = *stems[i - 1];
+                if (!output(stem.apu, stem.synth, *outputs[i].sink)) {
+                    return false;
+                }
+            }
+
+        }
+    };
+
+    auto const completed = run();
+    for (size_t i = 0; i < count; ++i) {
+        outputs[i].sink->end();
+    }
+    return completed;
+}
+
+trackerboy::Song const* OfflineRenderer::song() const {
+    auto const& songs = mModule.songs();
+    if (mSong < 0 || (size_t)mSong >= songs.size()) {
+        return nullptr;
+    }
+    return songs.get(mSong);
+}
+
+#undef TU
@@ -0,0 +1,198 @@
+
+#pragma once
+
+#include "audio/SampleWriter.hpp"
+#include "core/ChannelOutput.hpp"
+
+#include "trackerboy/data/Module.hpp"
+#include "trackerboy/export/Player.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <vector>
+
+//
+// Destination for samples rendered by an OfflineRenderer. Samples are
+// always interleaved stereo, sizes are given in frames (sample pairs).
+//
+class RenderSink {
+
+public:
+    virtual ~RenderSink() = default;
+
+    //
+    // Called once before rendering with the expected number of frames, an
+    // upper bound for preallocating. 0 if unknown.
+    //
+    virtual void begin(size_t frames);
+
+    //
+    // Returns storage for the given number of frames for the renderer to
+    // read samples into, or nullptr to receive them through write(). Sinks
+    // that keep the samples in memory avoid a copy this way.
+    //
+    virtual float* acquire(size_t frames);
+
+    //
+    // Called after samples were read into the storage from acquire(),
+    // frames may be less than requested. Returns false to stop rendering.
+    //
+    virtual bool commit(size_t frames);
+
+    //
+    // Receives samples when acquire() returned nullptr. Returns false to stop
+    // rendering.
+    //
+    virtual bool write(float const *samples, size_t frames) = 0;
+
+    //
+    // Called once after rendering, whether it completed or was stopped.
+    //
+    virtual void end();
+
+};
+
+//
+// Keeps the rendered samples in memory, reserved for the expected length.
+//
+class BufferSink : public RenderSink {
+
+public:
+    BufferSink();
+
+    std::vector<float> const& samples() const;
+
+    //
+    // Moves the samples out of the sink
+    //
+    std::vector<float> take();
+
+    virtual void begin(size_t frames) override;
+
+    virtual float* acquire(size_t frames) override;
+
+    virtual bool commit(size_t frames) override;
+
+    virtual bool write(float const *samples, size_t frames) override;
+
+private:
+    std::vector<float> mSamples;
+    // frames in mSamples, which is larger while acquired
+    size_t mFrames;
+};
+
+//
+// Passes the rendered samples to a function.
+//
+class CallbackSink : public RenderSink {
+
+public:
+    using Callback = std::function<bool(float const *samples, size_t frames)>;
+
+    explicit CallbackSink(Callback callback);
+
+    virtual bool write(float const *samples, size_t frames) override;
+
+private:
+    Callback mCallback;
+};
+
+//
+// Writes the rendered samples to a file, see Wav and Flac.
+//
+class FileSink : public RenderSink {
+
+public:
+    explicit FileSink(SampleWriter &file);
+
+    virtual bool write(float const *samples, size_t frames) override;
+
+private:
+    SampleWriter &mFile;
+};
+
+//
+// Renders a song of a module without a device, GUI or event loop. Used by
+// the exporters, and by anything else that needs a song as samples.
+//
+// A render creates its own APU, synth and engine, so separate renderers can
+// be used from different threads on the same module.
+//
+class OfflineRenderer {
+
+public:
+
+    //
+    // Called before every engine frame with the player's progress, out of
+    // progressMax(). Returns false to stop rendering.
+    //
+    using ProgressCallback = std::function<bool(int progress)>;
+
+    //
+    // A sink and the channels it receives, for rendering several outputs in
+    // a single pass.
+    //
+    struct Output {
+        ChannelOutput::Flags channels;
+        RenderSink *sink;
+    };
+
+    explicit OfflineRenderer(trackerboy::Module const& mod, int samplerate = 44100);
+
+    //
+    // Index of the song to render in the module's song list, 0 by default.
+    //
+    void setSong(int index);
+
+    //
+    // Number of loops or time to render, 1 loop by default.
+    //
+    void setDuration(trackerboy::Player::Duration duration);
+
+    //
+    // Channels to render with render(RenderSink&), all by default.
+    //
+    void setChannels(ChannelOutput::Flags channels);
+
+    int samplerate() const;
+
+    //
+    // Upper bound of the number of frames a render will produce. For a loop
+    // duration, the song is stepped through without synthesis to count its
+    // engine frames. The result is kept until the song or duration changes.
+    //
+    size_t expectedFrames() const;
+
+    //
+    // The maximum progress reported while rendering.
+    //
+    int progressMax() const;
+
+    //
+    // Renders the song to the sink. Returns false if the song does not
+    // exist, or the sink or progress callback stopped the render.
+    //
+    bool render(RenderSink &sink, ProgressCallback const& progress = {});
+
+    //
+    // Renders the song once to each of the given outputs, with a single
+    // engine driving an APU per output (see FanoutApu).
+    //
+    bool render(Output const *outputs, size_t count, ProgressCallback const& progress = {});
+
+private:
+
+    trackerboy::Song const* song() const;
+
+    size_t countFrames() const;
+
+    trackerboy::Module const& mModule;
+    int mSamplerate;
+    int mSong;
+    trackerboy::Player::Duration mDuration;
+    ChannelOutput::Flags mChannels;
+
+    mutable std::optional<size_t> mExpectedFrames;
+
+};
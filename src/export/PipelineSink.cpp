@@ -0,0 +1,129 @@
+
+#include "export/PipelineSink.hpp"
+
+#include <algorithm>
+
+
+PipelineSink::PipelineSink(RenderSink &downstream, size_t bufferFrames) :
+    mDownstream(downstream),
+    mBuffer(),
+    mMutex(),
+    mChanged(),
+    mDone(false),
+    mStopped(false),
+    mWriter()
+{
+    mBuffer.init(bufferFrames);
+}
+
+PipelineSink::~PipelineSink() {
+    if (mWriter.joinable()) {
+        end();
+    }
+}
+
+void PipelineSink::begin(size_t frames) {
+    if (mWriter.joinable()) {
+        end();
+    }
+
+    mBuffer.reset();
+    mDone = false;
+    mStopped = false;
+    mDownstream.begin(frames);
+    mWriter = std::thread(&PipelineSink::writeLoop, this);
+}
+
+float* PipelineSink::acquire(size_t frames) {
+    if (frames > mBuffer.size() || !waitForSpace(frames)) {
+        // too large for the buffer, or stopped, write() handles both
+        return nullptr;
+    }
+
+    auto count = frames;
+    auto dest = mBuffer.writer().acquireWrite(count);
+    // the free space wraps around the end of the storage, use write() to
+    // copy it in two parts
+    return count == frames ? dest : nullptr;
+}
+
+bool PipelineSink::commit(size_t frames) {
+    mBuffer.writer().commitWrite(frames);
+    notify();
+    return !mStopped;
+}
+
+bool PipelineSink::write(float const *samples, size_t frames) {
+    auto writer = mBuffer.writer();
+    while (frames) {
+        if (!waitForSpace(1)) {
+            return false;
+        }
+        auto const written = writer.write(samples, frames);
+        samples += written * 2;
+        frames -= written;
+        notify();
+    }
+    return !mStopped;
+}
+
+void PipelineSink::end() {
+    if (!mWriter.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard lock(mMutex);
+        mDone = true;
+    }
+    mChanged.notify_one();
+    mWriter.join();
+    mDownstream.end();
+}
+
+void PipelineSink::writeLoop() {
+    auto reader = mBuffer.reader();
+
+    for (;;) {
+        auto count = mBuffer.size();
+        auto const samples = reader.acquireRead(count);
+        if (count == 0) {
+            std::unique_lock lock(mMutex);
+            mChanged.wait(lock, [this, &reader]() {
+                return mDone || reader.availableRead() > 0;
+            });
+            if (mDone && reader.availableRead() == 0) {
+                break;
+            }
+            continue;
+        }
+
+        // once stopped, samples are discarded so that the renderer never
+        // waits on a full buffer
+        if (!mStopped && !mDownstream.write(samples, count)) {
+            mStopped = true;
+        }
+        reader.commitRead(count);
+        notify();
+    }
+}
+
+bool PipelineSink::waitForSpace(size_t frames) {
+    auto writer = mBuffer.writer();
+    if (writer.availableWrite() < frames) {
+        std::unique_lock lock(mMutex);
+        mChanged.wait(lock, [this, &writer, frames]() {
+            return mStopped || writer.availableWrite() >= frames;
+        });
+    }
+    return !mStopped;
+}
+
+void PipelineSink::notify() {
+    // taking the lock orders the buffer change before the other thread's
+    // check, so that it cannot miss the wakeup
+    {
+        std::lock_guard lock(mMutex);
+    }
+    mChanged.notify_one();
+}
@@ -0,0 +1,84 @@
+
+#pragma once
+
+#include "audio/Ringbuffer.hpp"
+#include "export/OfflineRenderer.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+//
+// Runs another sink on its own thread, so that rendering and writing overlap.
+// The renderer synthesizes directly into a ringbuffer, which a writer thread
+// drains into the downstream sink. Format conversion, dithering, encoding and
+// file I/O all happen on the writer thread, so an export runs at the speed of
+// the slower stage rather than the sum of both.
+//
+// The renderer waits when the buffer is full and the writer waits when it is
+// empty. If the downstream sink stops, the next commit or write returns false.
+//
+class PipelineSink : public RenderSink {
+
+public:
+
+    // default buffer size in frames, about 0.75 seconds at 44100 Hz
+    static constexpr size_t DEFAULT_FRAMES = 32768;
+
+    explicit PipelineSink(RenderSink &downstream, size_t bufferFrames = DEFAULT_FRAMES);
+
+    //
+    // Waits for the writer thread if end() was not called.
+    //
+    virtual ~PipelineSink();
+
+    virtual void begin(size_t frames) override;
+
+    virtual float* acquire(size_t frames) override;
+
+    virtual bool commit(size_t frames) override;
+
+    virtual bool write(float const *samples, size_t frames) override;
+
+    //
+    // Waits for the writer thread to pass the remaining samples downstream.
+    //
+    virtual void end() override;
+
+private:
+
+    PipelineSink(PipelineSink const& sink) = delete;
+    PipelineSink& operator=(PipelineSink const& sink) = delete;
+
+    //
+    // Writer thread, drains the buffer until end() is called.
+    //
+    void writeLoop();
+
+    //
+    // Waits until the given number of frames can be written or the downstream
+    // sink has stopped. Returns false for the latter.
+    //
+    bool waitForSpace(size_t frames);
+
+    //
+    // Wakes the other thread after the buffer changed.
+    //
+    void notify();
+
+    RenderSink &mDownstream;
+    Ringbuffer<float, 2> mBuffer;
+
+    // guards mDone, and the waits on the buffer
+    std::mutex mMutex;
+    std::condition_variable mChanged;
+    bool mDone;
+
+    // set by the writer thread when the downstream sink stops
+    std::atomic_bool mStopped;
+
+    std::thread mWriter;
+
+};
@@ -1,12 +1,20 @@
 
 #include "export/WavExporter.hpp"
 
+#include "audio/Flac.hpp"
 #include "audio/Wav.hpp"
+#include "export/MeterSink.hpp"
+#include "export/OfflineRenderer.hpp"
+#include "export/PipelineSink.hpp"
 
 #include <QDir>
 #include <QFileInfo>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <thread>
+#include <vector>
 
 
 
@@ -16,18 +24,28 @@ WavExporter::WavExporter(
     QObject *parent
 ) :
     QThread(parent),
+    mModule(mod),
     mSamplerate(samplerate),
-    mApu(),
-    mSynth(mApu, samplerate, mod.data().framerate()),
-    mEngine(mApu, &mod.data()),
     mDuration(0),
     mChannels(ChannelOutput::AllOn),
     mSeparate(false),
     mDestination(),
+    mSeparatePrefix(),
+    mSeparateMix(false),
+    mSinglePass(false),
+    mSongs(),
+    mMappedOutput(false),
+    mFormat(Wav::Format::float32),
+    mDither(false),
+    mFlac(false),
+    mAnalyze(false),
+    mNormalizeTarget(),
     mFailed(false),
-    mAbort(false)
+    mAbort(false),
+    mProgress(1),
+    mClipped(0),
+    mLevels()
 {
-    mEngine.setSong(mod.song());
 }
 
 void WavExporter::setDuration(trackerboy::Player::Duration duration) {
@@ -39,12 +57,11 @@ void WavExporter::setDestination(QString const& dest) {
 }
 
 bool WavExporter::failed() const {
-    return mFailed;
+    return mFailed.load(std::memory_order_relaxed);
 }
 
 void WavExporter::cancel() {
-    QMutexLocker locker(&mMutex);
-    mAbort = true;
+    mAbort.store(true, std::memory_order_relaxed);
 }
 
 void WavExporter::setChannels(ChannelOutput::Flags channels) {
@@ -59,12 +76,69 @@ void WavExporter::setSeparatePrefix(QString const& prefix) {
     mSeparatePrefix = prefix;
 }
 
+void WavExporter::setSeparateMix(bool mix) {
+    mSeparateMix = mix;
+}
+
+void WavExporter::setSinglePass(bool singlePass) {
+    mSinglePass = singlePass;
+}
+
+void WavExporter::setSongs(QVector<int> const& songs) {
+    mSongs = songs;
+    // one counter per song, or one for the current song
+    mProgress = std::vector<std::atomic_int>(std::max(1, (int)songs.size()));
+}
+
+int WavExporter::progress(int song) const {
+    if (song < 0 || (size_t)song >= mProgress.size()) {
+        return 0;
+    }
+    return mProgress[song].load(std::memory_order_relaxed);
+}
+
+void WavExporter::setMappedOutput(bool mapped) {
+    mMappedOutput = mapped;
+}
+
+void WavExporter::setFormat(Wav::Format format) {
+    mFormat = format;
+}
+
+void WavExporter::setDither(bool dither) {
+    mDither = dither;
+}
+
+void WavExporter::setFlac(bool flac) {
+    mFlac = flac;
+}
+
+void WavExporter::setAnalyze(bool analyze) {
+    mAnalyze = analyze;
+}
+
+void WavExporter::setNormalize(std::optional<double> targetLoudness) {
+    mNormalizeTarget = targetLoudness;
+}
+
+std::vector<WavExporter::FileLevels> const& WavExporter::levels() const {
+    return mLevels;
+}
+
+size_t WavExporter::clipCount() const {
+    return mClipped.load(std::memory_order_relaxed);
+}
+
 #define TU WavExporterTU
 namespace TU {
 
-struct Batch {
-    QString filename;
-    ChannelOutput::Flags channels;
+//
+// A unit of work for a worker: a single batch, or all of a song's batches
+// for a single pass export.
+//
+struct Job {
+    int first;
+    int count;
 };
 
 }
@@ -72,99 +146,290 @@ struct Batch {
 
 void WavExporter::run() {
 
-    // batches for this run
-    std::array<TU::Batch, 4> batches;
-    int batchCount = 0;
-    if (mSeparate) {
-        // separate channel per file, each channel gets its own batch
-        auto iter = batches.begin();
-
-        QDir dest(mDestination);
-
-        for (int i = 0; i < 4; ++i) {
-            auto const flag = (ChannelOutput::Flag)(1 << i);
-            if (mChannels.testFlag(flag)) {
-                iter->channels = flag;
-                iter->filename = dest.filePath(
-                    QStringLiteral("%1.ch%2.wav").arg(
-                        mSeparatePrefix,
-                        QString::number(i + 1)
-                    ));
-                ++iter;
+    // songs for this run, the current one if none were given
+    auto const& songList = mModule.data().songs();
+    std::vector<int> songs;
+    if (mSongs.isEmpty()) {
+        for (int index = 0; index < (int)songList.size(); ++index) {
+            if (songList.get(index) == mModule.song()) {
+                songs.push_back(index);
+                break;
             }
         }
-
-        batchCount = iter - batches.begin();
     } else {
-        // one file, one batch
-        batchCount = 1;
-        batches[0].filename = mDestination;
-        batches[0].channels = mChannels;
+        for (auto index : mSongs) {
+            if (index >= 0 && (size_t)index < songList.size()) {
+                songs.push_back(index);
+            }
+        }
     }
+    if (songs.empty()) {
+        mFailed.store(true, std::memory_order_relaxed);
+        return;
+    }
+    // when exporting more than one song, the song's number is added to its
+    // files to tell them apart
+    auto const numbered = songs.size() > 1;
+
+    // batches for this run, grouped by song
+    std::vector<Batch> batches;
+    std::vector<TU::Job> jobs;
+    for (int slot = 0; slot < (int)songs.size(); ++slot) {
+        auto const song = songs[slot];
+        auto const first = (int)batches.size();
+
+        if (mSeparate) {
+            // separate channel per file, each channel gets its own batch
+            QDir dest(mDestination);
+            auto const extension = mFlac ? QStringLiteral("flac") : QStringLiteral("wav");
+            auto prefix = mSeparatePrefix;
+            if (numbered) {
+                prefix += QStringLiteral(".song%1").arg(song + 1);
+            }
 
-    // temporary buffer for transferring samples from apu to the wav file
-    auto buffersize = mSynth.framesize() * 2;
-    auto buffer = std::make_unique<float[]>(buffersize);
-
-    for (int i = 0; i < batchCount; ++i) {
-
-        trackerboy::Player player(mEngine);
-        player.start(mDuration);
+            for (int i = 0; i < 4; ++i) {
+                auto const flag = (ChannelOutput::Flag)(1 << i);
+                if (mChannels.testFlag(flag)) {
+                    batches.push_back({
+                        dest.filePath(QStringLiteral("%1.ch%2.%3").arg(prefix, QString::number(i + 1), extension)),
+                        flag,
+                        song,
+                        slot
+                    });
+                }
+            }
 
-        auto const channels = batches[i].channels;
-        for (int ch = 0; ch < 4; ++ch) {
-            if (channels.testFlag((ChannelOutput::Flag)(1 << ch))) {
-                mEngine.lock(static_cast<trackerboy::ChType>(ch));
-            } else {
-                mEngine.unlock(static_cast<trackerboy::ChType>(ch));
+            if (mSeparateMix) {
+                // all of the selected channels, as a single file would have
+                batches.push_back({
+                    dest.filePath(QStringLiteral("%1.mix.%2").arg(prefix, extension)),
+                    mChannels,
+                    song,
+                    slot
+                });
+            }
+        } else {
+            // one file, one batch
+            auto filename = mDestination;
+            if (numbered) {
+                QFileInfo info(mDestination);
+                filename = info.dir().filePath(QStringLiteral("%1.song%2.%3").arg(
+                    info.completeBaseName(),
+                    QString::number(song + 1),
+                    info.suffix()
+                ));
             }
+            batches.push_back({ filename, mChannels, song, slot });
         }
 
+        auto const count = (int)batches.size() - first;
+        if (mSeparate && mSinglePass) {
+            jobs.push_back({ first, count });
+        } else {
+            for (int i = first; i < first + count; ++i) {
+                jobs.push_back({ i, 1 });
+            }
+        }
+    }
 
-        Wav wav(batches[i].filename.toStdString(), 2, mSamplerate);
-        if (!wav.stream().good()) {
-            mFailed = true;
-            return;
+    mFailed.store(false, std::memory_order_relaxed);
+    mAbort.store(false, std::memory_order_relaxed);
+    for (auto &songProgress : mProgress) {
+        songProgress.store(0, std::memory_order_relaxed);
+    }
+    mClipped.store(0, std::memory_order_relaxed);
+    // sized before the workers start, so that each can fill in its own
+    mLevels.clear();
+    if (mAnalyze || mNormalizeTarget) {
+        mLevels.resize(batches.size());
+        for (size_t i = 0; i < batches.size(); ++i) {
+            mLevels[i].filename = batches[i].filename;
         }
+    }
 
-        emit progressMax(player.progressMax());
-        auto lastProgress = player.progress();
-        emit progress(lastProgress);
+    // every batch of a song plays it for the same duration, so a song's total
+    // is a multiple of a single batch's progress. A single pass export steps
+    // through the song only once, and normalizing doubles the passes.
+    for (int slot = 0; slot < (int)songs.size(); ++slot) {
+        OfflineRenderer renderer(mModule.data(), mSamplerate);
+        renderer.setSong(songs[slot]);
+        renderer.setDuration(mDuration);
+        auto const passes = mSinglePass && mSeparate ? 1 : std::count_if(batches.begin(), batches.end(),
+            [slot](Batch const& batch) {
+                return batch.slot == slot;
+            });
+        auto const passMultiplier = mNormalizeTarget ? 2 : 1;
+        emit progressMax(slot, renderer.progressMax() * (int)passes * passMultiplier);
+    }
 
+    // workers take the next job until there are none left
+    std::atomic_int nextJob = 0;
+    auto work = [this, &batches, &jobs, &nextJob]() {
         for (;;) {
-
-            mMutex.lock();
-            if (mAbort) {
-                mAbort = false;
-                mMutex.unlock();
+            auto const i = nextJob.fetch_add(1, std::memory_order_relaxed);
+            if (i >= (int)jobs.size()) {
                 break;
             }
-            mMutex.unlock();
-
-            auto currentProgress = player.progress();
-            if (currentProgress != lastProgress) {
-                lastProgress = currentProgress;
-                emit progress(currentProgress);
+            auto const& job = jobs[i];
+            auto const levels = mLevels.empty() ? nullptr : mLevels.data() + job.first;
+            if (!exportBatches(batches.data() + job.first, job.count, levels)) {
+                break;
             }
+        }
+    };
+
+    // no more workers than jobs or cores, this thread is the first worker
+    auto const workerCount = std::clamp(QThread::idealThreadCount(), 1, (int)jobs.size());
+    std::vector<std::thread> threads;
+    threads.reserve(workerCount - 1);
+    for (int i = 1; i < workerCount; ++i) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+bool WavExporter::exportBatches(Batch const *batches, int count, FileLevels *levels) {
+
+    OfflineRenderer renderer(mModule.data(), mSamplerate);
+    renderer.setSong(batches[0].song);
+    renderer.setDuration(mDuration);
 
-            player.step();
-            if (!player.isPlaying()) {
+    std::vector<float> gains(count, 1.0f);
+    if (mNormalizeTarget && !measureGains(renderer, batches, count, gains)) {
+        return false;
+    }
+
+    std::vector<std::unique_ptr<SampleWriter>> files;
+    std::vector<std::unique_ptr<FileSink>> sinks;
+    std::vector<std::unique_ptr<PipelineSink>> pipelines;
+    std::vector<std::unique_ptr<MeterSink>> meters;
+    std::vector<OfflineRenderer::Output> outputs;
+    files.reserve(count);
+    sinks.reserve(count);
+    pipelines.reserve(count);
+    meters.reserve(count);
+    outputs.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        auto &file = files.emplace_back(openFile(batches[i], renderer.expectedFrames()));
+        if (!file->good()) {
+            fail();
+            return false;
+        }
+        auto &sink = sinks.emplace_back(std::make_unique<FileSink>(*file));
+        // conversion, encoding and writing happen on the pipeline's thread
+        auto &pipeline = pipelines.emplace_back(std::make_unique<PipelineSink>(*sink));
+        RenderSink *output = pipeline.get();
+        if (levels) {
+            // measured and scaled on the render thread, in the pipeline's
+            // buffer
+            auto &meter = meters.emplace_back(std::make_unique<MeterSink>(mSamplerate, output));
+            meter->setGain(gains[i]);
+            output = meter.get();
+        }
+        outputs.push_back({ batches[i].channels, output });
+    }
+
+    auto const slot = batches[0].slot;
+    int lastProgress = 0;
+    auto const completed = renderer.render(outputs.data(), outputs.size(),
+        [this, slot, &lastProgress](int progress) {
+            return updateProgress(slot, lastProgress, progress);
+        });
+
+    if (!completed) {
+        // either cancelled or a file could not be written
+        for (auto const& file : files) {
+            if (!file->good()) {
+                fail();
                 break;
             }
-            mSynth.run();
+        }
+        return false;
+    }
 
-            auto samplesRead = mApu.readSamples(buffer.get(), mSynth.framesize());
-            wav.write(buffer.get(), samplesRead);
-            if (!wav.stream().good()) {
-                mFailed = true;
-                return;
-            }
+    // the last of the data and the headers are only written now, a file
+    // isn't complete until this succeeds
+    auto finished = true;
+    for (auto const& file : files) {
+        finished = file->finish() && finished;
+    }
+    if (!finished) {
+        fail();
+        return false;
+    }
 
-        }
+    for (auto const& file : files) {
+        addClipped(*file);
+    }
+    for (size_t i = 0; i < meters.size(); ++i) {
+        levels[i].levels = meters[i]->meter().levels();
+    }
+    return true;
+}
+
+bool WavExporter::measureGains(OfflineRenderer &renderer, Batch const *batches, int count, std::vector<float> &gains) {
+    std::vector<std::unique_ptr<MeterSink>> meters;
+    std::vector<OfflineRenderer::Output> outputs;
+    meters.reserve(count);
+    outputs.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        auto &meter = meters.emplace_back(std::make_unique<MeterSink>(mSamplerate));
+        outputs.push_back({ batches[i].channels, meter.get() });
+    }
+
+    auto const slot = batches[0].slot;
+    int lastProgress = 0;
+    auto const completed = renderer.render(outputs.data(), outputs.size(),
+        [this, slot, &lastProgress](int progress) {
+            return updateProgress(slot, lastProgress, progress);
+        });
+    if (!completed) {
+        return false;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        auto const loudness = meters[i]->meter().levels().loudness;
+        gains[i] = (float)LoudnessMeter::normalizeGain(loudness, *mNormalizeTarget);
+    }
+    return true;
+}
 
-        mFailed = false;
+std::unique_ptr<SampleWriter> WavExporter::openFile(Batch const& batch, size_t expectedFrames) {
+    if (mFlac) {
+        auto flac = std::make_unique<Flac>(batch.filename.toStdString(), 2, mSamplerate, mFormat == Wav::Format::pcm24 ? 24 : 16);
+        flac->setDither(mDither);
+        return flac;
+    }
+
+    auto const mode = mMappedOutput ? Wav::Mode::mapped : Wav::Mode::buffered;
+    auto wav = std::make_unique<Wav>(batch.filename.toStdString(), 2, mSamplerate, mFormat, mode, expectedFrames);
+    wav->setDither(mDither);
+    return wav;
+}
 
+bool WavExporter::updateProgress(int slot, int &lastProgress, int currentProgress) {
+    // called every engine frame, so this is kept to a load and, when the
+    // progress changed, an add
+    if (mAbort.load(std::memory_order_relaxed)) {
+        return false;
     }
+    if (currentProgress != lastProgress) {
+        mProgress[slot].fetch_add(currentProgress - lastProgress, std::memory_order_relaxed);
+        lastProgress = currentProgress;
+    }
+    return true;
+}
+
+void WavExporter::addClipped(SampleWriter const& file) {
+    mClipped.fetch_add(file.clipCount(), std::memory_order_relaxed);
+}
+
+void WavExporter::fail() {
+    mFailed.store(true, std::memory_order_relaxed);
+    mAbort.store(true, std::memory_order_relaxed);
 }
 
 #undef TU
@@ -1,23 +1,42 @@
 
 #pragma once
 
+#include "audio/LoudnessMeter.hpp"
+#include "audio/Wav.hpp"
 #include "core/Module.hpp"
 #include "core/ChannelOutput.hpp"
 
-#include "trackerboy/apu/DefaultApu.hpp"
 #include "trackerboy/export/Player.hpp"
-#include "trackerboy/Synth.hpp"
 
 #include <QThread>
-#include <QMutex>
+#include <QVector>
+
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <vector>
+
+class OfflineRenderer;
 
 //
-// Worker thread for exporting a module to a wav file
+// Worker thread for exporting a module to a wav file. When exporting multiple
+// songs or channels to separate files, each file is rendered on its own
+// worker, up to one worker per core. Each file is written through a
+// PipelineSink, so that writing does not hold up rendering.
 //
 class WavExporter : public QThread {
     Q_OBJECT
 
 public:
+
+    //
+    // Levels measured for an exported file.
+    //
+    struct FileLevels {
+        QString filename;
+        LoudnessMeter::Levels levels;
+    };
+
     WavExporter(
         Module const& mod,
         int samplerate,
@@ -34,24 +53,149 @@ public:
 
     void setSeparatePrefix(QString const& prefix);
 
+    //
+    // When exporting channels separately, also export the selected channels
+    // mixed together to a file of its own.
+    //
+    void setSeparateMix(bool mix);
+
+    //
+    // When exporting channels separately, step the engine once for all of the
+    // files instead of once per file. The engine's register writes are sent
+    // to an APU for each file, which are run one after the other on a single
+    // thread.
+    //
+    void setSinglePass(bool singlePass);
+
+    //
+    // Sets the songs to export, by index in the module's song list. When more
+    // than one song is exported, the song's number is added to the name of
+    // its files (out.song1.wav, out.song2.wav, ...). The default, an empty
+    // list, exports the module's current song.
+    //
+    void setSongs(QVector<int> const& songs);
+
+    //
+    // Progress of a song, out of the maximum given by the progressMax signal.
+    // Safe to call from any thread while exporting, the GUI polls it instead
+    // of receiving a signal for every change.
+    //
+    int progress(int song) const;
+
+    //
+    // Write the wav files through a memory mapping instead of a buffered
+    // stream. The files are preallocated for the song's length, and the
+    // mapping is only used where supported.
+    //
+    void setMappedOutput(bool mapped);
+
+    //
+    // Sets the sample format of the exported files, 32-bit float by default.
+    //
+    void setFormat(Wav::Format format);
+
+    //
+    // Adds TPDF dither when exporting to an integer format.
+    //
+    void setDither(bool dither);
+
+    //
+    // Encode the files as FLAC instead of wav. FLAC only stores integer
+    // samples, 16-bit is used when the format is float32. Stems are named
+    // with the .flac extension.
+    //
+    void setFlac(bool flac);
+
+    //
+    // Measure the peak, RMS and loudness of each file while it is rendered,
+    // see levels(). Off by default.
+    //
+    void setAnalyze(bool analyze);
+
+    //
+    // Normalize each file to the given integrated loudness in LUFS, or no
+    // normalization for std::nullopt (the default). Each file is rendered
+    // twice: once to measure its loudness, then again with the gain applied.
+    // Files are measured when normalizing, as with setAnalyze.
+    //
+    void setNormalize(std::optional<double> targetLoudness);
+
+    //
+    // Levels of each exported file, empty unless analyzing or normalizing.
+    // Only valid once finished.
+    //
+    std::vector<FileLevels> const& levels() const;
+
+    //
+    // Total number of samples that clipped when converting to an integer
+    // format, over all files. Only valid once finished.
+    //
+    size_t clipCount() const;
+
     bool failed() const;
 
     void cancel();
 
 signals:
-    void progressMax(int max);
-    void progress(int amount);
+    // progress is reported per song, song being the position of the song in
+    // the list given by setSongs. The progress itself is polled, see
+    // progress().
+    void progressMax(int song, int max);
 
 protected:
     virtual void run() override;
 
 private:
-    QMutex mMutex;
 
+    struct Batch {
+        QString filename;
+        ChannelOutput::Flags channels;
+        // index of the song in the module
+        int song;
+        // position of the song in the export, for progress
+        int slot;
+    };
+
+    //
+    // Renders the given batches of a song with a single OfflineRenderer, a
+    // single batch unless exporting in a single pass (see setSinglePass()).
+    // Called from the workers. Returns false if the export failed or was
+    // cancelled. The levels of each batch's file are stored in levels when
+    // given.
+    //
+    bool exportBatches(Batch const *batches, int count, FileLevels *levels);
+
+    //
+    // First pass of a normalized export, renders without writing to get the
+    // gain for each batch. Returns false if cancelled.
+    //
+    bool measureGains(OfflineRenderer &renderer, Batch const *batches, int count, std::vector<float> &gains);
+
+    //
+    // Opens the wav or FLAC file for the given batch, with the format and
+    // output mode for this export. Mapped wav files are preallocated for the
+    // expected number of frames.
+    //
+    std::unique_ptr<SampleWriter> openFile(Batch const& batch, size_t expectedFrames);
+
+    //
+    // Adds the progress made since lastProgress to the song's total. Returns
+    // false if the export was cancelled.
+    //
+    bool updateProgress(int slot, int &lastProgress, int currentProgress);
+
+    //
+    // Adds a finished file's clip count to the total.
+    //
+    void addClipped(SampleWriter const& file);
+
+    //
+    // Marks the export as failed, stopping the other workers.
+    //
+    void fail();
+
+    Module const& mModule;
     int mSamplerate;
-    trackerboy::DefaultApu mApu;
-    trackerboy::Synth mSynth;
-    trackerboy::Engine mEngine;
 
     trackerboy::Player::Duration mDuration;
 
@@ -60,8 +204,25 @@ private:
 
     QString mDestination;
     QString mSeparatePrefix;
-
-    bool mFailed;
-    bool mAbort;
+    bool mSeparateMix;
+    bool mSinglePass;
+    QVector<int> mSongs;
+    bool mMappedOutput;
+    Wav::Format mFormat;
+    bool mDither;
+    bool mFlac;
+    bool mAnalyze;
+    std::optional<double> mNormalizeTarget;
+
+    // shared by the workers, none of these need ordering with other memory
+    // so relaxed accesses are used
+    std::atomic_bool mFailed;
+    std::atomic_bool mAbort;
+    // progress of each song, summed over all workers. Sized by setSongs()
+    // so that it is never reallocated while the GUI polls it.
+    std::vector<std::atomic_int> mProgress;
+    std::atomic<size_t> mClipped;
+    // one per batch, each written by the worker exporting it
+    std::vector<FileLevels> mLevels;
 
 };
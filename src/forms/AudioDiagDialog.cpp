@@ -1,13 +1,29 @@
 
 #include "forms/AudioDiagDialog.hpp"
 
+#include <QFile>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QTextStream>
 #include <QTimerEvent>
 
+#include <algorithm>
+
 #define TU AudioDiagDialogTU
 namespace TU {
 
 constexpr int DEFAULT_REFRESH_INTERVAL = 100;
 
+static const char* CSV_FILTER = QT_TR_NOOP("CSV files (*.csv)");
+
+QString percentilesToString(RenderProfile::Percentiles const& p) {
+    return QStringLiteral("%1 / %2 / %3 / %4 us")
+        .arg(p.p50, 0, 'f', 0)
+        .arg(p.p95, 0, 'f', 0)
+        .arg(p.p99, 0, 'f', 0)
+        .arg(p.max, 0, 'f', 0);
+}
+
 }
 
 AudioDiagDialog::AudioDiagDialog(Renderer &renderer, QWidget *parent) :
@@ -24,25 +40,55 @@ AudioDiagDialog::AudioDiagDialog(Renderer &renderer, QWidget *parent) :
     mElapsedLabel(),
     mPeriodLabel(),
     mPeriodWrittenLabel(),
+    mRenderModeLabel(),
+    mFormatLabel(),
+    mLatencySavedLabel(),
+    mTimerLatenessLabel(),
+    mTimerPriorityLabel(),
+    mFrameRetriesLabel(),
+    mDeferredLabel(),
+    mLatencyLabel(),
+    mDeviceLatencyLabel(),
+    mTotalLatencyLabel(),
+    mLoadLabel(),
+    mIntervalLabel(),
+    mRenderTimeLabel(),
+    mProfileStepsLabel(),
     mClearButton(tr("Clear")),
     mButtonLayout(),
     mAutoRefreshCheck(tr("Auto refresh")),
     mIntervalSpin(),
     mRefreshButton(tr("Refresh")),
+    mExportButton(tr("Export CSV...")),
     mCloseButton(tr("Close"))
 {
     mRenderLayout.addRow(tr("Underruns"), &mUnderrunLabel);
     mRenderLayout.addRow(tr("Buffer usage"), &mBufferProgress);
+    mRenderLayout.addRow(tr("Buffer latency"), &mLatencyLabel);
+    mRenderLayout.addRow(tr("Device latency"), &mDeviceLatencyLabel);
+    mRenderLayout.addRow(tr("Total latency"), &mTotalLatencyLabel);
     mRenderLayout.addRow(tr("Status"), &mStatusLabel);
     mRenderLayout.addRow(tr("Elapsed"), &mElapsedLabel);
     mRenderLayout.addRow(tr("Refresh rate"), &mPeriodLabel);
     mRenderLayout.addRow(tr("Samples written"), &mPeriodWrittenLabel);
-    mRenderLayout.setWidget(6, QFormLayout::LabelRole, &mClearButton);
+    mRenderLayout.addRow(tr("Render mode"), &mRenderModeLabel);
+    mRenderLayout.addRow(tr("Output format"), &mFormatLabel);
+    mRenderLayout.addRow(tr("Latency saved"), &mLatencySavedLabel);
+    mRenderLayout.addRow(tr("Timer lateness"), &mTimerLatenessLabel);
+    mRenderLayout.addRow(tr("Timer priority"), &mTimerPriorityLabel);
+    mRenderLayout.addRow(tr("Frame read retries"), &mFrameRetriesLabel);
+    mRenderLayout.addRow(tr("Deferred frames"), &mDeferredLabel);
+    mRenderLayout.addRow(tr("DSP load"), &mLoadLabel);
+    mRenderLayout.addRow(tr("Period (p50/p95/p99/max)"), &mIntervalLabel);
+    mRenderLayout.addRow(tr("Render time (p50/p95/p99/max)"), &mRenderTimeLabel);
+    mRenderLayout.addRow(tr("Engine steps"), &mProfileStepsLabel);
+    mRenderLayout.setWidget(20, QFormLayout::LabelRole, &mClearButton);
     mRenderGroup.setLayout(&mRenderLayout);
 
     mButtonLayout.addWidget(&mAutoRefreshCheck);
     mButtonLayout.addWidget(&mIntervalSpin);
     mButtonLayout.addWidget(&mRefreshButton);
+    mButtonLayout.addWidget(&mExportButton);
     mButtonLayout.addStretch();
     mButtonLayout.addWidget(&mCloseButton);
 
@@ -68,6 +114,7 @@ AudioDiagDialog::AudioDiagDialog(Renderer &renderer, QWidget *parent) :
 
     connect(&mCloseButton, &QPushButton::clicked, this, &AudioDiagDialog::close);
     connect(&mRefreshButton, &QPushButton::clicked, this, &AudioDiagDialog::refresh);
+    connect(&mExportButton, &QPushButton::clicked, this, &AudioDiagDialog::exportCsv);
     connect(&mClearButton, &QPushButton::clicked, &mRenderer, &Renderer::clearDiagnostics);
     connect(&mAutoRefreshCheck, &QCheckBox::stateChanged, this,
         [this](int state) {
@@ -129,10 +176,92 @@ void AudioDiagDialog::refresh() {
     setRunningLabel(isRunning);
 
     auto const bufferStat = mRenderer.statBuffer();
-    mBufferProgress.setMaximum(bufferStat.capacity);
+    // no buffer is used when rendering in the callback
+    auto const callbackRender = bufferStat.capacity == 0;
+    mBufferProgress.setEnabled(!callbackRender);
+    mBufferProgress.setMaximum(std::max(1, bufferStat.capacity));
     mBufferProgress.setValue(bufferStat.usage);
+    mRenderModeLabel.setText(callbackRender ? tr("Callback") : tr("Timer"));
+    mFormatLabel.setText(tr("%1, %2 Hz")
+        .arg(mRenderer.statFormat() == SampleFormat::s16 ? tr("16-bit") : tr("32-bit float"))
+        .arg(mRenderer.samplerate()));
+    mLatencyLabel.setText(tr("%1 ms (%2)")
+        .arg(bufferStat.latencyMs, 0, 'f', 1)
+        .arg(bufferStat.adaptive ? tr("adaptive") : tr("fixed")));
+    // the device's buffer is on top of ours, in callback mode it is all there is
+    auto const deviceStat = mRenderer.statDevice();
+    mDeviceLatencyLabel.setText(tr("%1 ms (%2 x %3 samples, %4 ms each)")
+        .arg(deviceStat.latencyMs, 0, 'f', 1)
+        .arg(deviceStat.periods)
+        .arg(deviceStat.period)
+        .arg(deviceStat.periodMs, 0, 'f', 1));
+    mTotalLatencyLabel.setText(tr("%1 ms")
+        .arg((callbackRender ? 0.0 : bufferStat.latencyMs) + deviceStat.latencyMs, 0, 'f', 1));
+    mLatencySavedLabel.setText(tr("%1 ms").arg(mRenderer.statLatencySaved()));
+
+    auto const timerStat = mRenderer.statTimer();
+    mTimerLatenessLabel.setText(tr("avg %1 us, jitter %2 us, max %3 us, %4 missed")
+        .arg(timerStat.latenessAvg, 0, 'f', 1)
+        .arg(timerStat.latenessStdDev, 0, 'f', 1)
+        .arg(timerStat.latenessMax)
+        .arg(timerStat.missed));
+    mTimerPriorityLabel.setText(timerStat.realtime ? tr("Realtime") : tr("Normal"));
+    mFrameRetriesLabel.setText(QString::number(mRenderer.statFrameRetries()));
+    auto const deferStat = mRenderer.statDeferredFrames();
+    mDeferredLabel.setText(tr("%1 (%2 skipped)").arg(deferStat.deferred).arg(deferStat.dropped));
     mPeriodLabel.setText(tr("%1 ms").arg(bufferStat.lastPeriodMs, 0, 'f', 3));
     mPeriodWrittenLabel.setText(QString::number(bufferStat.writesSinceLastPeriod));
+
+    auto const profile = mRenderer.statProfile().stats();
+    mLoadLabel.setText(tr("avg %1%, max %2% (step %3 us, synth %4 us, read %5 us)")
+        .arg(profile.loadAvg, 0, 'f', 1)
+        .arg(profile.loadMax, 0, 'f', 1)
+        .arg(profile.stepAvg, 0, 'f', 0)
+        .arg(profile.synthAvg, 0, 'f', 0)
+        .arg(profile.readAvg, 0, 'f', 0));
+    mProfileStepsLabel.setText(tr("%1 deferred, %2 skipped")
+        .arg(profile.deferred)
+        .arg(profile.dropped));
+    mIntervalLabel.setText(TU::percentilesToString(profile.interval));
+    mRenderTimeLabel.setText(TU::percentilesToString(profile.render));
+}
+
+void AudioDiagDialog::exportCsv() {
+    auto filename = QFileDialog::getSaveFileName(
+        this,
+        tr("Export render profile"),
+        tr("profile.csv"),
+        tr(TU::CSV_FILTER)
+        );
+    if (filename.isEmpty()) {
+        return;
+    }
+
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        QMessageBox::critical(
+            this,
+            tr("Export failed"),
+            tr("The file could not be written")
+        );
+        return;
+    }
+
+    // one row per period, oldest first
+    auto const& profile = mRenderer.statProfile();
+    QTextStream stream(&file);
+    stream << "interval_us,render_us,step_us,synth_us,read_us,deferred,dropped,load_percent\n";
+    for (size_t i = 0; i < profile.size(); ++i) {
+        auto const& period = profile.at(i);
+        stream << period.interval << ','
+               << period.render << ','
+               << period.step << ','
+               << period.synth << ','
+               << period.read << ','
+               << period.deferred << ','
+               << period.dropped << ','
+               << RenderProfile::load(period) << '\n';
+    }
 }
 
 void AudioDiagDialog::setRunningLabel(bool const isRunning) {
@@ -43,6 +43,8 @@ private:
 
     void setElapsed(long const msecs);
 
+    void exportCsv();
+
     Renderer &mRenderer;
     int mTimerId;
     bool mLastIsRunning;
@@ -57,10 +59,25 @@ private:
                 QLabel mElapsedLabel;
                 QLabel mPeriodLabel;
                 QLabel mPeriodWrittenLabel;
+                QLabel mRenderModeLabel;
+                QLabel mFormatLabel;
+                QLabel mLatencySavedLabel;
+                QLabel mTimerLatenessLabel;
+                QLabel mTimerPriorityLabel;
+                QLabel mFrameRetriesLabel;
+                QLabel mDeferredLabel;
+                QLabel mLatencyLabel;
+                QLabel mDeviceLatencyLabel;
+                QLabel mTotalLatencyLabel;
+                QLabel mLoadLabel;
+                QLabel mIntervalLabel;
+                QLabel mRenderTimeLabel;
+                QLabel mProfileStepsLabel;
                 QPushButton mClearButton;
         QHBoxLayout mButtonLayout;
             QCheckBox mAutoRefreshCheck;
             QSpinBox mIntervalSpin;
             QPushButton mRefreshButton;
+            QPushButton mExportButton;
             QPushButton mCloseButton;
 };
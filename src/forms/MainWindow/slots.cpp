@@ -288,7 +288,11 @@ Config::Categories MainWindow::applyConfig(Config const& config, Config::Categor
             flags |= Config::CategorySound;
             setPlayingStatus(PlayingStatusText::error);
             if (problems) {
-                problems->append(tr("[Sound] The configured device could not be initialized. Playback is disabled.\n"));
+                if (mRenderer->isRunning()) {
+                    problems->append(tr("[Sound] The configured device could not be initialized. Playback continues on the current device.\n"));
+                } else {
+                    problems->append(tr("[Sound] The configured device could not be initialized. Playback is disabled.\n"));
+                }
             }
         } else {
             if (!mRenderer->isRunning()) {
@@ -533,8 +537,8 @@ void MainWindow::onAudioStop() {
 
 void MainWindow::onFrameSync() {
     // this slot is called when the renderer has renderered a new frame
-    // sync is a bit misleading here, as this slot is called when this frame
-    // is in process of being bufferred. It is not the current frame being played out.
+    // currentFrame() accounts for the buffer, so the frame we get is the one
+    // being played out, which may lag behind the one just renderered.
 
     auto frame = mRenderer->currentFrame();
 
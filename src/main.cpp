@@ -1,4 +1,5 @@
 
+#include "export/HeadlessExport.hpp"
 #include "forms/MainWindow.hpp"
 
 #include <QApplication>
@@ -19,6 +20,7 @@
 #include <memory>
 #include <new>
 #include <cstdio>
+#include <cstdlib>
 
 #include "version.hpp"
 
@@ -52,6 +54,8 @@ static std::string demangle(const char* name) {
 
 constexpr int EXIT_BAD_ARGUMENTS = -1;
 constexpr int EXIT_BAD_ALLOC = 1;
+constexpr int EXIT_OPEN_FAILED = 2;
+constexpr int EXIT_EXPORT_FAILED = 3;
 
 //
 // Singleton class for a custom Qt message handler. This message handler wraps
@@ -127,8 +131,59 @@ public:
 
 
 
+#define main_tr(str) QCoreApplication::translate("main", str)
+
+//
+// main for a headless export, only a QCoreApplication is created so no GUI
+// or display is needed.
+//
+static int exportMain(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setOrganizationName("Trackerboy");
+    QCoreApplication::setApplicationName("Trackerboy");
+    QCoreApplication::setApplicationVersion(VERSION_STR);
+
+    HeadlessExport headless;
+    QCommandLineParser parser;
+    parser.setApplicationDescription(main_tr("Game Boy music tracker"));
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("module_file", main_tr("The module file to export"));
+    headless.addOptions(parser);
+    parser.process(app);
+
+    auto const positionals = parser.positionalArguments();
+    if (positionals.size() != 1) {
+        fputs("expected one module file\n", stderr);
+        fputs(qPrintable(parser.helpText()), stderr);
+        return EXIT_BAD_ARGUMENTS;
+    }
+
+    try {
+        switch (headless.run(parser, positionals[0])) {
+            case HeadlessExport::Result::success:
+                return EXIT_SUCCESS;
+            case HeadlessExport::Result::badArguments:
+                return EXIT_BAD_ARGUMENTS;
+            case HeadlessExport::Result::openFailed:
+                return EXIT_OPEN_FAILED;
+            case HeadlessExport::Result::exportFailed:
+                return EXIT_EXPORT_FAILED;
+        }
+    } catch (const std::bad_alloc &) {
+        qCritical() << "out of memory";
+        return EXIT_BAD_ALLOC;
+    }
+    return EXIT_EXPORT_FAILED;
+}
+
 int main(int argc, char *argv[]) {
 
+    // checked first, so that the GUI is skipped entirely
+    if (HeadlessExport::isRequested(argc, argv)) {
+        return exportMain(argc, argv);
+    }
+
     int code;
 
     #ifndef QT_NO_INFO_OUTPUT
@@ -143,13 +198,14 @@ int main(int argc, char *argv[]) {
     // use INI on all systems, much easier to edit by hand
     QSettings::setDefaultFormat(QSettings::IniFormat);
 
-#define main_tr(str) QCoreApplication::translate("main", str)
-
     QCommandLineParser parser;
     parser.setApplicationDescription(main_tr("Game Boy music tracker"));
     parser.addHelpOption();
     parser.addVersionOption();
     parser.addPositionalArgument("[module_file]", main_tr("(Optional) the module file to open"));
+    // only listed for --help, an export never gets here
+    HeadlessExport headless;
+    headless.addOptions(parser);
 
     parser.process(app);
 
@@ -1,99 +1,215 @@
 
 #include "utils/FastTimer.hpp"
-#include "utils/utils.hpp"
 
-#include <QMutexLocker>
-#include <QTimerEvent>
-#include <QThread>
+#include <QtGlobal>
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(Q_OS_LINUX)
+#include <cerrno>
+#include <ctime>
+#endif
+
+#if defined(Q_OS_UNIX)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(Q_OS_WIN)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <timeapi.h>
+#endif
 
 #define TU FastTimerTU
 namespace TU {
 
-constexpr auto NO_TIMER = -1;
+//
+// Attempts to give the calling thread realtime priority, returns true on
+// success. Failure is normal, ie on Linux the user needs RLIMIT_RTPRIO or
+// CAP_SYS_NICE.
+//
+bool setRealtimePriority() {
+#if defined(Q_OS_UNIX)
+    sched_param param{};
+    // lowest realtime priority, enough to preempt every normal thread while
+    // staying below audio servers and device threads
+    param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+#elif defined(Q_OS_WIN)
+    return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+#else
+    return false;
+#endif
+}
+
+void setThreadName() {
+#if defined(Q_OS_LINUX)
+    pthread_setname_np(pthread_self(), "FastTimer");
+#endif
+}
+
+//
+// Sleeps until the given absolute deadline
+//
+void sleepUntil(FastTimer::Clock::time_point deadline) {
+#if defined(Q_OS_LINUX)
+    // steady_clock is CLOCK_MONOTONIC, so the deadline can be used as is
+    auto const ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+    timespec ts;
+    ts.tv_sec = (time_t)(ns / 1000000000);
+    ts.tv_nsec = (long)(ns % 1000000000);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR);
+#else
+    std::this_thread::sleep_until(deadline);
+#endif
+}
 
 }
 
-FastTimer::FastTimer(QObject *parent) :
-    QObject(parent),
+FastTimer::FastTimer() :
     mCallback(nullptr),
     mCallbackData(nullptr),
-    mInterval(0),
-    mTimerType(Qt::CoarseTimer),
-    mTimerId(TU::NO_TIMER)
+    mRealtimeRequested(false),
+    mThread(),
+    mRunning(false),
+    mInterval(1000),
+    mResetStats(false),
+    mRealtime(false),
+    mTicks(0),
+    mMissed(0),
+    mLatenessSum(0),
+    mLatenessSumSq(0.0),
+    mLatenessMax(0)
 {
 }
 
+FastTimer::~FastTimer() {
+    stop();
+}
+
 void FastTimer::setCallback(CallbackFn function, void *data) {
-    QMutexLocker locker(&mMutex);
     mCallback = function;
     mCallbackData = data;
 }
 
-void FastTimer::setInterval(int ms, Qt::TimerType type) {
-    mMutex.lock();
-    bool changed = false;
-    if (mInterval != ms) {
-        mInterval = ms;
-        changed = true;
-    }
-    if (mTimerType != type) {
-        mTimerType = type;
-        changed = true;
-    }
-    auto timerId = mTimerId;
-    mMutex.unlock();
-
-    if (changed && timerId != TU::NO_TIMER) {
-        // restart the timer with the new interval
-        start();
-    }
+void FastTimer::setInterval(std::chrono::microseconds interval) {
+    mInterval.store(std::max((int64_t)1, (int64_t)interval.count()), std::memory_order_relaxed);
 }
 
-void FastTimer::timerEvent(QTimerEvent *evt) {
-    mMutex.lock();
-    auto const timerId = mTimerId;
-    auto const callback = mCallback;
-    auto const data = mCallbackData;
-    mMutex.unlock();
+void FastTimer::setRealtime(bool realtime) {
+    mRealtimeRequested = realtime;
+}
 
+void FastTimer::start() {
+    stop();
+    mRunning.store(true, std::memory_order_relaxed);
+    mThread = std::thread(&FastTimer::run, this);
+}
 
-    if (evt->timerId() == timerId && callback) {
-        callback(data);
+void FastTimer::stop() {
+    mRunning.store(false, std::memory_order_release);
+    if (std::this_thread::get_id() != mThread.get_id()) {
+        // the thread exits after at most one interval
+        join();
     }
-
+    // otherwise we were called from the callback, the thread exits once it returns
 }
 
+bool FastTimer::isRunning() const {
+    return mRunning.load(std::memory_order_relaxed);
+}
 
-void FastTimer::start() {
-    if (objectInCurrentThread(*this)) {
-        QMutexLocker locker(&mMutex);
-        _stopTimer();
-        _startTimer();
-    } else {
-        // re-invoke in the object's thread
-        QMetaObject::invokeMethod(this, [this]() { start(); }, Qt::BlockingQueuedConnection);
+FastTimer::Stats FastTimer::stats() const {
+    Stats stats{};
+    stats.ticks = mTicks.load(std::memory_order_relaxed);
+    stats.missed = mMissed.load(std::memory_order_relaxed);
+    stats.latenessMax = mLatenessMax.load(std::memory_order_relaxed);
+    stats.realtime = mRealtime.load(std::memory_order_relaxed);
+    if (stats.ticks) {
+        auto const n = (double)stats.ticks;
+        auto const mean = mLatenessSum.load(std::memory_order_relaxed) / n;
+        auto const variance = mLatenessSumSq.load(std::memory_order_relaxed) / n - (mean * mean);
+        stats.latenessAvg = mean;
+        stats.latenessStdDev = std::sqrt(std::max(0.0, variance));
     }
+    return stats;
 }
 
-void FastTimer::stop() {
-    if (objectInCurrentThread(*this)) {
-        QMutexLocker locker(&mMutex);
-        _stopTimer();
+void FastTimer::resetStats() {
+    if (isRunning()) {
+        // the timer thread is the only writer, let it clear them on the next tick
+        mResetStats.store(true, std::memory_order_relaxed);
     } else {
-        QMetaObject::invokeMethod(this, [this]() { stop(); }, Qt::BlockingQueuedConnection);
+        mTicks.store(0, std::memory_order_relaxed);
+        mMissed.store(0, std::memory_order_relaxed);
+        mLatenessSum.store(0, std::memory_order_relaxed);
+        mLatenessSumSq.store(0.0, std::memory_order_relaxed);
+        mLatenessMax.store(0, std::memory_order_relaxed);
     }
 }
 
-
-void FastTimer::_startTimer() {
-    mTimerId = startTimer(mInterval, mTimerType);
+void FastTimer::join() {
+    if (mThread.joinable()) {
+        mThread.join();
+    }
 }
 
-void FastTimer::_stopTimer() {
-    if (mTimerId != TU::NO_TIMER) {
-        killTimer(mTimerId);
-        mTimerId = -1;
+void FastTimer::run() {
+    TU::setThreadName();
+    mRealtime.store(mRealtimeRequested && TU::setRealtimePriority(), std::memory_order_relaxed);
+
+#ifdef Q_OS_WIN
+    // sleep_until has the resolution of the system timer, 15.6 ms by default
+    timeBeginPeriod(1);
+#endif
+
+    auto deadline = Clock::now() + std::chrono::microseconds(mInterval.load(std::memory_order_relaxed));
+
+    while (mRunning.load(std::memory_order_acquire)) {
+        TU::sleepUntil(deadline);
+        if (!mRunning.load(std::memory_order_acquire)) {
+            break;
+        }
+
+        auto const now = Clock::now();
+        if (mResetStats.exchange(false, std::memory_order_relaxed)) {
+            mTicks.store(0, std::memory_order_relaxed);
+            mMissed.store(0, std::memory_order_relaxed);
+            mLatenessSum.store(0, std::memory_order_relaxed);
+            mLatenessSumSq.store(0.0, std::memory_order_relaxed);
+            mLatenessMax.store(0, std::memory_order_relaxed);
+        }
+
+        // this thread is the only writer, so no read-modify-write is needed
+        auto const lateness = std::max((int64_t)0,
+            (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(now - deadline).count());
+        mTicks.store(mTicks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        mLatenessSum.store(mLatenessSum.load(std::memory_order_relaxed) + lateness, std::memory_order_relaxed);
+        mLatenessSumSq.store(mLatenessSumSq.load(std::memory_order_relaxed) + (double)lateness * lateness, std::memory_order_relaxed);
+        if (lateness > mLatenessMax.load(std::memory_order_relaxed)) {
+            mLatenessMax.store(lateness, std::memory_order_relaxed);
+        }
+
+        mCallback(mCallbackData);
+
+        auto const interval = std::chrono::microseconds(mInterval.load(std::memory_order_relaxed));
+        deadline += interval;
+        auto const behind = Clock::now() - deadline;
+        if (behind >= interval) {
+            // the callback overran by a period or more, skip the missed
+            // ticks instead of firing them all at once
+            auto const missed = behind / interval;
+            mMissed.store(mMissed.load(std::memory_order_relaxed) + missed, std::memory_order_relaxed);
+            deadline += missed * interval;
+        }
     }
+
+#ifdef Q_OS_WIN
+    timeEndPeriod(1);
+#endif
+
 }
 
 #undef TU
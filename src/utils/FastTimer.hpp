@@ -1,58 +1,125 @@
 
 #pragma once
 
-#include <QObject>
-#include <QMutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
 
 //
 // Similar to QTimer, but uses a callback function instead of signals.
 // The signal/slot mechanism has some overhead that is undesirable for a signal
 // that is invoked very often (ie every 5 ms), especially when invoked via queued
 // connection.
-// 
-// Qt Timers are used in this implementation for conveienence. Qt::PreciseTimer
-// offers millisecond resolution on all platforms, which is desired. If a better
-// implementation is needed, it can be implemented here (instead of using QObject timers).
-// 
-// All functions in this class are thread-safe.
 //
-class FastTimer : public QObject {
-
-    Q_OBJECT
+// The timer runs on its own thread, which is started by start() and exits
+// by stop(). Ticks are scheduled on absolute deadlines (clock_nanosleep with
+// TIMER_ABSTIME on Linux, sleep_until elsewhere) so that lateness in one tick
+// does not accumulate into the next, and intervals can be less than a
+// millisecond. The thread can optionally request realtime (SCHED_FIFO)
+// scheduling, if this is not permitted the thread runs with its default
+// priority.
+//
+// The lateness of each tick (time between the deadline and the actual wake
+// up) is recorded so that timer jitter can be measured, see stats().
+//
+// start(), stop() and the setters must be called from a single controlling
+// thread. stop() may also be called from within the callback.
+//
+class FastTimer {
 
 public:
 
     using CallbackFn = void(*)(void*);
-
-    explicit FastTimer(QObject *parent = nullptr);
-    virtual ~FastTimer() = default;
-
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        // number of ticks since the last reset
+        uint64_t ticks;
+        // number of ticks skipped due to the callback overrunning
+        uint64_t missed;
+        // average lateness of a tick, in microseconds
+        double latenessAvg;
+        // standard deviation of the lateness (jitter), in microseconds
+        double latenessStdDev;
+        // highest lateness of a tick, in microseconds
+        int64_t latenessMax;
+        // true if the timer thread is running with realtime priority
+        bool realtime;
+    };
+
+    FastTimer();
+    ~FastTimer();
+
+    //
+    // Sets the function to call every interval. Must not be called while
+    // the timer is running.
+    //
     void setCallback(CallbackFn function, void* data = nullptr);
 
-    void setInterval(int ms, Qt::TimerType type = Qt::CoarseTimer);
-
+    //
+    // Sets the interval between ticks. If the timer is running, the new
+    // interval takes effect after the next tick.
+    //
+    void setInterval(std::chrono::microseconds interval);
+
+    //
+    // Request realtime priority for the timer thread. Takes effect on the
+    // next call to start().
+    //
+    void setRealtime(bool realtime);
+
+    //
+    // Starts the timer, restarting it if already running. The first tick
+    // occurs one interval from now.
+    //
     void start();
 
+    //
+    // Stops the timer. When called from another thread, the callback is
+    // guaranteed not to be running or called again when this function
+    // returns. When called from within the callback, no further ticks occur
+    // once the callback returns.
+    //
     void stop();
 
-protected:
+    bool isRunning() const;
+
+    //
+    // Gets the tick statistics.
+    //
+    Stats stats() const;
 
-    virtual void timerEvent(QTimerEvent *evt) override;
+    //
+    // Clears the tick statistics.
+    //
+    void resetStats();
 
 private:
 
-    void _startTimer();
+    FastTimer(FastTimer const&) = delete;
+    FastTimer& operator=(FastTimer const&) = delete;
 
-    void _stopTimer();
+    void run();
 
+    // joins a thread that was previously stopped
+    void join();
 
-    QMutex mMutex;
     CallbackFn mCallback;
     void *mCallbackData;
-    int mInterval;
-    Qt::TimerType mTimerType;
-
-    int mTimerId;
-
+    bool mRealtimeRequested;
+
+    std::thread mThread;
+    std::atomic_bool mRunning;
+    std::atomic<int64_t> mInterval; // microseconds
+
+    // stats, only written by the timer thread
+    std::atomic_bool mResetStats;
+    std::atomic_bool mRealtime;
+    std::atomic_uint64_t mTicks;
+    std::atomic_uint64_t mMissed;
+    std::atomic<int64_t> mLatenessSum;
+    std::atomic<double> mLatenessSumSq;
+    std::atomic<int64_t> mLatenessMax;
 
 };
@@ -0,0 +1,103 @@
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+//
+// Single-writer sequence lock. Publishes a copy of a trivially copyable type
+// from one thread to any number of readers, without either side blocking.
+//
+// The writer increments the sequence number before and after modifying the
+// data, so it is odd while a write is in progress. Readers copy the data and
+// retry if the sequence number was odd or changed during the copy. Writes are
+// expected to be rare compared to the time it takes to copy, so retries
+// should be rare as well. The number of retries is counted so that
+// contention can be measured.
+//
+// The data is stored as an array of atomic words so that the racy copy made
+// by a reader is not a data race.
+//
+template <typename T>
+class Seqlock {
+
+    static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+
+    using Word = uintptr_t;
+    static constexpr size_t WORDS = (sizeof(T) + sizeof(Word) - 1) / sizeof(Word);
+
+public:
+
+    Seqlock() :
+        mSequence(0),
+        mData(),
+        mRetries(0)
+    {
+        store(T{});
+    }
+
+    //
+    // Publishes a new value. Only one thread may store.
+    //
+    void store(T const& value) {
+        Word words[WORDS] = {};
+        std::memcpy(words, &value, sizeof(T));
+
+        auto const seq = mSequence.load(std::memory_order_relaxed);
+        mSequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; ++i) {
+            mData[i].store(words[i], std::memory_order_relaxed);
+        }
+        mSequence.store(seq + 2, std::memory_order_release);
+    }
+
+    //
+    // Gets a copy of the last published value. Never blocks, but may retry
+    // if a store happens at the same time.
+    //
+    T load() const {
+        Word words[WORDS];
+        for (;;) {
+            auto const seq = mSequence.load(std::memory_order_acquire);
+            if ((seq & 1) == 0) {
+                for (size_t i = 0; i < WORDS; ++i) {
+                    words[i] = mData[i].load(std::memory_order_relaxed);
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (mSequence.load(std::memory_order_relaxed) == seq) {
+                    break;
+                }
+            }
+            mRetries.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        T value;
+        std::memcpy(&value, words, sizeof(T));
+        return value;
+    }
+
+    //
+    // Number of times a reader had to retry due to a concurrent store.
+    //
+    unsigned retries() const {
+        return mRetries.load(std::memory_order_relaxed);
+    }
+
+    void resetRetries() {
+        mRetries.store(0, std::memory_order_relaxed);
+    }
+
+private:
+
+    Seqlock(Seqlock const&) = delete;
+    Seqlock& operator=(Seqlock const&) = delete;
+
+    std::atomic<Word> mSequence;
+    std::atomic<Word> mData[WORDS];
+    mutable std::atomic_uint mRetries;
+
+};
@@ -36,7 +36,7 @@ AudioScope::AudioScope(QWidget *parent) :
 
 }
 
-void AudioScope::setBuffer(Guarded<VisualizerBuffer> *buffer) {
+void AudioScope::setBuffer(VisualizerBuffer *buffer) {
     if (buffer != mBuffer) {
         mBuffer = buffer;
         update();
@@ -66,8 +66,9 @@ void AudioScope::paintEvent(QPaintEvent *evt) {
         return;
     }
 
-    auto handle = mBuffer->access();
-    auto size = handle->size();
+    // the latest snapshot, the renderer is free to keep writing while we draw
+    auto const snapshot = mBuffer->snapshot();
+    auto size = snapshot.size();
     if (size == 0) {
         // buffer is empty, draw nothing
         drawSilence();
@@ -86,7 +87,7 @@ void AudioScope::paintEvent(QPaintEvent *evt) {
 
     float prevLeft;
     float prevRight;
-    sample(handle, 0.0f, ratio, prevLeft, prevRight);
+    sample(snapshot, 0.0f, ratio, prevLeft, prevRight);
 
     int const end = w + TU::LINE_WIDTH;
     for (int t = 1 + TU::LINE_WIDTH; t < end; ++t) {
@@ -94,7 +95,7 @@ void AudioScope::paintEvent(QPaintEvent *evt) {
         
         float leftSample;
         float rightSample;
-        sample(handle, index, ratio, leftSample, rightSample);
+        sample(snapshot, index, ratio, leftSample, rightSample);
 
         painter.drawLine(QLineF(t - 1, prevLeft, t, leftSample));
         painter.drawLine(QLineF(t - 1, prevRight, t, rightSample));
@@ -116,9 +117,9 @@ void AudioScope::drawSilence() {
 
 }
 
-void AudioScope::sample(Locked<VisualizerBuffer> &handle, float index, float ratio, float &outLeft, float &outRight) {
+void AudioScope::sample(VisualizerBuffer::Snapshot const& snapshot, float index, float ratio, float &outLeft, float &outRight) {
     float left, right;
-    handle->averageSample(index, ratio, left, right);
+    snapshot.averageSample(index, ratio, left, right);
 
     outLeft = WAVE_LEFT_AXIS - (left / (2.0f / WAVE_HEIGHT));
     outRight = WAVE_RIGHT_AXIS - (right / (2.0f / WAVE_HEIGHT));
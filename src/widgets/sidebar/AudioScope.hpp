@@ -4,7 +4,6 @@
 
 #include "audio/VisualizerBuffer.hpp"
 #include "config/data/Palette.hpp"
-#include "utils/Guarded.hpp"
 
 #include <QFrame>
 
@@ -19,7 +18,7 @@ public:
     explicit AudioScope(QWidget *parent = nullptr);
 
 
-    void setBuffer(Guarded<VisualizerBuffer>* buffer);
+    void setBuffer(VisualizerBuffer* buffer);
 
     void setColors(Palette const& pal);
 
@@ -32,7 +31,7 @@ private:
 
     void drawSilence();
 
-    void sample(Locked<VisualizerBuffer> &handle, float index, float ratio, float &outLeft, float &outRight);
+    void sample(VisualizerBuffer::Snapshot const& snapshot, float index, float ratio, float &outLeft, float &outRight);
 
     static constexpr int WAVE_WIDTH = 160;
     static constexpr int WAVE_HEIGHT = 64;
@@ -41,7 +40,7 @@ private:
     static constexpr int WAVE_LEFT_AXIS = (WAVE_HEIGHT / 2) + 1;
     static constexpr int WAVE_RIGHT_AXIS = (WAVE_HEIGHT / 2) + WAVE_HEIGHT + 1;
 
-    Guarded<VisualizerBuffer> *mBuffer;
+    VisualizerBuffer *mBuffer;
 
     QColor mLineColor;
 
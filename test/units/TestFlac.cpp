@@ -0,0 +1,413 @@
+#include "units/TestFlac.hpp"
+
+#include "audio/Flac.hpp"
+#include "audio/SampleFormat.hpp"
+
+#include <QFile>
+#include <QTemporaryDir>
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#define TU TestFlacTU
+namespace TU {
+
+//
+// Encodes the samples to a file and returns its contents
+//
+QByteArray encode(QString const& path, std::vector<float> const& samples, int bits) {
+    {
+        Flac flac(path.toStdString(), 2, 44100, bits);
+        flac.write(samples.data(), samples.size() / 2);
+        if (!flac.finish()) {
+            return {};
+        }
+    }
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return {};
+    }
+    return file.readAll();
+}
+
+//
+// Minimal FLAC decoder for checking the encoder's output, supporting what the
+// encoder writes: a single STREAMINFO block, fixed block sizes and constant,
+// verbatim, fixed and LPC subframes. Checks the CRCs of every frame.
+//
+class Decoder {
+
+public:
+
+    explicit Decoder(QByteArray const& data) :
+        mData(reinterpret_cast<uint8_t const*>(data.constData())),
+        mSize((size_t)data.size()),
+        mBit(0)
+    {
+    }
+
+    //
+    // Decodes the stream to interleaved samples, returns false if the stream
+    // is invalid.
+    //
+    bool decode(std::vector<int32_t> &out) {
+        if (mSize < 42 || read(32) != 0x664C6143) {
+            return false;
+        }
+        // last block flag, type 0 and length 34
+        if (read(32) != 0x80000022) {
+            return false;
+        }
+        read(16 + 16 + 24 + 24);
+        read(20);
+        int const channels = (int)read(3) + 1;
+        int const bits = (int)read(5) + 1;
+        uint64_t const total = ((uint64_t)read(4) << 32) | read(32);
+        read(32);
+        read(32);
+        read(32);
+        read(32);
+
+        std::vector<std::vector<int64_t>> signals(channels);
+        uint32_t frameNumber = 0;
+        while (mBit / 8 < mSize) {
+            auto const start = mBit / 8;
+            if (read(14) != 0x3FFE || read(1) != 0 || read(1) != 0) {
+                return false;
+            }
+            auto const blockSizeCode = read(4);
+            read(4);
+            auto const assignment = read(4);
+            read(3);
+            read(1);
+            if (readUtf8() != frameNumber++ || blockSizeCode != 7) {
+                return false;
+            }
+            int const blockSize = (int)read(16) + 1;
+            auto const headerCrc = crc8(start, mBit / 8);
+            if (read(8) != headerCrc) {
+                return false;
+            }
+
+            auto const subframes = assignment >= 8 ? 2 : (int)assignment + 1;
+            if (subframes != channels) {
+                return false;
+            }
+            std::vector<std::vector<int64_t>> block(subframes);
+            for (int ch = 0; ch < subframes; ++ch) {
+                // the side channel has an extra bit
+                auto const side = (assignment == 8 && ch == 1) || (assignment == 9 && ch == 0) || (assignment == 10 && ch == 1);
+                if (!decodeSubframe(block[ch], blockSize, bits + (side ? 1 : 0))) {
+                    return false;
+                }
+            }
+            mBit = (mBit + 7) & ~(size_t)7;
+            auto const frameCrc = crc16(start, mBit / 8);
+            if (read(16) != frameCrc) {
+                return false;
+            }
+
+            for (int i = 0; i < blockSize; ++i) {
+                auto a = block[0][i];
+                auto b = subframes > 1 ? block[1][i] : 0;
+                switch (assignment) {
+                    case 8:     // left/side
+                        b = a - b;
+                        break;
+                    case 9:     // side/right
+                        a = a + b;
+                        break;
+                    case 10: {  // mid/side
+                        auto const mid = (a * 2) | (b & 1);
+                        a = (mid + b) >> 1;
+                        b = (mid - b) >> 1;
+                        break;
+                    }
+                    default:
+                        break;
+                }
+                signals[0].push_back(a);
+                if (subframes > 1) {
+                    signals[1].push_back(b);
+                }
+            }
+        }
+
+        if (signals[0].size() != total) {
+            return false;
+        }
+        out.clear();
+        for (size_t i = 0; i < total; ++i) {
+            for (int ch = 0; ch < channels; ++ch) {
+                out.push_back((int32_t)signals[ch][i]);
+            }
+        }
+        return true;
+    }
+
+private:
+
+    bool decodeSubframe(std::vector<int64_t> &x, int blockSize, int bits) {
+        if (read(1) != 0) {
+            return false;
+        }
+        auto const type = read(6);
+        if (read(1) != 0) {
+            // wasted bits are never written
+            return false;
+        }
+
+        if (type == 0) {
+            x.assign(blockSize, readSigned(bits));
+            return true;
+        }
+        if (type == 1) {
+            for (int i = 0; i < blockSize; ++i) {
+                x.push_back(readSigned(bits));
+            }
+            return true;
+        }
+
+        int order;
+        bool lpc;
+        if (type >= 8 && type <= 12) {
+            order = (int)type - 8;
+            lpc = false;
+        } else if (type >= 32) {
+            order = (int)type - 31;
+            lpc = true;
+        } else {
+            return false;
+        }
+        for (int i = 0; i < order; ++i) {
+            x.push_back(readSigned(bits));
+        }
+
+        std::vector<int64_t> coefs;
+        int shift = 0;
+        if (lpc) {
+            auto const precision = (int)read(4) + 1;
+            shift = (int)readSigned(5);
+            for (int i = 0; i < order; ++i) {
+                coefs.push_back(readSigned(precision));
+            }
+        } else {
+            static int64_t const FIXED[5][4] = {
+                { 0, 0, 0, 0 },
+                { 1, 0, 0, 0 },
+                { 2, -1, 0, 0 },
+                { 3, -3, 1, 0 },
+                { 4, -6, 4, -1 }
+            };
+            coefs.assign(FIXED[order], FIXED[order] + order);
+        }
+
+        // partitioned rice, 4-bit parameters
+        if (read(2) != 0) {
+            return false;
+        }
+        auto const partitionOrder = (int)read(4);
+        auto const partitionSize = blockSize >> partitionOrder;
+        for (int p = 0; p < (1 << partitionOrder); ++p) {
+            auto const param = (int)read(4);
+            if (param == 15) {
+                return false;
+            }
+            auto const count = p == 0 ? partitionSize - order : partitionSize;
+            for (int i = 0; i < count; ++i) {
+                uint64_t quotient = 0;
+                while (read(1) == 0) {
+                    ++quotient;
+                }
+                auto const value = (quotient << param) | read(param);
+                auto const residual = (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+
+                int64_t prediction = 0;
+                auto const n = x.size();
+                for (int j = 0; j < order; ++j) {
+                    prediction += coefs[j] * x[n - 1 - j];
+                }
+                x.push_back(residual + (prediction >> shift));
+            }
+        }
+        return (int)x.size() == blockSize;
+    }
+
+    uint32_t read(int bits) {
+        uint32_t value = 0;
+        for (int i = 0; i < bits; ++i) {
+            uint32_t bit = 0;
+            if (mBit / 8 < mSize) {
+                bit = (mData[mBit / 8] >> (7 - (mBit & 7))) & 1;
+            }
+            value = (value << 1) | bit;
+            ++mBit;
+        }
+        return value;
+    }
+
+    int64_t readSigned(int bits) {
+        auto const value = (int64_t)read(bits);
+        return bits && (value >> (bits - 1)) ? value - ((int64_t)1 << bits) : value;
+    }
+
+    uint32_t readUtf8() {
+        auto value = read(8);
+        if (value < 0x80) {
+            return value;
+        }
+        int n = 0;
+        while (value & (0x80 >> n)) {
+            ++n;
+        }
+        value &= 0x7F >> n;
+        for (int i = 1; i < n; ++i) {
+            value = (value << 6) | (read(8) & 0x3F);
+        }
+        return value;
+    }
+
+    uint32_t crc8(size_t begin, size_t end) const {
+        uint32_t crc = 0;
+        for (auto i = begin; i < end; ++i) {
+            crc ^= mData[i];
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = crc & 0x80 ? ((crc << 1) ^ 0x07) & 0xFF : (crc << 1) & 0xFF;
+            }
+        }
+        return crc;
+    }
+
+    uint32_t crc16(size_t begin, size_t end) const {
+        uint32_t crc = 0;
+        for (auto i = begin; i < end; ++i) {
+            crc ^= (uint32_t)mData[i] << 8;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = crc & 0x8000 ? ((crc << 1) ^ 0x8005) & 0xFFFF : (crc << 1) & 0xFFFF;
+            }
+        }
+        return crc;
+    }
+
+    uint8_t const *mData;
+    size_t mSize;
+    size_t mBit;
+};
+
+}
+
+TestFlac::TestFlac() {
+
+}
+
+void TestFlac::streamInfo() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    // a few blocks and a partial one
+    size_t const frames = Flac::BLOCK_SIZE * 3 + 100;
+    std::vector<float> samples(frames * 2);
+    for (size_t i = 0; i < frames; ++i) {
+        samples[i * 2] = 0.5f * (float)std::sin(i * 0.05);
+        samples[i * 2 + 1] = (i / 50) & 1 ? 0.25f : -0.25f;
+    }
+
+    auto const data = TU::encode(dir.filePath("test.flac"), samples, 24);
+    QVERIFY(data.size() > 42);
+    QCOMPARE(data.left(4), QByteArray("fLaC"));
+
+    auto const info = reinterpret_cast<uint8_t const*>(data.constData()) + 8;
+    // samplerate (20 bits), channels - 1 (3 bits), bits - 1 (5 bits)
+    QCOMPARE((info[10] << 12) | (info[11] << 4) | (info[12] >> 4), 44100);
+    QCOMPARE((info[12] >> 1) & 7, 1);
+    QCOMPARE(((info[12] & 1) << 4) | (info[13] >> 4), 23);
+    // total samples (36 bits)
+    uint64_t total = info[13] & 0xF;
+    for (int i = 14; i < 18; ++i) {
+        total = (total << 8) | info[i];
+    }
+    QCOMPARE(total, (uint64_t)frames);
+    // first frame follows the header
+    QCOMPARE((uint8_t)data[42], (uint8_t)0xFF);
+    QCOMPARE((uint8_t)data[43], (uint8_t)0xF8);
+}
+
+void TestFlac::silenceCompresses() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    size_t const frames = Flac::BLOCK_SIZE * 10;
+    std::vector<float> samples(frames * 2, 0.0f);
+    auto const data = TU::encode(dir.filePath("silence.flac"), samples, 16);
+    // each frame should be a header and two constant subframes
+    QVERIFY(data.size() > 42);
+    QVERIFY(data.size() < 42 + 10 * 32);
+}
+
+void TestFlac::roundTrip_data() {
+    QTest::addColumn<int>("bits");
+    QTest::addColumn<int>("signal");
+
+    // the sines exercise LPC and the stereo modes, noise the verbatim
+    // subframes and the square waves the fixed predictors
+    for (int bits : { 16, 24 }) {
+        auto const suffix = QStringLiteral(" %1-bit").arg(bits);
+        QTest::newRow(qPrintable(QStringLiteral("sines") + suffix)) << bits << 0;
+        QTest::newRow(qPrintable(QStringLiteral("correlated") + suffix)) << bits << 1;
+        QTest::newRow(qPrintable(QStringLiteral("noise") + suffix)) << bits << 2;
+        QTest::newRow(qPrintable(QStringLiteral("square") + suffix)) << bits << 3;
+    }
+}
+
+void TestFlac::roundTrip() {
+    QFETCH(int, bits);
+    QFETCH(int, signal);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    // a few blocks and a partial one
+    size_t const frames = Flac::BLOCK_SIZE * 3 + 1000;
+    std::vector<float> samples(frames * 2);
+    uint32_t noise = 12345;
+    for (size_t i = 0; i < frames; ++i) {
+        float left, right;
+        switch (signal) {
+            case 0:
+                left = 0.6f * (float)std::sin(i * 0.031);
+                right = 0.4f * (float)std::sin(i * 0.017 + 1.0);
+                break;
+            case 1:
+                left = 0.5f * (float)std::sin(i * 0.02) + 0.1f * (float)std::sin(i * 0.3);
+                right = left * 0.9f;
+                break;
+            case 2:
+                noise = noise * 1664525u + 1013904223u;
+                left = (float)(int32_t)noise / 2147483648.0f;
+                noise = noise * 1664525u + 1013904223u;
+                right = (float)(int32_t)noise / 2147483648.0f;
+                break;
+            default:
+                left = (i / 37) & 1 ? 0.5f : -0.5f;
+                right = (i / 91) & 1 ? 0.25f : -0.75f;
+                break;
+        }
+        samples[i * 2] = left;
+        samples[i * 2 + 1] = right;
+    }
+
+    auto const data = TU::encode(dir.filePath("roundtrip.flac"), samples, bits);
+    QVERIFY(!data.isEmpty());
+
+    std::vector<int32_t> expected(samples.size());
+    convertToInt(samples.data(), expected.data(), samples.size(), bits, nullptr);
+
+    std::vector<int32_t> decoded;
+    TU::Decoder decoder(data);
+    QVERIFY(decoder.decode(decoded));
+    QCOMPARE(decoded.size(), expected.size());
+    QVERIFY(decoded == expected);
+}
+
+#undef TU
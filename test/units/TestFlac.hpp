@@ -0,0 +1,22 @@
+#pragma once
+
+#include <QtTest/QtTest>
+
+class TestFlac : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    Q_INVOKABLE TestFlac();
+
+private slots:
+
+    void streamInfo();
+
+    void silenceCompresses();
+
+    void roundTrip_data();
+    void roundTrip();
+
+};
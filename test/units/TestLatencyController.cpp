@@ -0,0 +1,81 @@
+
+#include "units/TestLatencyController.hpp"
+
+#include "audio/LatencyController.hpp"
+
+#define TU TestLatencyControllerTU
+namespace TU {
+
+constexpr unsigned SAMPLERATE = 48000;
+// 5 ms period
+constexpr size_t PERIOD = SAMPLERATE / 200;
+constexpr size_t MIN_SIZE = SAMPLERATE / 100;   // 10 ms
+constexpr size_t MAX_SIZE = SAMPLERATE / 10;    // 100 ms
+
+//
+// Runs the controller for the given number of seconds with a steady period,
+// where the buffer still has the given fraction of its size remaining at
+// the start of each period.
+//
+size_t runStable(LatencyController &lc, unsigned underruns, double seconds, double fillRatio) {
+    size_t size = lc.size();
+    auto periods = (size_t)(seconds * SAMPLERATE / PERIOD);
+    while (periods--) {
+        size = lc.update(underruns, (size_t)(size * fillRatio), PERIOD);
+    }
+    return size;
+}
+
+}
+
+TestLatencyController::TestLatencyController() {
+
+}
+
+void TestLatencyController::startsAtMaximum() {
+    LatencyController lc;
+    lc.setup(TU::MIN_SIZE, TU::MAX_SIZE, TU::SAMPLERATE);
+    QCOMPARE(lc.size(), TU::MAX_SIZE);
+    QCOMPARE(lc.minSize(), TU::MIN_SIZE);
+    QCOMPARE(lc.maxSize(), TU::MAX_SIZE);
+}
+
+void TestLatencyController::growsOnUnderrun() {
+    LatencyController lc;
+    lc.setup(TU::MIN_SIZE, TU::MAX_SIZE, TU::SAMPLERATE);
+    auto const small = TU::runStable(lc, 0, 30.0, 0.75);
+    QVERIFY(small < TU::MAX_SIZE);
+
+    // a single underrun grows the buffer immediately
+    auto const grown = lc.update(1, 0, TU::PERIOD);
+    QCOMPARE(grown, std::min(small * 2, TU::MAX_SIZE));
+
+    // clearing the underrun counter does not grow it
+    QCOMPARE(lc.update(0, grown / 2, TU::PERIOD), grown);
+}
+
+void TestLatencyController::shrinksWhenStable() {
+    LatencyController lc;
+    lc.setup(TU::MIN_SIZE, TU::MAX_SIZE, TU::SAMPLERATE);
+
+    // less than a second of stable playback, no change
+    QCOMPARE(TU::runStable(lc, 0, 0.5, 0.9), TU::MAX_SIZE);
+
+    // a lot of unused headroom, converges on the lower bound
+    QCOMPARE(TU::runStable(lc, 0, 60.0, 0.9), TU::MIN_SIZE);
+}
+
+void TestLatencyController::keepsRoomForJitter() {
+    LatencyController lc;
+    lc.setup(0, TU::MAX_SIZE, TU::SAMPLERATE);
+
+    // periods of up to 20 ms, the buffer must hold at least two of them
+    constexpr size_t LONG_PERIOD = TU::SAMPLERATE / 50;
+    for (int i = 0; i < 60 * 50; ++i) {
+        auto const period = (i % 4 == 0) ? LONG_PERIOD : TU::PERIOD;
+        lc.update(0, lc.size() / 2, period);
+    }
+    QCOMPARE(lc.size(), LONG_PERIOD * 2);
+}
+
+#undef TU
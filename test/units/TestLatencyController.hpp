@@ -0,0 +1,24 @@
+
+#pragma once
+
+#include <QtTest/QtTest>
+
+class TestLatencyController : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    Q_INVOKABLE TestLatencyController();
+
+private slots:
+
+    void startsAtMaximum();
+
+    void growsOnUnderrun();
+
+    void shrinksWhenStable();
+
+    void keepsRoomForJitter();
+
+};
@@ -0,0 +1,85 @@
+#include "units/TestLoudnessMeter.hpp"
+
+#include "audio/LoudnessMeter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#define TU TestLoudnessMeterTU
+namespace TU {
+
+//
+// 5 seconds of a full scale 997 Hz sine, in one or both channels
+//
+std::vector<float> sine(int samplerate, bool stereo) {
+    constexpr double PI = 3.14159265358979323846;
+    size_t const frames = samplerate * 5;
+    std::vector<float> samples(frames * 2);
+    for (size_t i = 0; i < frames; ++i) {
+        auto const sample = (float)std::sin(2.0 * PI * 997.0 * i / samplerate);
+        samples[i * 2] = sample;
+        samples[i * 2 + 1] = stereo ? sample : 0.0f;
+    }
+    return samples;
+}
+
+}
+
+TestLoudnessMeter::TestLoudnessMeter() {
+
+}
+
+void TestLoudnessMeter::sineLevels_data() {
+    QTest::addColumn<int>("samplerate");
+    QTest::addColumn<bool>("stereo");
+    QTest::addColumn<double>("loudness");
+
+    // BS.1770 calibration: a full scale 997 Hz sine in one channel reads
+    // -3.01 LUFS
+    QTest::newRow("48000 left") << 48000 << false << -3.01;
+    QTest::newRow("48000 stereo") << 48000 << true << 0.0;
+    QTest::newRow("44100 stereo") << 44100 << true << 0.0;
+}
+
+void TestLoudnessMeter::sineLevels() {
+    QFETCH(int, samplerate);
+    QFETCH(bool, stereo);
+    QFETCH(double, loudness);
+
+    auto const samples = TU::sine(samplerate, stereo);
+    LoudnessMeter meter(samplerate);
+    // uneven amounts, so that sub-blocks span calls
+    size_t const frames = samples.size() / 2;
+    for (size_t pos = 0; pos < frames; pos += 881) {
+        meter.process(samples.data() + pos * 2, std::min<size_t>(881, frames - pos));
+    }
+
+    auto const levels = meter.levels();
+    QVERIFY(std::abs(levels.peak) < 0.01);
+    QVERIFY(std::abs(levels.loudness - loudness) < 0.05);
+    if (stereo) {
+        QVERIFY(std::abs(levels.rms + 3.01) < 0.01);
+    }
+}
+
+void TestLoudnessMeter::silence() {
+    std::vector<float> samples(44100 * 2);
+    LoudnessMeter meter(44100);
+    meter.process(samples.data(), samples.size() / 2);
+
+    auto const levels = meter.levels();
+    QVERIFY(std::isinf(levels.peak));
+    QVERIFY(std::isinf(levels.rms));
+    QVERIFY(std::isinf(levels.loudness));
+
+    // the gated loudness of silence is not normalized
+    QCOMPARE(LoudnessMeter::normalizeGain(levels.loudness, -14.0), 1.0);
+}
+
+void TestLoudnessMeter::normalizeGain() {
+    QVERIFY(std::abs(LoudnessMeter::normalizeGain(-20.0, -14.0) - 1.9953) < 0.001);
+    QVERIFY(std::abs(LoudnessMeter::normalizeGain(-8.0, -14.0) - 0.5012) < 0.001);
+}
+
+#undef TU
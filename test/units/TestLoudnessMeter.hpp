@@ -0,0 +1,22 @@
+#pragma once
+
+#include <QtTest/QtTest>
+
+class TestLoudnessMeter : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    Q_INVOKABLE TestLoudnessMeter();
+
+private slots:
+
+    void sineLevels_data();
+    void sineLevels();
+
+    void silence();
+
+    void normalizeGain();
+
+};
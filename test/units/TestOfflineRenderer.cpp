@@ -0,0 +1,141 @@
+#include "units/TestOfflineRenderer.hpp"
+
+#include "export/OfflineRenderer.hpp"
+#include "export/PipelineSink.hpp"
+
+#include "trackerboy/data/Module.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+
+TestOfflineRenderer::TestOfflineRenderer() {
+
+}
+
+void TestOfflineRenderer::renderToBuffer_data() {
+    QTest::addColumn<bool>("timed");
+
+    QTest::newRow("loops") << false;
+    QTest::newRow("time") << true;
+}
+
+void TestOfflineRenderer::renderToBuffer() {
+    QFETCH(bool, timed);
+
+    trackerboy::Module mod;
+    OfflineRenderer renderer(mod, 48000);
+    if (timed) {
+        renderer.setDuration(std::chrono::seconds(2));
+    } else {
+        renderer.setDuration(1);
+    }
+
+    BufferSink sink;
+    QVERIFY(renderer.render(sink));
+
+    // the expected length covers the render, so the buffer never grew past
+    // its reservation
+    auto const expected = renderer.expectedFrames();
+    auto const& samples = sink.samples();
+    QVERIFY(!samples.empty());
+    QVERIFY(samples.size() <= expected * 2);
+    QCOMPARE(samples.capacity(), expected * 2);
+    if (timed) {
+        QVERIFY(samples.size() >= 2 * 48000 * 2 - 2 * renderer.samplerate() / 50);
+    }
+}
+
+void TestOfflineRenderer::callbackStops() {
+    trackerboy::Module mod;
+    OfflineRenderer renderer(mod);
+    renderer.setDuration(std::chrono::seconds(10));
+
+    size_t calls = 0;
+    CallbackSink sink([&calls](float const *samples, size_t frames) {
+        Q_UNUSED(samples)
+        Q_UNUSED(frames)
+        return ++calls < 5;
+    });
+    QVERIFY(!renderer.render(sink));
+    QCOMPARE(calls, (size_t)5);
+}
+
+void TestOfflineRenderer::invalidSong() {
+    trackerboy::Module mod;
+    OfflineRenderer renderer(mod);
+    renderer.setSong(1);
+
+    BufferSink sink;
+    QVERIFY(!renderer.render(sink));
+    QCOMPARE(renderer.expectedFrames(), (size_t)0);
+}
+
+void TestOfflineRenderer::pipelineMatches() {
+    trackerboy::Module mod;
+    OfflineRenderer renderer(mod);
+    renderer.setDuration(std::chrono::seconds(2));
+
+    BufferSink direct;
+    QVERIFY(renderer.render(direct));
+
+    // a buffer smaller than two engine frames, so that the renderer waits on
+    // the writer and writes wrap around the end of the storage
+    BufferSink buffered;
+    PipelineSink pipeline(buffered, 1000);
+    QVERIFY(renderer.render(pipeline));
+
+    QCOMPARE(buffered.samples(), direct.samples());
+}
+
+void TestOfflineRenderer::pipelineStops() {
+    trackerboy::Module mod;
+    OfflineRenderer renderer(mod);
+    renderer.setDuration(std::chrono::seconds(10));
+
+    size_t calls = 0;
+    CallbackSink sink([&calls](float const *samples, size_t frames) {
+        Q_UNUSED(samples)
+        Q_UNUSED(frames)
+        return ++calls < 5;
+    });
+    PipelineSink pipeline(sink, 1000);
+    QVERIFY(!renderer.render(pipeline));
+    QCOMPARE(calls, (size_t)5);
+}
+
+void TestOfflineRenderer::singlePassMatchesChannels() {
+    // a note on every channel, starting on different rows
+    trackerboy::Module mod;
+    auto &patterns = mod.songs().get(0)->patterns();
+    for (int ch = 0; ch < 4; ++ch) {
+        auto &track = patterns.getTrack(static_cast<trackerboy::ChType>(ch), 0);
+        auto const row = (uint16_t)(ch * 4);
+        track.setNote(row, (uint8_t)(trackerboy::NOTE_C + trackerboy::OCTAVE_4 + ch * 3));
+        track.setEffect(row, 0, trackerboy::EffectType::setEnvelope, 0xF0);
+        track.setNote(row + 16, (uint8_t)(trackerboy::NOTE_G + trackerboy::OCTAVE_4));
+    }
+
+    OfflineRenderer renderer(mod);
+    renderer.setDuration(1);
+
+    // every channel to its own output in one pass
+    std::array<BufferSink, 4> stems;
+    std::array<OfflineRenderer::Output, 4> outputs;
+    for (int ch = 0; ch < 4; ++ch) {
+        outputs[ch] = { (ChannelOutput::Flag)(1 << ch), &stems[ch] };
+    }
+    QVERIFY(renderer.render(outputs.data(), outputs.size()));
+
+    // the channel stems are not silent, so the comparison means something
+    auto const& ch1 = stems[0].samples();
+    QVERIFY(std::any_of(ch1.begin(), ch1.end(), [](float sample) { return sample != 0.0f; }));
+
+    // and the same as rendering each channel on its own
+    for (int ch = 0; ch < 4; ++ch) {
+        BufferSink separate;
+        renderer.setChannels((ChannelOutput::Flag)(1 << ch));
+        QVERIFY(renderer.render(separate));
+        QCOMPARE(stems[ch].samples(), separate.samples());
+    }
+}
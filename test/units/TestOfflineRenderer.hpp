@@ -0,0 +1,28 @@
+#pragma once
+
+#include <QtTest/QtTest>
+
+class TestOfflineRenderer : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    Q_INVOKABLE TestOfflineRenderer();
+
+private slots:
+
+    void renderToBuffer_data();
+    void renderToBuffer();
+
+    void callbackStops();
+
+    void invalidSong();
+
+    void pipelineMatches();
+
+    void pipelineStops();
+
+    void singlePassMatchesChannels();
+
+};
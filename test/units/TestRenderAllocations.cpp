@@ -0,0 +1,155 @@
+
+#include "units/TestRenderAllocations.hpp"
+
+#include "audio/Renderer.hpp"
+#include "core/Module.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#define TU TestRenderAllocationsTU
+namespace TU {
+
+// allocations are only counted on a thread while this is set
+thread_local bool tracking = false;
+std::atomic_uint allocationCount = 0;
+
+void count() {
+    if (tracking) {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+//
+// Counts allocations made by the calling thread while in scope
+//
+class Tracker {
+
+public:
+    Tracker() {
+        allocationCount = 0;
+        tracking = true;
+    }
+
+    ~Tracker() {
+        tracking = false;
+    }
+
+    unsigned allocations() const {
+        return allocationCount.load(std::memory_order_relaxed);
+    }
+
+};
+
+// render in device sized chunks, for 1 second at 48000 Hz
+constexpr size_t CHUNK = 480;
+constexpr int CHUNKS = 100;
+
+}
+
+// The replacements for the global allocation functions. operator new[] and
+// the nothrow variants call these by default. malloc and friends are also
+// replaced when using glibc, as Qt allocates with them (an operator new is
+// then counted twice, which doesn't matter as we expect none).
+
+void* operator new(std::size_t size) {
+    TU::count();
+    if (auto p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+#ifdef __GLIBC__
+
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void *ptr, size_t size);
+
+void* malloc(size_t size) {
+    TU::count();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    TU::count();
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void *ptr, size_t size) {
+    TU::count();
+    return __libc_realloc(ptr, size);
+}
+
+}
+
+#endif
+
+TestRenderAllocations::TestRenderAllocations() {
+
+}
+
+void TestRenderAllocations::musicDoesNotAllocate() {
+    Module mod;
+    Renderer renderer(mod);
+    std::vector<float> buf(TU::CHUNK * 2);
+
+    renderer.beginOfflineRender(48000);
+
+    // commands are applied by the render, which may allocate
+    renderer.play(0, 0, false);
+    render(renderer, buf, TU::CHUNKS);
+
+    unsigned allocations;
+    {
+        TU::Tracker tracker;
+        render(renderer, buf, TU::CHUNKS);
+        allocations = tracker.allocations();
+    }
+    QCOMPARE(allocations, 0u);
+    QVERIFY(renderer.isPlaying());
+}
+
+void TestRenderAllocations::previewDoesNotAllocate() {
+    Module mod;
+    Renderer renderer(mod);
+    std::vector<float> buf(TU::CHUNK * 2);
+
+    renderer.beginOfflineRender(48000);
+
+    // note preview on CH1, steps the previewer every frame
+    renderer.instrumentPreview(48, 0, -1);
+    render(renderer, buf, TU::CHUNKS);
+
+    unsigned allocations;
+    {
+        TU::Tracker tracker;
+        render(renderer, buf, TU::CHUNKS);
+        allocations = tracker.allocations();
+    }
+    QCOMPARE(allocations, 0u);
+}
+
+void TestRenderAllocations::render(Renderer &renderer, std::vector<float> &buf, int chunks) {
+    // the callback render path, which is the same path used by the timer
+    // minus the stream's buffer
+    while (chunks--) {
+        std::fill(buf.begin(), buf.end(), 0.0f);
+        renderer.renderOffline(buf.data(), TU::CHUNK);
+    }
+}
+
+#undef TU
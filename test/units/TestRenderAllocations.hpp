@@ -0,0 +1,37 @@
+#pragma once
+
+#include <QtTest/QtTest>
+
+#include <vector>
+
+class Renderer;
+
+//
+// Checks that the render path does not allocate once rendering. The global
+// allocation functions are replaced in TestRenderAllocations.cpp, and count
+// allocations made by a thread while it is being tracked. Since these
+// replacements apply to the whole executable, this test is built into its
+// own (see ISOLATED_TESTLIST in test/CMakeLists.txt).
+//
+class TestRenderAllocations : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    Q_INVOKABLE TestRenderAllocations();
+
+private slots:
+
+    void musicDoesNotAllocate();
+
+    void previewDoesNotAllocate();
+
+private:
+
+    //
+    // Renders the given number of chunks from the render callback
+    //
+    void render(Renderer &renderer, std::vector<float> &buf, int chunks);
+
+};
@@ -0,0 +1,61 @@
+
+#include "units/TestRenderProfile.hpp"
+
+#include "audio/RenderProfile.hpp"
+
+TestRenderProfile::TestRenderProfile() {
+
+}
+
+void TestRenderProfile::percentiles() {
+    RenderProfile profile(100);
+    // render times of 1 to 100 us, in reverse so that order doesn't matter
+    for (int i = 100; i >= 1; --i) {
+        profile.add({ 5000.0f, (float)i, 0.0f, 0.0f, 0.0f, 0, 0 });
+    }
+
+    auto const stats = profile.stats();
+    QCOMPARE(stats.periods, (size_t)100);
+    QCOMPARE(stats.render.p50, 50.0f);
+    QCOMPARE(stats.render.p95, 95.0f);
+    QCOMPARE(stats.render.p99, 99.0f);
+    QCOMPARE(stats.render.max, 100.0f);
+    QCOMPARE(stats.interval.p50, 5000.0f);
+    QCOMPARE(stats.interval.max, 5000.0f);
+}
+
+void TestRenderProfile::load() {
+    RenderProfile profile;
+    // 25% and 75% of a 1 ms period
+    profile.add({ 1000.0f, 300.0f, 100.0f, 100.0f, 50.0f, 2, 0 });
+    profile.add({ 1000.0f, 800.0f, 300.0f, 300.0f, 150.0f, 9, 1 });
+
+    auto const stats = profile.stats();
+    QCOMPARE(stats.loadAvg, 50.0f);
+    QCOMPARE(stats.loadMax, 75.0f);
+    QCOMPARE(stats.stepAvg, 200.0f);
+    QCOMPARE(stats.synthAvg, 200.0f);
+    QCOMPARE(stats.readAvg, 100.0f);
+    QCOMPARE(stats.deferred, 11u);
+    QCOMPARE(stats.dropped, 1u);
+
+    // no interval, no load
+    QCOMPARE(RenderProfile::load({ 0.0f, 10.0f, 10.0f, 0.0f, 0.0f, 0, 0 }), 0.0f);
+}
+
+void TestRenderProfile::keepsRecentPeriods() {
+    RenderProfile profile(4);
+    for (int i = 1; i <= 6; ++i) {
+        profile.add({ (float)i, 0.0f, 0.0f, 0.0f, 0.0f, 0, 0 });
+    }
+
+    // 1 and 2 were discarded
+    QCOMPARE(profile.size(), (size_t)4);
+    for (size_t i = 0; i < 4; ++i) {
+        QCOMPARE(profile.at(i).interval, 3.0f + i);
+    }
+
+    profile.clear();
+    QCOMPARE(profile.size(), (size_t)0);
+    QCOMPARE(profile.stats().periods, (size_t)0);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <QtTest/QtTest>
+
+class TestRenderProfile : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    Q_INVOKABLE TestRenderProfile();
+
+private slots:
+
+    void percentiles();
+
+    void load();
+
+    void keepsRecentPeriods();
+
+};
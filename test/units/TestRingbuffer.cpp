@@ -0,0 +1,371 @@
+#include "units/TestRingbuffer.hpp"
+
+#include "audio/Ringbuffer.hpp"
+
+#include "miniaudio.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#define TU TestRingbufferTU
+namespace TU {
+
+//
+// The ma_rb wrapper that AudioRingbuffer replaced, kept here so the two can
+// be compared. Mirrors the fullRead/fullWrite path of the old RingbufferBase.
+//
+class MaRingbuffer {
+
+public:
+    static constexpr size_t SIZE_UNIT = sizeof(float) * 2;
+
+    explicit MaRingbuffer(size_t frames) :
+        mRb()
+    {
+        auto result = ma_rb_init(frames * SIZE_UNIT, nullptr, nullptr, &mRb);
+        Q_ASSERT(result == MA_SUCCESS);
+        Q_UNUSED(result)
+    }
+
+    ~MaRingbuffer() {
+        ma_rb_uninit(&mRb);
+    }
+
+    size_t write(float const *data, size_t frames) {
+        size_t bytes = frames * SIZE_UNIT;
+        size_t avail = ma_rb_available_write(&mRb);
+        if (avail == 0) {
+            return 0;
+        }
+        size_t written = writeOnce(data, bytes);
+        bytes -= written;
+        avail -= written;
+        if (bytes != 0 && avail) {
+            written += writeOnce(reinterpret_cast<uint8_t const*>(data) + written, bytes);
+        }
+        return written / SIZE_UNIT;
+    }
+
+    size_t read(float *data, size_t frames) {
+        size_t bytes = frames * SIZE_UNIT;
+        size_t avail = ma_rb_available_read(&mRb);
+        if (avail == 0) {
+            return 0;
+        }
+        size_t nread = readOnce(data, bytes);
+        bytes -= nread;
+        avail -= nread;
+        if (bytes != 0 && avail) {
+            nread += readOnce(reinterpret_cast<uint8_t*>(data) + nread, bytes);
+        }
+        return nread / SIZE_UNIT;
+    }
+
+private:
+
+    size_t writeOnce(void const *data, size_t bytes) {
+        void *dest;
+        auto result = ma_rb_acquire_write(&mRb, &bytes, &dest);
+        Q_ASSERT(result == MA_SUCCESS);
+        memcpy(dest, data, bytes);
+        result = ma_rb_commit_write(&mRb, bytes);
+        Q_ASSERT(result == MA_SUCCESS || result == MA_AT_END);
+        Q_UNUSED(result)
+        return bytes;
+    }
+
+    size_t readOnce(void *data, size_t bytes) {
+        void *src;
+        auto result = ma_rb_acquire_read(&mRb, &bytes, &src);
+        Q_ASSERT(result == MA_SUCCESS);
+        memcpy(data, src, bytes);
+        result = ma_rb_commit_read(&mRb, bytes);
+        Q_ASSERT(result == MA_SUCCESS || result == MA_AT_END);
+        Q_UNUSED(result)
+        return bytes;
+    }
+
+    ma_rb mRb;
+};
+
+//
+// Adapts AudioRingbuffer to the same interface as MaRingbuffer
+//
+class SpscRingbuffer {
+
+public:
+    explicit SpscRingbuffer(size_t frames) :
+        mRb()
+    {
+        mRb.init(frames);
+    }
+
+    size_t write(float const *data, size_t frames) {
+        return mRb.writer().write(data, frames);
+    }
+
+    size_t read(float *data, size_t frames) {
+        return mRb.reader().read(data, frames);
+    }
+
+private:
+    AudioRingbuffer mRb;
+};
+
+struct StreamResult {
+    double framesPerSecond;
+    double p50;     // read latency percentiles, in nanoseconds
+    double p99;
+    double p999;
+    double max;
+    bool intact;    // all frames were received in order
+};
+
+//
+// Streams `seconds` worth of audio through the given ringbuffer type, using
+// the same shape as the application: a producer filling the buffer in 5 ms
+// periods and a consumer pulling device-sized (10 ms) blocks. Both threads run
+// as fast as they can. Each frame carries its index so the consumer can check
+// that nothing was lost or reordered.
+//
+template <class Rb>
+StreamResult stream(int samplerate, int seconds) {
+    using Clock = std::chrono::steady_clock;
+
+    size_t const totalFrames = (size_t)samplerate * seconds;
+    size_t const bufferFrames = (size_t)samplerate * 40 / 1000;
+    size_t const periodFrames = (size_t)samplerate * 5 / 1000;
+    size_t const deviceFrames = (size_t)samplerate * 10 / 1000;
+
+    Rb rb(bufferFrames);
+
+    std::thread producer([&]() {
+        std::vector<float> block(periodFrames * 2);
+        size_t frame = 0;
+        while (frame < totalFrames) {
+            auto const count = std::min(periodFrames, totalFrames - frame);
+            for (size_t i = 0; i < count; ++i) {
+                block[i * 2] = (float)(frame + i);
+                block[i * 2 + 1] = -(float)(frame + i);
+            }
+            size_t written = 0;
+            while (written < count) {
+                auto const n = rb.write(block.data() + written * 2, count - written);
+                if (n == 0) {
+                    std::this_thread::yield();
+                }
+                written += n;
+            }
+            frame += count;
+        }
+    });
+
+    std::vector<float> block(deviceFrames * 2);
+    std::vector<Clock::rep> latencies;
+    latencies.reserve(totalFrames / deviceFrames * 4 + 1);
+    bool intact = true;
+    size_t frame = 0;
+
+    auto const start = Clock::now();
+    while (frame < totalFrames) {
+        auto const before = Clock::now();
+        auto nread = rb.read(block.data(), deviceFrames);
+        auto const after = Clock::now();
+        if (nread == 0) {
+            std::this_thread::yield();
+            continue;
+        }
+        latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count());
+        for (size_t i = 0; i < nread; ++i) {
+            if (block[i * 2] != (float)(frame + i) || block[i * 2 + 1] != -(float)(frame + i)) {
+                intact = false;
+            }
+        }
+        frame += nread;
+    }
+    auto const elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    producer.join();
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        if (latencies.empty()) {
+            return 0.0;
+        }
+        auto index = (size_t)(p * (latencies.size() - 1));
+        return (double)latencies[index];
+    };
+
+    return {
+        totalFrames / elapsed,
+        percentile(0.5),
+        percentile(0.99),
+        percentile(0.999),
+        percentile(1.0),
+        intact
+    };
+}
+
+}
+
+TestRingbuffer::TestRingbuffer() {
+
+}
+
+void TestRingbuffer::readWrite() {
+    Ringbuffer<int> rb;
+    rb.init(8);
+    QCOMPARE(rb.size(), (size_t)8);
+
+    auto writer = rb.writer();
+    auto reader = rb.reader();
+    QCOMPARE(writer.availableWrite(), (size_t)8);
+    QCOMPARE(reader.availableRead(), (size_t)0);
+
+    int const in[] = { 1, 2, 3, 4, 5 };
+    QCOMPARE(writer.write(in, 5), (size_t)5);
+    QCOMPARE(writer.availableWrite(), (size_t)3);
+    QCOMPARE(reader.availableRead(), (size_t)5);
+
+    // writes are truncated to the space available
+    QCOMPARE(writer.write(in, 5), (size_t)3);
+    QCOMPARE(writer.availableWrite(), (size_t)0);
+
+    int out[8] = { 0 };
+    QCOMPARE(reader.read(out, 8), (size_t)8);
+    int const expected[] = { 1, 2, 3, 4, 5, 1, 2, 3 };
+    QVERIFY(std::equal(out, out + 8, expected));
+    QCOMPARE(reader.read(out, 8), (size_t)0);
+
+    rb.reset();
+    QCOMPARE(writer.availableWrite(), (size_t)8);
+}
+
+void TestRingbuffer::wrapAround() {
+    Ringbuffer<float, 2> rb;
+    rb.init(4);
+
+    auto writer = rb.writer();
+    auto reader = rb.reader();
+
+    float const in[] = { 1, -1, 2, -2, 3, -3 };
+    float out[6];
+
+    // move the indices so that the next write wraps
+    QCOMPARE(writer.write(in, 3), (size_t)3);
+    QCOMPARE(reader.read(out, 3), (size_t)3);
+
+    QCOMPARE(writer.write(in, 3), (size_t)3);
+    std::fill_n(out, 6, 0.0f);
+    QCOMPARE(reader.read(out, 3), (size_t)3);
+    QVERIFY(std::equal(out, out + 6, in));
+}
+
+void TestRingbuffer::acquireCommit() {
+    Ringbuffer<int> rb;
+    rb.init(4);
+    auto writer = rb.writer();
+    auto reader = rb.reader();
+
+    int const in[] = { 1, 2, 3 };
+    writer.write(in, 3);
+    reader.seekRead(3);
+
+    // only one frame is contiguous before the end of the storage
+    size_t count = 4;
+    auto ptr = writer.acquireWrite(count);
+    QCOMPARE(count, (size_t)1);
+    *ptr = 10;
+    writer.commitWrite(1);
+
+    count = 4;
+    ptr = writer.acquireWrite(count);
+    QCOMPARE(count, (size_t)3);
+    ptr[0] = 11;
+    writer.commitWrite(1);
+
+    count = 4;
+    auto rptr = reader.acquireRead(count);
+    QCOMPARE(count, (size_t)1);
+    QCOMPARE(*rptr, 10);
+    reader.commitRead(1);
+
+    count = 4;
+    rptr = reader.acquireRead(count);
+    QCOMPARE(count, (size_t)1);
+    QCOMPARE(*rptr, 11);
+    reader.commitRead(1);
+    QCOMPARE(reader.availableRead(), (size_t)0);
+}
+
+void TestRingbuffer::nonPowerOfTwo() {
+    // the usable size is what was requested, not the rounded up storage
+    Ringbuffer<float, 2> rb;
+    rb.init(1764);
+    QCOMPARE(rb.size(), (size_t)1764);
+    QCOMPARE(rb.writer().availableWrite(), (size_t)1764);
+
+    std::vector<float> buf(2048 * 2);
+    QCOMPARE(rb.writer().write(buf.data(), 2048), (size_t)1764);
+    rb.reader().flush();
+    QCOMPARE(rb.reader().availableRead(), (size_t)0);
+    QCOMPARE(rb.writer().availableWrite(), (size_t)1764);
+}
+
+void TestRingbuffer::setSize() {
+    Ringbuffer<float, 2> rb;
+    rb.init(1000);
+    QCOMPARE(rb.capacity(), (size_t)1024);
+
+    std::vector<float> buf(1024 * 2);
+    QCOMPARE(rb.writer().write(buf.data(), 800), (size_t)800);
+
+    // shrinking below the amount buffered blocks the writer until the reader catches up
+    rb.writer().setSize(500);
+    QCOMPARE(rb.size(), (size_t)500);
+    QCOMPARE(rb.writer().availableWrite(), (size_t)0);
+    QCOMPARE(rb.writer().write(buf.data(), 100), (size_t)0);
+    QCOMPARE(rb.reader().read(buf.data(), 400), (size_t)400);
+    QCOMPARE(rb.writer().availableWrite(), (size_t)100);
+
+    // growing is limited to the capacity
+    rb.writer().setSize(4096);
+    QCOMPARE(rb.size(), (size_t)1024);
+    QCOMPARE(rb.writer().availableWrite(), (size_t)624);
+}
+
+void TestRingbuffer::benchmark_data() {
+    QTest::addColumn<bool>("spsc");
+    QTest::addColumn<int>("samplerate");
+
+    for (auto rate : { 44100, 48000, 96000 }) {
+        QTest::addRow("ma_rb %d Hz", rate) << false << rate;
+        QTest::addRow("spsc %d Hz", rate) << true << rate;
+    }
+}
+
+void TestRingbuffer::benchmark() {
+    QFETCH(bool, spsc);
+    QFETCH(int, samplerate);
+
+    // 60 seconds of audio per run
+    constexpr int SECONDS = 60;
+
+    auto const result = spsc
+        ? TU::stream<TU::SpscRingbuffer>(samplerate, SECONDS)
+        : TU::stream<TU::MaRingbuffer>(samplerate, SECONDS);
+
+    QVERIFY(result.intact);
+
+    qInfo().noquote() << QStringLiteral(
+        "%1 Mframes/s | read latency p50 %2 ns, p99 %3 ns, p99.9 %4 ns, max %5 ns")
+        .arg(result.framesPerSecond / 1e6, 0, 'f', 2)
+        .arg(result.p50, 0, 'f', 0)
+        .arg(result.p99, 0, 'f', 0)
+        .arg(result.p999, 0, 'f', 0)
+        .arg(result.max, 0, 'f', 0);
+}
+
+#undef TU
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <QtTest/QtTest>
+
+class TestRingbuffer : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    Q_INVOKABLE TestRingbuffer();
+
+private slots:
+
+    void readWrite();
+
+    void wrapAround();
+
+    void acquireCommit();
+
+    void nonPowerOfTwo();
+
+    void setSize();
+
+    // compares the SPSC ringbuffer against the old ma_rb wrapper
+    void benchmark_data();
+    void benchmark();
+
+};
@@ -0,0 +1,76 @@
+
+#include "units/TestSampleFormat.hpp"
+
+#include "audio/SampleFormat.hpp"
+
+#include <vector>
+
+TestSampleFormat::TestSampleFormat() {
+
+}
+
+void TestSampleFormat::convertToS16() {
+    // 11 samples, so that both the vectorized and remaining loops are used
+    std::vector<float> const in = {
+        0.0f, 1.0f, -1.0f, 0.5f, -0.5f, 2.0f, -2.0f, 0.25f,
+        1.5f, -0.25f, 0.0001f
+    };
+    std::vector<int16_t> const expected = {
+        0, 32767, -32767, 16384, -16384, 32767, -32767, 8192,
+        32767, -8192, 3
+    };
+
+    std::vector<int16_t> out(in.size());
+    ::convertToS16(in.data(), out.data(), in.size());
+    QCOMPARE(out, expected);
+}
+
+void TestSampleFormat::convertToPcm16() {
+    // 11 samples, so that both the vectorized and remaining loops are used
+    std::vector<float> const in = {
+        0.0f, 1.0f, -1.0f, 0.5f, -0.5f, 2.0f, -2.0f, 0.25f,
+        1.5f, -0.25f, -1.0001f
+    };
+    std::vector<int16_t> const expected = {
+        0, 32767, -32767, 16384, -16384, 32767, -32767, 8192,
+        32767, -8192, -32767
+    };
+
+    std::vector<int16_t> out(in.size());
+    auto const clipped = ::convertToPcm16(in.data(), out.data(), in.size(), nullptr);
+    QCOMPARE(out, expected);
+    QCOMPARE(clipped, (size_t)4);
+}
+
+void TestSampleFormat::convertToPcm24() {
+    std::vector<float> const in = { 0.0f, 1.0f, -1.0f, 0.5f, 2.0f, -0.5f };
+    std::vector<uint8_t> const expected = {
+        0x00, 0x00, 0x00,   // 0
+        0xFF, 0xFF, 0x7F,   // 8388607
+        0x01, 0x00, 0x80,   // -8388607
+        0x00, 0x00, 0x40,   // 4194304
+        0xFF, 0xFF, 0x7F,   // clipped
+        0x00, 0x00, 0xC0    // -4194304
+    };
+
+    std::vector<uint8_t> out(in.size() * 3);
+    auto const clipped = ::convertToPcm24(in.data(), out.data(), in.size(), nullptr);
+    QCOMPARE(out, expected);
+    QCOMPARE(clipped, (size_t)1);
+}
+
+void TestSampleFormat::ditherBounds() {
+    // TPDF dither is at most 1 LSB either way, so silence stays within +/- 1
+    std::vector<float> const in(1003, 0.0f);
+    std::vector<int16_t> out(in.size());
+    Dither dither;
+    auto const clipped = ::convertToPcm16(in.data(), out.data(), in.size(), &dither);
+    QCOMPARE(clipped, (size_t)0);
+
+    bool nonzero = false;
+    for (auto sample : out) {
+        QVERIFY(sample >= -1 && sample <= 1);
+        nonzero = nonzero || sample != 0;
+    }
+    QVERIFY(nonzero);
+}
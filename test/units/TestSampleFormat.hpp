@@ -0,0 +1,23 @@
+#pragma once
+
+#include <QtTest/QtTest>
+
+class TestSampleFormat : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    Q_INVOKABLE TestSampleFormat();
+
+private slots:
+
+    void convertToS16();
+
+    void convertToPcm16();
+
+    void convertToPcm24();
+
+    void ditherBounds();
+
+};
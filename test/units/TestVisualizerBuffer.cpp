@@ -0,0 +1,95 @@
+
+#include "units/TestVisualizerBuffer.hpp"
+
+#include "audio/VisualizerBuffer.hpp"
+
+#include <vector>
+
+#define TU TestVisualizerBufferTU
+namespace TU {
+
+constexpr size_t SIZE = 4;
+
+//
+// Writes count frames with both channels set to the frame's number, starting
+// at first.
+//
+void writeFrames(VisualizerBuffer &buf, float first, size_t count) {
+    std::vector<float> data;
+    for (size_t i = 0; i < count; ++i) {
+        data.push_back(first + i);
+        data.push_back(first + i);
+    }
+    buf.beginWrite(count);
+    buf.write(data.data(), count);
+}
+
+float left(VisualizerBuffer::Snapshot const& snapshot, size_t index) {
+    float l, r;
+    snapshot.read(index, l, r);
+    return l;
+}
+
+}
+
+TestVisualizerBuffer::TestVisualizerBuffer() {
+
+}
+
+void TestVisualizerBuffer::unpublishedWritesAreHidden() {
+    VisualizerBuffer buf;
+    buf.resize(TU::SIZE);
+
+    TU::writeFrames(buf, 1.0f, TU::SIZE);
+    auto snapshot = buf.snapshot();
+    QCOMPARE(snapshot.size(), TU::SIZE);
+    for (size_t i = 0; i < TU::SIZE; ++i) {
+        QCOMPARE(TU::left(snapshot, i), 0.0f);
+    }
+
+    buf.publish();
+    snapshot = buf.snapshot();
+    for (size_t i = 0; i < TU::SIZE; ++i) {
+        QCOMPARE(TU::left(snapshot, i), 1.0f + i);
+    }
+}
+
+void TestVisualizerBuffer::snapshotIsOldestFirst() {
+    VisualizerBuffer buf;
+    buf.resize(TU::SIZE);
+
+    // 1 2 3 then 4 5 6, the buffer has rotated and holds 3 4 5 6
+    TU::writeFrames(buf, 1.0f, 3);
+    TU::writeFrames(buf, 4.0f, 3);
+    buf.publish();
+
+    auto snapshot = buf.snapshot();
+    for (size_t i = 0; i < TU::SIZE; ++i) {
+        QCOMPARE(TU::left(snapshot, i), 3.0f + i);
+    }
+
+    // the bin for the last pixel stops at the newest sample
+    float l, r;
+    snapshot.averageSample(2.0f, 4.0f, l, r);
+    QCOMPARE(l, 5.5f);
+}
+
+void TestVisualizerBuffer::snapshotIsStableUntilTaken() {
+    VisualizerBuffer buf;
+    buf.resize(TU::SIZE);
+
+    TU::writeFrames(buf, 1.0f, TU::SIZE);
+    buf.publish();
+    auto snapshot = buf.snapshot();
+
+    // the producer keeps publishing while the consumer is reading
+    for (int i = 0; i < 5; ++i) {
+        TU::writeFrames(buf, 10.0f * (i + 1), TU::SIZE);
+        buf.publish();
+        QCOMPARE(TU::left(snapshot, 0), 1.0f);
+    }
+
+    // the next snapshot is the latest one
+    snapshot = buf.snapshot();
+    QCOMPARE(TU::left(snapshot, 0), 50.0f);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <QtTest/QtTest>
+
+class TestVisualizerBuffer : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    Q_INVOKABLE TestVisualizerBuffer();
+
+private slots:
+
+    void unpublishedWritesAreHidden();
+
+    void snapshotIsOldestFirst();
+
+    void snapshotIsStableUntilTaken();
+
+};
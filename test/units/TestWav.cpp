@@ -0,0 +1,76 @@
+#include "units/TestWav.hpp"
+
+#include "audio/Wav.hpp"
+
+#include <QFile>
+#include <QTemporaryDir>
+
+#include <cstdint>
+#include <vector>
+
+Q_DECLARE_METATYPE(Wav::Mode)
+
+#define TU TestWavTU
+namespace TU {
+
+// size of the header written by Wav, the data chunk's samples follow it
+constexpr int HEADER_SIZE = 58;
+
+uint32_t readU32(QByteArray const& data, int offset) {
+    auto const bytes = reinterpret_cast<uint8_t const*>(data.constData()) + offset;
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+}
+
+TestWav::TestWav() {
+
+}
+
+void TestWav::oddLength_data() {
+    QTest::addColumn<Wav::Mode>("mode");
+    QTest::addColumn<int>("samples");
+
+    QTest::newRow("buffered") << Wav::Mode::buffered << 1001;
+    QTest::newRow("mapped") << Wav::Mode::mapped << 1001;
+    // reserved for more than the smallest mapping (16 MiB), so the data fills
+    // the mapping exactly and the pad byte needs it to grow
+    QTest::newRow("mapped, pad grows") << Wav::Mode::mapped << 5592407;
+}
+
+void TestWav::oddLength() {
+    QFETCH(Wav::Mode, mode);
+    QFETCH(int, samples);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    auto const path = dir.filePath("test.wav");
+
+    // mono 24-bit with an odd sample count, an odd number of data bytes
+    std::vector<float> buf((size_t)samples);
+    for (size_t i = 0; i < buf.size(); ++i) {
+        buf[i] = (float)(i % 100) / 100.0f - 0.5f;
+    }
+    {
+        Wav wav(path.toStdString(), 1, 44100, Wav::Format::pcm24, mode, buf.size());
+        wav.write(buf.data(), buf.size());
+        QVERIFY(wav.finish());
+    }
+
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    auto const data = file.readAll();
+
+    auto const dataSize = (uint32_t)samples * 3;
+    QCOMPARE(data.size(), TU::HEADER_SIZE + (int)dataSize + 1);
+    QCOMPARE(data.left(4), QByteArray("RIFF"));
+    QCOMPARE(TU::readU32(data, 4), (uint32_t)data.size() - 8);
+    QCOMPARE(data.mid(38, 4), QByteArray("fact"));
+    QCOMPARE(TU::readU32(data, 46), (uint32_t)samples);
+    QCOMPARE(data.mid(50, 4), QByteArray("data"));
+    QCOMPARE(TU::readU32(data, 54), dataSize);
+    // the pad byte
+    QCOMPARE(data.back(), '\0');
+}
+
+#undef TU
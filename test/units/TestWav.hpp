@@ -0,0 +1,18 @@
+#pragma once
+
+#include <QtTest/QtTest>
+
+class TestWav : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    Q_INVOKABLE TestWav();
+
+private slots:
+
+    void oddLength_data();
+    void oddLength();
+
+};